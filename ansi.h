@@ -10,7 +10,10 @@ static char const clear_screen[] = "\x1b[2J";
 static char const clear_line[] = "\x1b[K";
 static inline void cursor_line(unsigned n) { printf("\x1b[%uH", n + 1); }
 static inline void cursor_column(unsigned n) { printf("\x1b[%uG", n + 1); }
+static inline void scroll_region(unsigned n) { printf("\x1b[1;%ur", n); }
+static char const reset_scroll_region[] = "\x1b[r";
 static char const show_cursor[] = "\x1b[?25h", hide_cursor[] = "\x1b[?25l";
+static char const mouse_on[] = "\x1b[?1000h", mouse_off[] = "\x1b[?1000l";
 static char const color_black[] = "\x1b[30m";
 static char const color_red[] = "\x1b[31m";
 static char const color_green[] = "\x1b[32m";
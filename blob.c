@@ -1,6 +1,7 @@
 
 #include "common.h"
 #include "blob.h"
+#include "scan.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -9,29 +10,88 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <pthread.h>
+
+#define BLOB_SAVE_CHUNK (1 << 20) /* bytes copied and written per step of a save */
+
+static void blob_saving_touch(struct blob *blob, size_t pos, size_t len);
+static void blob_saving_detach(struct blob *blob);
+static void blob_saving_drop(struct blob *blob);
 
 void blob_init(struct blob *blob)
 {
     memset(blob, 0, sizeof(*blob));
+    ranges_init(&blob->dirty);
+    ranges_init(&blob->holes);
     history_init(&blob->undo);
     history_init(&blob->redo);
+    snap_init(&blob->snaps);
+    blob->follow_fd = -1;
 }
 
-void blob_replace(struct blob *blob, size_t pos, byte const *data, size_t len, bool save_history)
+/* whether the next undo step joins the previous one */
+static bool blob_join(struct blob *blob)
+{
+    bool join = blob->batch == BATCH_OPEN;
+    if (blob->batch)
+        blob->batch = BATCH_OPEN;
+    blob->saved_dist += !join;
+    return join;
+}
+
+void blob_batch_begin(struct blob *blob)
+{
+    blob->batch = BATCH_EMPTY;
+}
+
+void blob_batch_end(struct blob *blob)
+{
+    blob->batch = BATCH_OFF;
+}
+
+/* makes [pos, pos + len) writable in place; blob_end_write() must follow */
+byte *blob_begin_write(struct blob *blob, size_t pos, size_t len, bool save_history)
 {
     assert(pos + len <= blob->len);
+    assert(blob_writable(blob, pos, len));
+    jobs_quiesce(blob);
 
     if (save_history) {
-        history_free(&blob->redo);
-        history_save(&blob->undo, REPLACE, blob, pos, len);
-        ++blob->saved_dist;
+        blob->history_mem -= history_free(&blob->redo);
+        history_save(&blob->undo, REPLACE, blob, pos, len, blob_join(blob));
     }
 
-    if (blob->dirty)
-        for (size_t i = pos / 0x1000; i < (pos + len + 0xfff) / 0x1000; ++i)
-            blob->dirty[i / 8] |= 1 << i % 8;
+    if (blob->alloc == BLOB_MMAP && len) {
+        size_t from = pos / 0x1000 * 0x1000, to = (pos + len + 0xfff) / 0x1000 * 0x1000;
+        ranges_add(&blob->dirty, from, to - from);
+    }
+    if (blob->alloc == BLOB_PROCESS && len)
+        ranges_add(&blob->dirty, pos, len);
+    else
+        ranges_remove(&blob->holes, pos, len);
+    snap_before_replace(blob, pos, len);
+    overview_touch(blob->overview, pos, len);
+    layout_touch(blob->layout, pos, len);
+    watch_touch(blob->watch, blob, pos, len);
+    blob_saving_touch(blob, pos, len);
+
+    if (blob->alloc == BLOB_PROCESS)
+        return procmem_begin_write(blob->proc, pos, len);
+    return blob->data + pos;
+}
 
-    memcpy(blob->data + pos, data, len);
+void blob_end_write(struct blob *blob, size_t pos, size_t len)
+{
+    if (blob->alloc == BLOB_PROCESS)
+        procmem_end_write(blob->proc, pos, len);
+    if (blob->journal && len)
+        journal_record(blob->journal, 'R', pos, blob->data + pos, len);
+}
+
+void blob_replace(struct blob *blob, size_t pos, byte const *data, size_t len, bool save_history)
+{
+    memcpy(blob_begin_write(blob, pos, len, save_history), data, len);
+    blob_end_write(blob, pos, len);
 }
 
 void blob_insert(struct blob *blob, size_t pos, byte const *data, size_t len, bool save_history)
@@ -39,18 +99,28 @@ void blob_insert(struct blob *blob, size_t pos, byte const *data, size_t len, bo
     assert(pos <= blob->len);
     assert(blob_can_move(blob));
     assert(len);
-    assert(!blob->dirty); /* not implemented */
+    jobs_quiesce(blob);
+    blob_saving_detach(blob);
+
+    if (blob->journal)
+        journal_record(blob->journal, 'I', pos, data, len);
 
     if (save_history) {
-        history_free(&blob->redo);
-        history_save(&blob->undo, INSERT, blob, pos, len);
-        ++blob->saved_dist;
+        blob->history_mem -= history_free(&blob->redo);
+        history_save(&blob->undo, INSERT, blob, pos, len, blob_join(blob));
     }
 
+    ranges_insert(&blob->holes, pos, len);
+    snap_before_move(blob);
+    watch_moved(blob->watch);
+
     blob->data = realloc_strict(blob->data, blob->len += len);
 
     memmove(blob->data + pos + len, blob->data + pos, blob->len - pos - len);
     memcpy(blob->data + pos, data, len);
+
+    overview_moved(blob->overview, pos, blob->len);
+    layout_moved(blob->layout);
 }
 
 void blob_delete(struct blob *blob, size_t pos, size_t len, bool save_history)
@@ -58,36 +128,58 @@ void blob_delete(struct blob *blob, size_t pos, size_t len, bool save_history)
     assert(pos + len <= blob->len);
     assert(blob_can_move(blob));
     assert(len);
-    assert(!blob->dirty); /* not implemented */
+    jobs_quiesce(blob);
+    blob_saving_detach(blob);
+
+    if (blob->journal)
+        journal_record(blob->journal, 'D', pos, NULL, len);
 
     if (save_history) {
-        history_free(&blob->redo);
-        history_save(&blob->undo, DELETE, blob, pos, len);
-        ++blob->saved_dist;
+        blob->history_mem -= history_free(&blob->redo);
+        history_save(&blob->undo, DELETE, blob, pos, len, blob_join(blob));
     }
 
+    ranges_delete(&blob->holes, pos, len);
+    snap_before_move(blob);
+    watch_moved(blob->watch);
+
     memmove(blob->data + pos, blob->data + pos + len, (blob->len -= len) - pos);
     blob->data = realloc_strict(blob->data, blob->len);
+
+    overview_moved(blob->overview, pos, blob->len);
+    layout_moved(blob->layout);
 }
 
 void blob_free(struct blob *blob)
 {
+    jobs_quiesce(blob);
+    blob_saving_drop(blob);
+    histfile_persist(blob);
     free(blob->filename);
+    blob_follow(blob, false);
 
     switch (blob->alloc) {
     case BLOB_MALLOC:
         free(blob->data);
         break;
     case BLOB_MMAP:
-        free(blob->dirty);
         munmap_strict(blob->data, blob->len);
         break;
+    case BLOB_PROCESS:
+        procmem_free(blob->proc);
+        break;
     }
 
-    free(blob->clipboard.data);
-
+    ranges_free(&blob->dirty);
+    ranges_free(&blob->holes);
+    journal_close(blob->journal);
     history_free(&blob->undo);
     history_free(&blob->redo);
+    histfile_free(blob->histfile);
+    snap_free(&blob->snaps);
+    overview_free(blob->overview);
+    layout_free(blob->layout);
+    watch_free(blob->watch);
 }
 
 bool blob_can_move(struct blob const *blob)
@@ -95,55 +187,121 @@ bool blob_can_move(struct blob const *blob)
     return blob->alloc == BLOB_MALLOC;
 }
 
-bool blob_undo(struct blob *blob, size_t *pos)
+/* approximate heap and private page usage */
+size_t blob_memory(struct blob const *blob)
 {
-    bool r = history_step(&blob->undo, blob, &blob->redo, pos);
-    blob->saved_dist -= r;
-    return r;
+    size_t mem = blob->history_mem + blob->snaps.mem;
+
+    switch (blob->alloc) {
+    case BLOB_MALLOC:
+        mem += blob->len;
+        break;
+    case BLOB_MMAP:
+        for (size_t i = 0; i < blob->dirty.n; ++i)
+            mem += blob->dirty.r[i].len;
+        break;
+    case BLOB_PROCESS:
+        mem += procmem_memory(blob->proc);
+        break;
+    }
+
+    return mem;
 }
 
-bool blob_redo(struct blob *blob, size_t *pos)
+/* drops resident pages that can be read back from the file */
+void blob_release(struct blob *blob)
 {
-    bool r = history_step(&blob->redo, blob, &blob->undo, pos);
-    blob->saved_dist += r;
-    return r;
+    size_t from = 0, to;
+
+    if (blob->alloc == BLOB_PROCESS)
+        procmem_drop(blob->proc);
+    if (blob->alloc != BLOB_MMAP || blob->saving)
+        return; /* pages being saved are not in dirty any more */
+
+    /* modified pages only exist in memory, so keep them */
+    for (size_t i = 0; i <= blob->dirty.n; ++i) {
+        to = i < blob->dirty.n ? blob->dirty.r[i].pos : blob->len;
+        if (to > from && madvise(blob->data + from, to - from, MADV_DONTNEED))
+            pdie("madvise");
+        if (i < blob->dirty.n)
+            from = range_end(&blob->dirty.r[i]);
+    }
+}
+
+size_t blob_undo(struct blob *blob, size_t steps, size_t *pos)
+{
+    size_t n = history_step(&blob->undo, blob, &blob->redo, steps, pos);
+    blob->saved_dist -= n;
+    return n;
+}
+
+size_t blob_redo(struct blob *blob, size_t steps, size_t *pos)
+{
+    size_t n = history_step(&blob->redo, blob, &blob->undo, steps, pos);
+    blob->saved_dist += n;
+    return n;
 }
 
 void blob_yank(struct blob *blob, size_t pos, size_t len)
 {
-    free(blob->clipboard.data);
-    blob->clipboard.data = NULL;
+    struct clipboard *clip = blob->clipboard;
+
+    free(clip->data);
+    clip->data = NULL;
 
     if (pos < blob_length(blob)) {
-        blob->clipboard.data = malloc_strict(blob->clipboard.len = len);
-        blob_read_strict(blob, pos, blob->clipboard.data, blob->clipboard.len);
+        clip->data = malloc_strict(clip->len = len);
+        blob_read_strict(blob, pos, clip->data, clip->len);
     }
 }
 
-size_t blob_paste(struct blob *blob, size_t pos, enum op_type type)
+/* pastes the clipboard count times over as one operation */
+size_t blob_paste(struct blob *blob, size_t pos, enum op_type type, size_t count)
 {
-    if (!blob->clipboard.data) return 0;
+    struct clipboard const *clip = blob->clipboard;
+    byte *data = clip->data;
+    size_t len;
+
+    if (!clip->data) return 0;
+
+    /* replacing past the end is cut off anyway */
+    if (type == REPLACE)
+        count = min(count, (blob->len - pos + clip->len - 1) / clip->len);
+    count = min(max(count, 1), SIZE_MAX / clip->len);
+    len = clip->len * count;
+
+    if (count > 1) {
+        data = malloc_strict(len);
+        for (size_t i = 0; i < count; ++i)
+            memcpy(data + i * clip->len, clip->data, clip->len);
+    }
 
     switch (type) {
     case REPLACE:
-        blob_replace(blob, pos, blob->clipboard.data, min(blob->clipboard.len, blob->len - pos), true);
+        blob_replace(blob, pos, data, min(len, blob->len - pos), true);
         break;
     case INSERT:
-        blob_insert(blob, pos, blob->clipboard.data, blob->clipboard.len, true);
+        blob_insert(blob, pos, data, len, true);
         break;
     default:
         die("bad operation");
     }
 
-    return blob->clipboard.len;
+    if (data != clip->data)
+        free(data);
+    return len;
 }
 
 #define DD(F,B) (dir > 0 ? (F) : (B))
 
-/* modified Boyer-Moore-Horspool algorithm. */
-static ssize_t blob_search_range(struct blob *blob, byte const *needle, size_t len, size_t start, ssize_t end, ssize_t dir, size_t tab[256])
+/* modified Boyer-Moore-Horspool algorithm.
+ * if the needle has a nonzero byte at offset nz, no match can place it
+ * inside a hole, so holes are skipped without touching their pages. */
+static ssize_t blob_search_range(struct blob *blob, byte const *needle, size_t len, size_t start, ssize_t end, ssize_t dir, size_t tab[256], ssize_t nz)
 {
     size_t blen = blob_length(blob);
+    struct ranges const *holes = &blob->holes;
+    size_t h = 0;
 
     assert(start < blen && end >= -1 && end <= (ssize_t) blen);
     assert(DD((ssize_t) start <= end, end <= (ssize_t) start));
@@ -151,8 +309,25 @@ static ssize_t blob_search_range(struct blob *blob, byte const *needle, size_t l
     if (len > DD(end-start, start-end)) /* needle longer than range */
         return -1;
 
+    if (nz >= 0)
+        h = ranges_find(holes, start + nz);
+
     for (ssize_t i = start; DD(i < end, i > end) ; ) {
 
+        if (nz >= 0) {
+            /* index of the hole nearest to i + nz in search direction */
+            if (dir > 0)
+                while (h < holes->n && range_end(&holes->r[h]) <= (size_t) i + nz)
+                    ++h;
+            else
+                while (h > 0 && (h >= holes->n || holes->r[h].pos > (size_t) i + nz))
+                    --h;
+            if (h < holes->n && holes->r[h].pos <= (size_t) i + nz && (size_t) i + nz < range_end(&holes->r[h])) {
+                i = DD((ssize_t) range_end(&holes->r[h]), (ssize_t) holes->r[h].pos - 1) - nz;
+                continue;
+            }
+        }
+
         if (i + len > blen) {
             /* not enough space for pattern: skip */
             i += dir;
@@ -191,18 +366,305 @@ ssize_t blob_search(struct blob *blob, byte const *needle, size_t len, size_t st
     for (size_t j = 0; j < len-1; ++j)
         tab[needle[DD(j, len-1-j)]] = len-1-j;
 
-    ssize_t r = blob_search_range(blob, needle, len, start, DD((ssize_t) blen, -1), dir, tab);
+    ssize_t nz = -1;
+    for (size_t j = 0; nz < 0 && j < len; ++j)
+        if (needle[j])
+            nz = j;
+    /* unmapped memory doesn't even hold zeros */
+    if (nz < 0 && blob->alloc == BLOB_PROCESS)
+        nz = 0;
+
+    ssize_t r = blob_search_range(blob, needle, len, start, DD((ssize_t) blen, -1), dir, tab, nz);
     if (r < 0)  /* wrap around */
-        r = blob_search_range(blob, needle, len, DD(0, blen-1), start, dir, tab);
+        r = blob_search_range(blob, needle, len, DD(0, blen-1), start, dir, tab, nz);
 
     return r;
 }
 
+/* start of the next (dir > 0) or current/previous (dir < 0) hole or data extent;
+ * in process memory, of the next or current/previous mapping */
+size_t blob_next_extent(struct blob const *blob, size_t pos, ssize_t dir)
+{
+    struct ranges const *holes = &blob->holes;
+    struct procmem const *pm = blob->proc;
+    size_t i;
+
+    if (blob->alloc == BLOB_PROCESS) {
+        i = procmem_region(pm, pos);
+        if (dir > 0) {
+            i += i < pm->n && pm->regions[i].pos <= pos;
+            return i < pm->n ? pm->regions[i].pos : blob->len;
+        }
+        i = pos ? procmem_region(pm, pos - 1) : 0;
+        if (i < pm->n && pm->regions[i].pos < pos)
+            return pm->regions[i].pos;
+        return i ? pm->regions[i - 1].pos : 0;
+    }
+
+    if (dir > 0) {
+        if ((i = ranges_find(holes, pos)) == holes->n)
+            return blob->len;
+        return holes->r[i].pos <= pos ? range_end(&holes->r[i]) : holes->r[i].pos;
+    }
+
+    if (!pos)
+        return 0;
+    i = ranges_find(holes, pos - 1);
+    if (i < holes->n && holes->r[i].pos <= pos - 1)
+        return holes->r[i].pos;
+    return i ? range_end(&holes->r[i - 1]) : 0;
+}
+
 #undef DD
 
+/* first position from pos on (dir > 0) or at/before pos (dir < 0) that doesn't
+ * hold the byte b, or -1 if there is none. holes are skipped over in one step. */
+ssize_t blob_skip_fill(struct blob const *blob, size_t pos, byte b, ssize_t dir)
+{
+    struct ranges const *holes = &blob->holes;
+    byte const *ptr;
+    size_t h, n, k;
+
+    assert(dir == +1 || dir == -1);
+
+    if (dir > 0) {
+        for (size_t i = pos; i < blob->len; i += n) {
+            h = ranges_find(holes, i);
+            if (h < holes->n && holes->r[h].pos <= i) {
+                if (b)
+                    return i;
+                n = range_end(&holes->r[h]) - i;
+                continue;
+            }
+            ptr = blob_lookup(blob, i, &n);
+            if (h < holes->n)
+                n = min(n, holes->r[h].pos - i);
+            if ((k = scan_fill(ptr, n, b)) < n)
+                return i + k;
+        }
+        return -1;
+    }
+
+    for (size_t i = pos + 1; i; i -= n) { /* i is exclusive here */
+        h = ranges_find(holes, i - 1);
+        if (h < holes->n && holes->r[h].pos < i) {
+            if (b)
+                return i - 1;
+            n = i - holes->r[h].pos;
+            continue;
+        }
+        ptr = blob_lookup_back(blob, i, &n);
+        if (h)
+            n = min(n, i - range_end(&holes->r[h - 1]));
+        if ((k = scan_fill_back(ptr, n, b)) < n)
+            return i - 1 - k;
+    }
+    return -1;
+}
+
+/* start of the nearest run of at least minlen equal bytes after (dir > 0) or
+ * before (dir < 0) the run containing pos, or -1 if there is none. */
+ssize_t blob_find_run(struct blob const *blob, size_t pos, size_t minlen, ssize_t dir)
+{
+    struct ranges const *holes = &blob->holes;
+    byte const *ptr;
+    byte last;
+    size_t h, n, k, cnt = 0;
+    ssize_t i;
+
+    assert(dir == +1 || dir == -1);
+    assert(pos < blob->len && minlen);
+
+    /* leave the current run first */
+    if (0 > (i = blob_skip_fill(blob, pos, blob_at(blob, pos), dir)))
+        return -1;
+    last = blob_at(blob, i);
+
+    if (dir > 0) {
+        for (; (size_t) i < blob->len; i += n) {
+            h = ranges_find(holes, i);
+            if (h < holes->n && holes->r[h].pos <= (size_t) i) {
+                n = range_end(&holes->r[h]) - i;
+                cnt = last ? 0 : cnt;
+                last = 0;
+                if (cnt + n >= minlen)
+                    return i - cnt;
+                cnt += n;
+                continue;
+            }
+            ptr = blob_lookup(blob, i, &n);
+            if (h < holes->n)
+                n = min(n, holes->r[h].pos - i);
+            if ((k = scan_run(ptr, n, &last, &cnt, minlen)) < n)
+                return i + k + 1 - minlen;
+        }
+        return -1;
+    }
+
+    /* the same, mirrored: runs are counted from their end */
+    for (size_t j = i + 1; j; j -= n) {
+        h = ranges_find(holes, j - 1);
+        if (h < holes->n && holes->r[h].pos < j) {
+            n = j - holes->r[h].pos;
+            cnt = last ? 0 : cnt;
+            last = 0;
+            if (cnt + n >= minlen) {
+                /* found; extend the run to where it actually starts */
+                ssize_t s = blob_skip_fill(blob, j - 1, 0, -1);
+                return s + 1;
+            }
+            cnt += n;
+            continue;
+        }
+        ptr = blob_lookup_back(blob, j, &n);
+        if (h)
+            n = min(n, j - range_end(&holes->r[h - 1]));
+        for (size_t m = 0; m < n; m += k) {
+            if (ptr[-(ssize_t) m - 1] != last) {
+                last = ptr[-(ssize_t) m - 1];
+                cnt = 0;
+            }
+            k = scan_fill_back(ptr - m, min(n - m, minlen - cnt), last);
+            if ((cnt += k) >= minlen) {
+                ssize_t s = blob_skip_fill(blob, j - 1 - m, last, -1);
+                return s + 1;
+            }
+        }
+    }
+    return -1;
+}
+
+/* first position p from pos on (dir > 0) or at/before pos (dir < 0) where
+ * a[p] and b[p + delta] differ (or agree, if !want_diff). bytes present in
+ * only one of the blobs count as different. returns -1 if there is none. */
+ssize_t blob_compare(struct blob const *a, struct blob const *b, ssize_t delta, size_t pos, ssize_t dir, bool want_diff)
+{
+    byte const *pa, *pb;
+    size_t na, nb, k;
+
+    /* both blobs have bytes exactly in [lo, hi); the union ends at end */
+    ssize_t alen = a->len, blen = (ssize_t) b->len > delta ? (ssize_t) b->len - delta : 0;
+    ssize_t lo = delta < 0 ? -delta : 0;
+    ssize_t hi = alen < blen ? alen : blen;
+    ssize_t end = alen > blen ? alen : blen;
+    ssize_t p = pos;
+
+    assert(dir == +1 || dir == -1);
+
+    if (hi < lo)
+        hi = lo;
+
+    if (dir > 0) {
+        if (p < lo) {
+            if (p >= alen) /* in neither blob */
+                return -1;
+            if (want_diff)
+                return p;
+            p = lo;
+        }
+        for (; p < hi; p += k) {
+            pa = blob_lookup(a, p, &na);
+            pb = blob_lookup(b, p + delta, &nb);
+            na = min(min(na, nb), hi - p);
+            if ((k = (want_diff ? scan_diff : scan_same)(pa, pb, na)) < na)
+                return p + k;
+        }
+        return want_diff && p < end ? p : -1;
+    }
+
+    if (p >= hi) {
+        if (want_diff && p < end)
+            return p;
+        p = hi - 1;
+    }
+    for (; p >= lo; p -= k) {
+        pa = blob_lookup_back(a, p + 1, &na);
+        pb = blob_lookup_back(b, p + 1 + delta, &nb);
+        na = min(min(na, nb), p + 1 - lo);
+        if ((k = (want_diff ? scan_diff_back : scan_same_back)(pa, pb, na)) < na)
+            return p - k;
+    }
+    return want_diff && p >= 0 && p < alen ? p : -1;
+}
+
+/* offset of the occurrence of needle in hay closest to hay + center, or -1 */
+static ssize_t memmem_nearest(byte const *hay, size_t haylen, byte const *needle, size_t len, size_t center)
+{
+    ssize_t best = -1;
+    for (byte const *p = hay; (p = memmem(p, haylen - (p - hay), needle, len)); ++p) {
+        if (best < 0 || absdiff(p - hay, center) < absdiff(best, center))
+            best = p - hay;
+        if ((size_t) (p - hay) >= center)
+            break;
+    }
+    return best;
+}
+
+/* tries to find an alignment of a and b that makes them agree again from pos
+ * on, assuming bytes were inserted into or deleted from one of them. */
+bool blob_resync(struct blob *a, struct blob *b, ssize_t *delta, size_t pos)
+{
+    size_t const w = CONFIG_RESYNC_WINDOW, r = CONFIG_RESYNC_RADIUS;
+    byte needle[CONFIG_RESYNC_WINDOW], *buf;
+    ssize_t q = pos + *delta, k, best = 0;
+    bool found = false;
+    size_t from, to;
+
+    if (pos + w > a->len || q < 0 || (size_t) q + w > b->len)
+        return false;
+    buf = malloc_strict(2 * r + w);
+
+    /* bytes missing from a: find a's window in b around q */
+    blob_read_strict(a, pos, needle, w);
+    from = q > (ssize_t) r ? q - r : 0;
+    to = min(q + r + w, b->len);
+    blob_read_strict(b, from, buf, to - from);
+    if (0 <= (k = memmem_nearest(buf, to - from, needle, w, q - from))) {
+        best = from + k - q;
+        found = true;
+    }
+
+    /* bytes missing from b: find b's window in a after pos */
+    blob_read_strict(b, q, needle, w);
+    to = min(pos + r + w, a->len);
+    blob_read_strict(a, pos, buf, to - pos);
+    if (0 <= (k = memmem_nearest(buf, to - pos, needle, w, 0)) && (!found || k < labs(best))) {
+        best = -k;
+        found = true;
+    }
+
+    free(buf);
+
+    if (!found || !best)
+        return false;
+    *delta += best;
+    return true;
+}
+
 
 /* blob_load* functions must be called with a fresh struct from blob_init() */
 
+static void blob_load_holes(struct blob *blob, int fd)
+{
+#ifdef SEEK_HOLE
+    off_t data, hole = 0;
+
+    while ((size_t) hole < blob->len) {
+        errno = 0;
+        if (0 > (data = lseek(fd, hole, SEEK_DATA))) {
+            if (errno == ENXIO) /* only a hole left until the end */
+                ranges_add(&blob->holes, hole, blob->len - hole);
+            break; /* or not supported at all */
+        }
+        ranges_add(&blob->holes, hole, data - hole);
+        if (0 > (hole = lseek(fd, data, SEEK_HOLE)))
+            break;
+    }
+#else
+    (void) blob, (void) fd;
+#endif
+}
+
 void blob_load(struct blob *blob, char const *filename)
 {
     struct stat st;
@@ -228,6 +690,8 @@ void blob_load(struct blob *blob, char const *filename)
     case S_IFREG:
         blob->len = st.st_size;
         blob->alloc = blob->len >= CONFIG_LARGE_FILESIZE ? BLOB_MMAP : BLOB_MALLOC;
+        blob_load_holes(blob, fd);
+        blob->watch = watch_new(filename);
         break;
     case S_IFBLK:
         blob->len = lseek_strict(fd, 0, SEEK_END);
@@ -250,8 +714,6 @@ void blob_load(struct blob *blob, char const *filename)
     case BLOB_MMAP:
         assert(ptr);
         blob->data = ptr;
-        if (!(blob->dirty = calloc(((blob->len + 0xfff) / 0x1000 + 7) / 8, sizeof(*blob->dirty))))
-            pdie("calloc");
         break;
 
     case BLOB_MALLOC:
@@ -265,6 +727,7 @@ void blob_load(struct blob *blob, char const *filename)
     default:
         die("bad blob type");
     }
+    blob->loaded = blob->len;
 
     if (close(fd))
         pdie("close");
@@ -291,11 +754,455 @@ void blob_load_stream(struct blob *blob, FILE *fp)
     blob->data = realloc(blob->data, (blob->len = n));
 }
 
-enum blob_save_error blob_save(struct blob *blob, char const *filename)
+void blob_load_process(struct blob *blob, pid_t pid)
+{
+    struct procmem *pm = blob->proc = procmem_open(pid);
+    char name[64];
+    size_t end = 0;
+
+    snprintf(name, sizeof(name), "/proc/%ld/mem", (long) pid);
+    blob->filename = strdup(name);
+    blob->alloc = BLOB_PROCESS;
+    blob->len = pm->regions[pm->n - 1].pos + pm->regions[pm->n - 1].len;
+
+    /* the gaps between mappings, and mappings that can't be read */
+    for (size_t i = 0; i < pm->n; ++i) {
+        if (pm->regions[i].pos > end)
+            ranges_add(&blob->holes, end, pm->regions[i].pos - end);
+        if (pm->regions[i].perms[0] != 'r')
+            ranges_add(&blob->holes, pm->regions[i].pos, pm->regions[i].len);
+        end = pm->regions[i].pos + pm->regions[i].len;
+    }
+}
+
+/* follow mode: what is appended to the file is appended to the blob */
+bool blob_follow(struct blob *blob, bool on)
+{
+    if (!on) {
+        if (blob->follow_fd >= 0 && close(blob->follow_fd))
+            pdie("close");
+        blob->follow_fd = -1;
+        return true;
+    }
+    if (blob->follow_fd >= 0)
+        return true;
+    if (blob->alloc == BLOB_PROCESS || !blob->filename)
+        return false;
+    return 0 <= (blob->follow_fd = open(blob->filename, O_RDONLY));
+}
+
+/* reads [pos, pos + len) of the file; returns how much there was */
+static size_t blob_pread(int fd, byte *buf, size_t pos, size_t len)
+{
+    ssize_t r;
+    size_t n;
+
+    for (n = 0; n < len; n += r)
+        if (0 >= (r = pread(fd, buf + n, len - n, pos + n))) {
+            if (r < 0)
+                pdie("pread");
+            break;
+        }
+    return n;
+}
+
+/* appends up to n bytes of the file from where the blob stopped; returns how many */
+static size_t blob_extend(struct blob *blob, int fd, size_t n)
+{
+    size_t old = blob->len;
+
+    jobs_quiesce(blob);
+    blob_saving_detach(blob);
+    snap_before_move(blob);
+
+    switch (blob->alloc) {
+
+    case BLOB_MMAP:
+        /* the mapping covers the whole file, so it simply gets longer */
+        assert(blob->loaded == blob->len && blob->len);
+        blob->data = mremap_strict(blob->data, blob->len, blob->len + n);
+        /* the old last page may be a private copy that doesn't see the new bytes */
+        if (blob->len % 0x1000)
+            blob_pread(fd, blob->data + blob->len, blob->len, min(n, 0x1000 - blob->len % 0x1000));
+        break;
+
+    case BLOB_MALLOC:
+        blob->data = realloc_strict(blob->data, blob->len + n);
+        n = blob_pread(fd, blob->data + blob->len, blob->loaded, n);
+        break;
+
+    default:
+        die("bad blob type");
+    }
+
+    blob->len += n;
+    blob->loaded += n;
+    if (n) {
+        overview_moved(blob->overview, old, blob->len);
+        layout_moved(blob->layout);
+    }
+    return n;
+}
+
+/* takes in whatever the file grew by since it was last looked at; returns that length */
+size_t blob_grow(struct blob *blob)
+{
+    struct stat st;
+    size_t size, n;
+
+    if (blob->follow_fd < 0)
+        return 0;
+    if (fstat(blob->follow_fd, &st))
+        pdie("fstat");
+    size = S_ISBLK(st.st_mode) ? (size_t) lseek_strict(blob->follow_fd, 0, SEEK_END) : (size_t) st.st_size;
+    if (size <= blob->loaded)
+        return 0; /* shrinking is ignored */
+
+    /* growing is expected here, so it is no change by someone else */
+    if ((n = blob_extend(blob, blob->follow_fd, size - blob->loaded)) && blob->watch)
+        watch_resync(blob->watch, blob->filename);
+    return n;
+}
+
+/* overwrites bytes with what the file now holds there */
+static void blob_reload_range(struct blob *blob, byte const *data, size_t pos, size_t len)
+{
+    snap_before_replace(blob, pos, len);
+    memcpy(blob->data + pos, data, len);
+    overview_touch(blob->overview, pos, len);
+    layout_touch(blob->layout, pos, len);
+}
+
+/* takes in what others changed in the file, reading it block by block; where
+ * a block has modifications of our own, these are kept and merged with the
+ * file's other bytes.  Counts blocks taken in, and blocks with kept edits. */
+enum blob_reload_error blob_reload(struct blob *blob, size_t *changed, size_t *kept)
+{
+    struct watch *w = blob->watch;
+    struct stat st;
+    size_t size, common, from, end, p, q, k, n;
+    byte *buf;
+    int fd;
+
+    *changed = *kept = 0;
+    if (!w)
+        return BLOB_RELOAD_UNWATCHED;
+    if (w->moved)
+        return BLOB_RELOAD_MOVED;
+    if (0 > (fd = open(blob->filename, O_RDONLY)))
+        return BLOB_RELOAD_UNREADABLE;
+    if (fstat(fd, &st))
+        pdie("fstat");
+    size = st.st_size;
+    if (blob->alloc == BLOB_MMAP && size < blob->len) {
+        close(fd);
+        return BLOB_RELOAD_SHRUNK;
+    }
+
+    jobs_quiesce(blob);
+    blob_saving_detach(blob);
+    buf = malloc_strict(WATCH_BLOCK);
+    common = min(size, blob->len);
+
+    for (size_t i = 0; i * WATCH_BLOCK < common; ++i) {
+        from = i * WATCH_BLOCK;
+        n = blob_pread(fd, buf, from, min(WATCH_BLOCK, common - from));
+
+        if (!watch_block_modified(w, i)) {
+            if (memcmp(blob->data + from, buf, n)) {
+                blob_reload_range(blob, buf, from, n);
+                ++*changed;
+            }
+        }
+        else if (watch_sum(buf, n) != w->sums[i]) {
+            /* the file's bytes go wherever there are none of ours */
+            end = from + n;
+            for (p = from, k = ranges_find(&w->modified, from); p < end; ++k) {
+                q = k < w->modified.n ? max(p, min(w->modified.r[k].pos, end)) : end;
+                if (q > p)
+                    blob_reload_range(blob, buf + (p - from), p, q - p);
+                p = k < w->modified.n ? max(q, min(range_end(&w->modified.r[k]), end)) : end;
+            }
+            w->sums[i] = watch_sum(buf, n);
+            ++*kept;
+        }
+    }
+
+    if (size > blob->len)
+        *changed += (blob_extend(blob, fd, size - blob->len) + WATCH_BLOCK - 1) / WATCH_BLOCK;
+    else if (size < blob->len) {
+        if (ranges_intersects(&w->modified, size, blob->len - size))
+            ++*kept; /* our own bytes past the file's end stay */
+        else {
+            snap_before_move(blob);
+            blob->data = realloc_strict(blob->data, blob->len = size);
+            overview_moved(blob->overview, size, size);
+            layout_moved(blob->layout);
+            ++*changed;
+        }
+    }
+    blob->loaded = size;
+
+    free(buf);
+    if (close(fd))
+        pdie("close");
+    watch_resync(w, blob->filename);
+
+    /* the journal is relative to the file, which has changed */
+    if (blob->journal) {
+        journal_reset(blob->journal, blob);
+        for (size_t i = 0; i < w->modified.n; ++i) {
+            from = w->modified.r[i].pos;
+            if (from < blob->len)
+                journal_record(blob->journal, 'R', from, blob->data + from,
+                        min(w->modified.r[i].len, blob->len - from));
+        }
+    }
+
+    return BLOB_RELOAD_OK;
+}
+
+/* whether pos is in none of the readable mappings of a process */
+bool blob_unmapped(struct blob const *blob, size_t pos)
+{
+    size_t i;
+
+    if (blob->alloc != BLOB_PROCESS)
+        return false;
+    i = ranges_find(&blob->holes, pos);
+    return i < blob->holes.n && blob->holes.r[i].pos <= pos;
+}
+
+/* whether [pos, pos + len) can be written: in a process, only where it is mapped */
+bool blob_writable(struct blob const *blob, size_t pos, size_t len)
+{
+    return blob->alloc != BLOB_PROCESS || !ranges_intersects(&blob->holes, pos, len);
+}
+
+static bool is_zero(byte const *ptr, size_t len)
+{
+    return !len || (!*ptr && !memcmp(ptr, ptr + 1, len - 1));
+}
+
+static bool blob_write_data(int fd, byte const *ptr, size_t pos, size_t len)
+{
+    ssize_t r;
+    for (size_t i = 0; i < len; i += r)
+        if (0 >= (r = pwrite(fd, ptr + i, len - i, pos + i)))
+            return false;
+    return true;
+}
+
+static bool blob_write_hole(int fd, size_t pos, size_t len)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (!fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len))
+        return true;
+#endif
+    /* can't punch holes here: write the zeros instead */
+    static byte const zeros[0x1000];
+    for (size_t i = 0; i < len; i += sizeof(zeros))
+        if (!blob_write_data(fd, zeros, pos + i, min(sizeof(zeros), len - i)))
+            return false;
+    return true;
+}
+
+/* writes buf to [pos, pos + len); on sparse targets, zero pages become holes again */
+static bool blob_write_range(int fd, byte const *buf, size_t pos, size_t len,
+        struct ranges const *holes, bool sparse)
+{
+    size_t zero = 0, data = 0; /* lengths of the pending runs of zero and data pages */
+    size_t h;
+
+    for (size_t i = pos, n; i < pos + len; i += n) {
+
+        if (sparse) {
+            h = ranges_find(holes, i);
+            if (h < holes->n && holes->r[h].pos <= i) {
+                /* known to be zero: don't even look at it */
+                n = min(range_end(&holes->r[h]), pos + len) - i;
+                goto zero;
+            }
+            n = min(pos + len - i, 0x1000 - i % 0x1000);
+            if (n == 0x1000 && is_zero(buf + (i - pos), n))
+                goto zero;
+        }
+        else
+            n = pos + len - i;
+
+        if (zero && !blob_write_hole(fd, i - zero, zero))
+            return false;
+        zero = 0;
+        data += n;
+        continue;
+
+zero:
+        if (data && !blob_write_data(fd, buf + (i - data - pos), i - data, data))
+            return false;
+        data = 0;
+        zero += n;
+    }
+
+    if (data && !blob_write_data(fd, buf + (len - data), pos + len - data, data))
+        return false;
+    if (zero && !blob_write_hole(fd, pos + len - zero, zero))
+        return false;
+    return true;
+}
+
+/* writes the modified bytes back into the process */
+static enum blob_save_error blob_save_process(struct blob *blob, char const *filename)
 {
+    if (filename && strcmp(filename, blob->filename))
+        return BLOB_SAVE_PROCESS;
+
+    for (size_t k = 0; k < blob->dirty.n; ++k)
+        if (!procmem_write_back(blob->proc, blob->dirty.r[k].pos, blob->dirty.r[k].len))
+            return errno == EACCES || errno == EPERM ? BLOB_SAVE_PERMISSIONS : BLOB_SAVE_FAULT;
+
+    procmem_saved(blob->proc);
+    blob->saved_dist = 0;
+    ranges_clear(&blob->dirty);
+    return BLOB_SAVE_OK;
+}
+
+/*
+ * Saving takes a snapshot of the blob without copying it up front: the
+ * ranges to write are split into chunks that refer to the blob's bytes in
+ * place.  Whatever is about to overwrite a chunk not yet written first
+ * copies it, and whatever moves the blob's bytes copies all of them.  The
+ * writer copies each chunk out under the lock before writing it, so edits
+ * can go on while a save runs on another thread.
+ */
+
+struct blob_chunk {
+    size_t pos, len;
+    byte *copy; /* NULL while the bytes are still the blob's */
+};
+
+struct blob_image {
+    pthread_mutex_t lock;
+    struct blob *blob; /* NULL once the blob is gone */
+    byte const *live; /* the blob's bytes, NULL once everything is copied */
+    bool touched; /* the blob was modified during the save */
+
+    size_t len;
+    struct ranges holes, dirty;
+    size_t n, next; /* chunks, and the first that isn't written yet */
+    struct blob_chunk *chunks;
+    size_t total, done; /* bytes to write, and written */
+
+    char *filename;
     int fd;
+    bool sparse;
+    ssize_t dist; /* undo steps between the blob and the saved state when the save began */
+    enum blob_save_error err;
+};
+
+static void image_lock(struct blob_image *img)
+{
+    if (pthread_mutex_lock(&img->lock))
+        die("pthread_mutex_lock");
+}
+
+static void image_unlock(struct blob_image *img)
+{
+    if (pthread_mutex_unlock(&img->lock))
+        die("pthread_mutex_unlock");
+}
+
+static void image_add(struct blob_image *img, size_t pos, size_t len, size_t *cap)
+{
+    for (size_t n; len; pos += n, len -= n) {
+        if (img->n == *cap)
+            img->chunks = realloc_strict(img->chunks, (*cap = max(16, 2 * *cap)) * sizeof(*img->chunks));
+        n = min(len, BLOB_SAVE_CHUNK);
+        img->chunks[img->n].pos = pos;
+        img->chunks[img->n].len = n;
+        img->chunks[img->n++].copy = NULL;
+        img->total += n;
+    }
+}
+
+/* with the lock held */
+static void image_copy(struct blob_image *img, struct blob_chunk *c)
+{
+    if (c->copy)
+        return;
+    c->copy = malloc_strict(c->len);
+    memcpy(c->copy, img->live + c->pos, c->len);
+}
+
+/* [pos, pos + len) of the blob is about to be overwritten */
+static void blob_saving_touch(struct blob *blob, size_t pos, size_t len)
+{
+    struct blob_image *img = blob->saving;
+    size_t lo, hi, m;
+
+    if (!img)
+        return;
+
+    image_lock(img);
+    img->touched = true;
+    if (img->live && len) {
+        /* the first chunk ending after pos */
+        for (lo = img->next, hi = img->n; lo < hi; ) {
+            m = lo + (hi - lo) / 2;
+            if (img->chunks[m].pos + img->chunks[m].len <= pos)
+                lo = m + 1;
+            else
+                hi = m;
+        }
+        for (; lo < img->n && img->chunks[lo].pos < pos + len; ++lo)
+            image_copy(img, &img->chunks[lo]);
+    }
+    image_unlock(img);
+}
+
+/* the blob's bytes are about to move or go away */
+static void blob_saving_detach(struct blob *blob)
+{
+    struct blob_image *img = blob->saving;
+
+    if (!img)
+        return;
+
+    image_lock(img);
+    img->touched = true;
+    if (img->live)
+        for (size_t i = img->next; i < img->n; ++i)
+            image_copy(img, &img->chunks[i]);
+    img->live = NULL;
+    image_unlock(img);
+}
+
+/* the blob goes away, but its save goes on */
+static void blob_saving_drop(struct blob *blob)
+{
+    if (!blob->saving)
+        return;
+    blob_saving_detach(blob);
+    blob->saving->blob = NULL;
+}
+
+/* checks whether the blob can be saved and takes its snapshot; the
+ * snapshot is written with blob_save_write() and finished with blob_save_end() */
+enum blob_save_error blob_save_begin(struct blob *blob, char const *filename)
+{
+    struct blob_image *img;
     struct stat st;
-    byte const *ptr;
+    size_t cap = 0, pos;
+    int fd;
+
+    if (blob->saving)
+        return BLOB_SAVE_PENDING;
+
+    /* don't silently overwrite what someone else wrote */
+    if (blob->watch && (!filename || !strcmp(filename, blob->filename))) {
+        watch_poll(blob->watch, blob->filename);
+        if (blob->watch->changed)
+            return BLOB_SAVE_CHANGED;
+    }
 
     if (filename) {
         free(blob->filename);
@@ -308,7 +1215,7 @@ enum blob_save_error blob_save(struct blob *blob, char const *filename)
 
     errno = 0;
     if (0 > (fd = open(filename,
-                    O_WRONLY | O_CREAT,
+                    O_WRONLY | O_CREAT | O_CLOEXEC,
                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH))) {
         switch (errno) {
         case ENOENT:  return BLOB_SAVE_NONEXISTENT;
@@ -321,33 +1228,156 @@ enum blob_save_error blob_save(struct blob *blob, char const *filename)
     if (fstat(fd, &st))
         pdie("fstat");
 
-    if ((st.st_mode & S_IFMT) == S_IFREG && ftruncate(fd, blob->len))
-            pdie("ftruncate");
+    img = malloc_strict(sizeof(*img));
+    memset(img, 0, sizeof(*img));
+    if (pthread_mutex_init(&img->lock, NULL))
+        die("pthread_mutex_init");
+    img->blob = blob;
+    img->live = blob->data;
+    img->len = blob->len;
+    img->filename = strdup(filename);
+    img->fd = fd;
+    img->sparse = (st.st_mode & S_IFMT) == S_IFREG;
+    img->dist = blob->saved_dist;
+    ranges_init(&img->holes);
+    ranges_init(&img->dirty);
+    for (size_t k = 0; k < blob->holes.n; ++k)
+        ranges_add(&img->holes, blob->holes.r[k].pos, blob->holes.r[k].len);
+
+    if (blob->alloc == BLOB_MMAP) {
+        /* only write back what was modified; what is modified from now on is not saved */
+        for (size_t k = 0; k < blob->dirty.n; ++k) {
+            pos = blob->dirty.r[k].pos;
+            image_add(img, pos, min(range_end(&blob->dirty.r[k]), blob->len) - pos, &cap);
+            ranges_add(&img->dirty, pos, blob->dirty.r[k].len);
+        }
+        ranges_clear(&blob->dirty);
+    }
+    else
+        image_add(img, 0, blob->len, &cap);
+
+    blob->saving = img;
+    return BLOB_SAVE_OK;
+}
 
-    for (size_t i = 0, n; i < blob->len; i += n) {
+/* writes the snapshot to the file; may run on another thread */
+void blob_save_write(struct blob_image *img, bool (*progress)(void *arg, size_t done, size_t total), void *arg)
+{
+    struct blob_chunk *c;
+    byte *buf = malloc_strict(BLOB_SAVE_CHUNK);
+    byte const *src;
+
+    if (img->sparse && ftruncate(img->fd, img->len))
+        img->err = BLOB_SAVE_WRITE;
+
+    for (size_t i = 0; !img->err && i < img->n; ++i) {
+        c = &img->chunks[i];
+
+        /* from here on, the chunk is ours */
+        image_lock(img);
+        if (!(src = c->copy))
+            memcpy(buf, img->live + c->pos, c->len);
+        img->next = i + 1;
+        image_unlock(img);
+
+        if (!blob_write_range(img->fd, src ? src : buf, c->pos, c->len, &img->holes, img->sparse))
+            img->err = BLOB_SAVE_WRITE;
+        free(c->copy);
+        c->copy = NULL;
+        img->done += c->len;
+        if (progress)
+            progress(arg, img->done, img->total); /* saving can't be cancelled halfway */
+    }
 
-        if (blob->dirty && !(blob->dirty[i / 0x1000 / 8] & (1 << i / 0x1000 % 8))) {
-            n = 0x1000 - i % 0x1000;
-            continue;
+    free(buf);
+}
+
+static void blob_journal_all(struct blob *blob, size_t saved_len)
+{
+    if (!blob->journal)
+        return;
+    journal_reset(blob->journal, blob);
+    if (blob->alloc == BLOB_MMAP) {
+        for (size_t k = 0; k < blob->dirty.n; ++k) {
+            size_t pos = blob->dirty.r[k].pos;
+            journal_record(blob->journal, 'R', pos, blob->data + pos,
+                    min(range_end(&blob->dirty.r[k]), blob->len) - pos);
         }
+    }
+    else {
+        if (saved_len)
+            journal_record(blob->journal, 'D', 0, NULL, saved_len);
+        if (blob->len)
+            journal_record(blob->journal, 'I', 0, blob->data, blob->len);
+    }
+}
 
-        ptr = blob_lookup(blob, i, &n);
-        if (blob->dirty)
-            n = min(0x1000 - i % 0x1000, n);
+/* completes a save in the main loop: the blob counts as saved, apart from
+ * what was changed during the save */
+enum blob_save_error blob_save_end(struct blob_image *img)
+{
+    struct blob *blob = img->blob;
+    enum blob_save_error err = img->err;
 
-        if ((ssize_t) i != lseek(fd, i, SEEK_SET))
-            pdie("lseek");
+    if (close(img->fd) && !err)
+        err = BLOB_SAVE_WRITE;
 
-        if (0 >= (n = write(fd, ptr, n)))
-            pdie("write");
+    if (blob && err) {
+        /* nothing counts as saved */
+        for (size_t k = 0; k < img->dirty.n; ++k)
+            ranges_add(&blob->dirty, img->dirty.r[k].pos, img->dirty.r[k].len);
     }
+    else if (blob) {
+        blob->saved_dist -= img->dist;
+        blob->loaded = img->len;
+        if (!img->touched) {
+            if (blob->journal)
+                journal_reset(blob->journal, blob);
+        }
+        else
+            blob_journal_all(blob, img->len);
+        histfile_saved(blob);
 
-    if (close(fd))
-        pdie("close");
+        if (!blob->watch) {
+            if (img->sparse)
+                blob->watch = watch_new(img->filename);
+        }
+        else if (img->touched)
+            watch_resync(blob->watch, img->filename);
+        else
+            watch_saved(blob->watch, img->filename);
+
+        /* keep following the file that was just written, which may be a new one */
+        if (blob->follow_fd >= 0) {
+            blob_follow(blob, false);
+            blob_follow(blob, true);
+        }
+    }
+    if (blob)
+        blob->saving = NULL;
+
+    for (size_t i = 0; i < img->n; ++i)
+        free(img->chunks[i].copy);
+    free(img->chunks);
+    ranges_free(&img->holes);
+    ranges_free(&img->dirty);
+    free(img->filename);
+    pthread_mutex_destroy(&img->lock);
+    free(img);
+    return err;
+}
 
-    blob->saved_dist = 0;
+enum blob_save_error blob_save(struct blob *blob, char const *filename)
+{
+    enum blob_save_error err;
 
-    return BLOB_SAVE_OK;
+    if (blob->alloc == BLOB_PROCESS)
+        return blob_save_process(blob, filename);
+
+    if ((err = blob_save_begin(blob, filename)))
+        return err;
+    blob_save_write(blob->saving, NULL, NULL);
+    return blob_save_end(blob->saving);
 }
 
 bool blob_is_saved(struct blob const *blob)
@@ -355,20 +1385,46 @@ bool blob_is_saved(struct blob const *blob)
     return !blob->saved_dist;
 }
 
+/* ranges changed since the last save; only kept for BLOB_MMAP (in pages) and BLOB_PROCESS */
+struct ranges const *blob_modified(struct blob const *blob)
+{
+    return &blob->dirty;
+}
+
 byte const *blob_lookup(struct blob const *blob, size_t pos, size_t *len)
 {
     assert(pos < blob->len);
 
+    if (blob->alloc == BLOB_PROCESS)
+        return procmem_lookup(blob->proc, pos, len);
+
     if (len)
         *len = blob->len - pos;
     return blob->data + pos;
 }
 
+/* like blob_lookup(), but for the contiguous bytes just before end */
+byte const *blob_lookup_back(struct blob const *blob, size_t end, size_t *len)
+{
+    assert(end && end <= blob->len);
+
+    if (blob->alloc == BLOB_PROCESS) {
+        size_t off = (end - 1) % PROCMEM_PAGE + 1;
+        if (len)
+            *len = off;
+        return procmem_lookup(blob->proc, end - off, NULL) + off;
+    }
+
+    if (len)
+        *len = end;
+    return blob->data + end;
+}
+
 void blob_read_strict(struct blob *blob, size_t pos, byte *buf, size_t len)
 {
     byte const *ptr;
     for (size_t i = 0, n; i < len; i += n) {
-        ptr = blob_lookup(blob, pos, &n);
+        ptr = blob_lookup(blob, pos + i, &n);
         memcpy(buf + i, ptr, (n = min(len - i, n)));
     }
 }
@@ -3,10 +3,33 @@
 
 #include "common.h"
 #include "history.h"
+#include "ranges.h"
+#include "journal.h"
+#include "histfile.h"
+#include "snap.h"
+#include "overview.h"
+#include "layout.h"
+#include "procmem.h"
+#include "watch.h"
+#include "jobs.h"
 
 enum blob_alloc {
     BLOB_MALLOC = 0,
     BLOB_MMAP,
+    BLOB_PROCESS,
+};
+
+enum blob_batch {
+    BATCH_OFF = 0,
+    BATCH_EMPTY,
+    BATCH_OPEN,
+};
+
+struct blob_image;
+
+struct clipboard {
+    size_t len;
+    byte *data;
 };
 
 struct blob {
@@ -16,50 +39,97 @@ struct blob {
     byte *data;
 
     char *filename;
+    size_t loaded; /* bytes of the file taken in so far */
+    int follow_fd; /* open while the file's growth is followed, else -1 */
 
-    uint8_t *dirty;
+    struct ranges dirty; /* modified pages of BLOB_MMAP blobs, modified bytes of BLOB_PROCESS ones */
+    struct ranges holes; /* unallocated (hence zero) extents of the file, or unmapped addresses */
+    struct procmem *proc; /* for BLOB_PROCESS */
 
     struct diff *undo, *redo;
     ssize_t saved_dist;
-
-    struct {
-        size_t len;
-        byte *data;
-    } clipboard;
+    enum blob_batch batch; /* edits after the first of a batch join its undo step */
+    size_t history_mem; /* bytes held by undo and redo */
+
+    struct clipboard *clipboard; /* owned by the caller; may be shared */
+    struct journal *journal; /* optional log of unsaved edits */
+    char const *journal_note; /* why there is no journal, if the user should know */
+    struct histfile *histfile; /* optional on-disk storage for undo history */
+    struct snapshots snaps; /* named states, kept by copying pages on write */
+    struct overview *overview; /* block statistics, once the overview was shown */
+    struct layout *layout; /* template applied with :template, if any */
+    struct watch *watch; /* changes to the file by others, for regular files */
+    struct blob_image *saving; /* snapshot being written by a save in progress */
 };
 
 void blob_init(struct blob *blob);
+byte *blob_begin_write(struct blob *blob, size_t pos, size_t len, bool save_history);
+void blob_end_write(struct blob *blob, size_t pos, size_t len);
 void blob_replace(struct blob *blob, size_t pos, byte const *data, size_t len, bool save_history);
 void blob_insert(struct blob *blob, size_t pos, byte const *data, size_t len, bool save_history);
 void blob_delete(struct blob *blob, size_t pos, size_t len, bool save_history);
 void blob_free(struct blob *blob);
 
 bool blob_can_move(struct blob const *blob);
+size_t blob_memory(struct blob const *blob);
+void blob_release(struct blob *blob);
 
-bool blob_undo(struct blob *blob, size_t *pos);
-bool blob_redo(struct blob *blob, size_t *pos);
+void blob_batch_begin(struct blob *blob);
+void blob_batch_end(struct blob *blob);
+size_t blob_undo(struct blob *blob, size_t steps, size_t *pos);
+size_t blob_redo(struct blob *blob, size_t steps, size_t *pos);
 
 void blob_yank(struct blob *blob, size_t pos, size_t len);
-size_t blob_paste(struct blob *blob, size_t pos, enum op_type type);
+size_t blob_paste(struct blob *blob, size_t pos, enum op_type type, size_t count);
 
 ssize_t blob_search(struct blob *blob, byte const *needle, size_t len, size_t start, ssize_t dir);
+size_t blob_next_extent(struct blob const *blob, size_t pos, ssize_t dir);
+ssize_t blob_skip_fill(struct blob const *blob, size_t pos, byte b, ssize_t dir);
+ssize_t blob_find_run(struct blob const *blob, size_t pos, size_t minlen, ssize_t dir);
+ssize_t blob_compare(struct blob const *a, struct blob const *b, ssize_t delta, size_t pos, ssize_t dir, bool want_diff);
+bool blob_resync(struct blob *a, struct blob *b, ssize_t *delta, size_t pos);
 
 void blob_load(struct blob *blob, char const *filename);
 void blob_load_stream(struct blob *blob, FILE *fp);
+void blob_load_process(struct blob *blob, pid_t pid);
+bool blob_follow(struct blob *blob, bool on);
+size_t blob_grow(struct blob *blob);
+enum blob_reload_error {
+    BLOB_RELOAD_OK = 0,
+    BLOB_RELOAD_UNWATCHED, /* not loaded from a regular file */
+    BLOB_RELOAD_MOVED, /* inserted or deleted bytes have no place in the file */
+    BLOB_RELOAD_UNREADABLE,
+    BLOB_RELOAD_SHRUNK, /* the file is shorter than the mapping of it */
+} blob_reload(struct blob *blob, size_t *changed, size_t *kept);
 enum blob_save_error {
     BLOB_SAVE_OK = 0,
     BLOB_SAVE_FILENAME,
     BLOB_SAVE_NONEXISTENT,
     BLOB_SAVE_PERMISSIONS,
     BLOB_SAVE_BUSY,
+    BLOB_SAVE_PROCESS, /* process memory only goes back to the process */
+    BLOB_SAVE_FAULT, /* the process refused some of the changes */
+    BLOB_SAVE_CHANGED, /* someone else changed the file since it was loaded */
+    BLOB_SAVE_PENDING, /* the previous save is still being written */
+    BLOB_SAVE_WRITE, /* writing failed; the file may be incomplete */
 } blob_save(struct blob *blob, char const *filename);
+enum blob_save_error blob_save_begin(struct blob *blob, char const *filename);
+void blob_save_write(struct blob_image *img, bool (*progress)(void *arg, size_t done, size_t total), void *arg);
+enum blob_save_error blob_save_end(struct blob_image *img);
 bool blob_is_saved(struct blob const *blob);
+struct ranges const *blob_modified(struct blob const *blob);
 
 static inline size_t blob_length(struct blob const *blob)
     { return blob->len; }
 byte const *blob_lookup(struct blob const *blob, size_t pos, size_t *len);
+byte const *blob_lookup_back(struct blob const *blob, size_t end, size_t *len);
 static inline byte blob_at(struct blob const *blob, size_t pos)
     { return *blob_lookup(blob, pos, NULL); }
+/* whether blob_lookup() may be called from several threads at once */
+static inline bool blob_concurrent(struct blob const *blob)
+    { return blob->alloc != BLOB_PROCESS; }
+bool blob_unmapped(struct blob const *blob, size_t pos);
+bool blob_writable(struct blob const *blob, size_t pos, size_t len);
 void blob_read_strict(struct blob *blob, size_t pos, byte *buf, size_t len);
 
 #endif
@@ -0,0 +1,174 @@
+
+#include "common.h"
+#include "blob.h"
+#include "view.h"
+#include "input.h"
+#include "buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+void buffers_init(struct buffers *bufs)
+{
+    memset(bufs, 0, sizeof(*bufs));
+    bufs->budget = CONFIG_MEMORY_BUDGET;
+}
+
+void buffers_free(struct buffers *bufs)
+{
+    for (size_t i = 0; i < bufs->n; ++i) {
+        blob_free(&bufs->list[i]->blob);
+        free(bufs->list[i]);
+    }
+    free(bufs->list);
+    free(bufs->clipboard.data);
+}
+
+/* appends a fresh buffer; the caller loads something into its blob */
+struct buffer *buffers_add(struct buffers *bufs)
+{
+    struct buffer *buf = malloc_strict(sizeof(*buf));
+
+    memset(buf, 0, sizeof(*buf));
+    blob_init(&buf->blob);
+    buf->blob.clipboard = &bufs->clipboard;
+
+    bufs->list = realloc_strict(bufs->list, (bufs->n + 1) * sizeof(*bufs->list));
+    bufs->list[bufs->n++] = buf;
+    return buf;
+}
+
+static void buffers_remove_last(struct buffers *bufs)
+{
+    assert(bufs->n > 1);
+    blob_free(&bufs->list[--bufs->n]->blob);
+    free(bufs->list[bufs->n]);
+}
+
+/* finds or loads the buffer for filename. unlike blob_load(), this fails
+ * gracefully, since there may be unsaved changes in other buffers. */
+enum buffers_open_error buffers_open(struct buffers *bufs, char const *filename, size_t *idx)
+{
+    struct blob *blob;
+    struct stat st;
+    int fd;
+
+    for (size_t i = 0; i < bufs->n; ++i) {
+        char const *name = bufs->list[i]->blob.filename;
+        if (name && (!strcmp(name, filename) || file_same(name, filename))) {
+            *idx = i;
+            return BUFFERS_OPEN_OK;
+        }
+    }
+
+    if (!stat(filename, &st)) {
+        if ((st.st_mode & S_IFMT) != S_IFREG && (st.st_mode & S_IFMT) != S_IFBLK)
+            return BUFFERS_OPEN_TYPE;
+        if (0 > (fd = open(filename, O_RDONLY)))
+            return BUFFERS_OPEN_UNREADABLE;
+        close(fd);
+        /* small files are copied to the heap; see blob_load() */
+        if ((st.st_mode & S_IFMT) == S_IFREG && (size_t) st.st_size < CONFIG_LARGE_FILESIZE
+                && buffers_enforce_budget(bufs, st.st_size))
+            return BUFFERS_OPEN_BUDGET;
+    }
+    else if (errno != ENOENT)
+        return BUFFERS_OPEN_UNREADABLE;
+
+    blob = &buffers_add(bufs)->blob;
+    blob_load(blob, filename);
+    histfile_open(blob);
+    blob->journal = journal_open(blob);
+    *idx = bufs->n - 1;
+
+    if (buffers_memory(bufs) > bufs->budget) {
+        buffers_remove_last(bufs);
+        return BUFFERS_OPEN_BUDGET;
+    }
+
+    return BUFFERS_OPEN_OK;
+}
+
+void buffers_switch(struct buffers *bufs, struct input *input, size_t idx)
+{
+    struct view *V = input->view;
+    struct buffer *old = bufs->list[bufs->cur], *new = bufs->list[idx];
+
+    assert(idx < bufs->n);
+
+    old->cur = input->cur;
+    old->start = V->start;
+    if (idx != bufs->cur)
+        blob_release(&old->blob);
+
+    bufs->cur = idx;
+    V->blob = &new->blob;
+    input->cur = new->cur;
+    V->start = new->start;
+}
+
+/* writes out the journals of all buffers */
+void buffers_commit(struct buffers *bufs)
+{
+    for (size_t i = 0; i < bufs->n; ++i)
+        if (bufs->list[i]->blob.journal)
+            journal_commit(bufs->list[i]->blob.journal);
+}
+
+/* index of some buffer with unsaved changes, preferring the current one */
+ssize_t buffers_unsaved(struct buffers const *bufs)
+{
+    if (!blob_is_saved(buffers_blob(bufs)))
+        return bufs->cur;
+    for (size_t i = 0; i < bufs->n; ++i)
+        if (!blob_is_saved(&bufs->list[i]->blob))
+            return i;
+    return -1;
+}
+
+size_t buffers_memory(struct buffers const *bufs)
+{
+    size_t mem = 0;
+    for (size_t i = 0; i < bufs->n; ++i)
+        mem += blob_memory(&bufs->list[i]->blob);
+    return mem;
+}
+
+/* makes room for another extra bytes within the budget: moves undo data
+ * to files first, then drops redo lists, then the oldest undo steps of the
+ * inactive buffers, finally those of the current buffer. returns how many
+ * bytes are still missing (zero if everything fits now). */
+size_t buffers_enforce_budget(struct buffers *bufs, size_t extra)
+{
+    size_t mem = buffers_memory(bufs) + extra, freed;
+    struct blob *blob;
+
+    if (mem <= bufs->budget)
+        return 0;
+
+    for (size_t i = 0; i < bufs->n && mem > bufs->budget; ++i)
+        mem -= histfile_spill(&bufs->list[i]->blob);
+
+    for (size_t i = 0; i < bufs->n && mem > bufs->budget; ++i) {
+        blob = &bufs->list[i]->blob;
+        freed = history_free(&blob->redo);
+        blob->history_mem -= freed;
+        mem -= freed;
+    }
+
+    for (size_t k = 0; k <= bufs->n && mem > bufs->budget; ++k) {
+        /* the current buffer goes last */
+        size_t i = k < bufs->n ? k : bufs->cur;
+        if (k < bufs->n && i == bufs->cur)
+            continue;
+        blob = &bufs->list[i]->blob;
+        freed = history_truncate(&blob->undo, blob->history_mem - min(blob->history_mem, mem - bufs->budget));
+        blob->history_mem -= freed;
+        mem -= freed;
+    }
+
+    return mem > bufs->budget ? mem - bufs->budget : 0;
+}
@@ -0,0 +1,41 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "blob.h"
+
+struct input;
+
+struct buffer {
+    struct blob blob;
+    size_t cur, start; /* cursor and view position while inactive */
+};
+
+struct buffers {
+    size_t n, cur;
+    struct buffer **list;
+
+    struct clipboard clipboard; /* shared by all buffers */
+    size_t budget; /* memory limit for all blobs and their histories */
+};
+
+void buffers_init(struct buffers *bufs);
+void buffers_free(struct buffers *bufs);
+
+static inline struct blob *buffers_blob(struct buffers const *bufs)
+    { return &bufs->list[bufs->cur]->blob; }
+
+struct buffer *buffers_add(struct buffers *bufs);
+enum buffers_open_error {
+    BUFFERS_OPEN_OK = 0,
+    BUFFERS_OPEN_UNREADABLE,
+    BUFFERS_OPEN_TYPE,
+    BUFFERS_OPEN_BUDGET,
+} buffers_open(struct buffers *bufs, char const *filename, size_t *idx);
+void buffers_switch(struct buffers *bufs, struct input *input, size_t idx);
+
+void buffers_commit(struct buffers *bufs);
+ssize_t buffers_unsaved(struct buffers const *bufs);
+size_t buffers_memory(struct buffers const *bufs);
+size_t buffers_enforce_budget(struct buffers *bufs, size_t extra);
+
+#endif
@@ -3,9 +3,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 unsigned long bit_length(unsigned long n)
 {
@@ -46,6 +50,14 @@ void munmap_strict(void *addr, size_t len)
         pdie("munmap");
 }
 
+void *mremap_strict(void *addr, size_t old_len, size_t new_len)
+{
+    void *ptr;
+    if (MAP_FAILED == (ptr = mremap(addr, old_len, new_len, MREMAP_MAYMOVE)))
+        pdie("mremap");
+    return ptr;
+}
+
 off_t lseek_strict(int fildes, off_t offset, int whence)
 {
     off_t ret;
@@ -75,3 +87,107 @@ uint64_t monotonic_microtime()
     return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
 }
 
+/* how many threads to split len bytes of bulk work across */
+size_t parallel_threads(size_t len)
+{
+    long cpus;
+
+    if (len < CONFIG_PARALLEL_MIN || (cpus = sysconf(_SC_NPROCESSORS_ONLN)) <= 1)
+        return 1;
+    return min(cpus, CONFIG_PARALLEL_MAX);
+}
+
+/* calls f on each of the n jobs, an array of elements of the given size,
+ * at once: the first one on this thread, the others on threads of their own */
+void parallel_run(void *(*f)(void *), void *jobs, size_t size, size_t n)
+{
+    pthread_t threads[CONFIG_PARALLEL_MAX];
+
+    assert(n && n <= CONFIG_PARALLEL_MAX);
+    for (size_t i = 1; i < n; ++i)
+        if (pthread_create(&threads[i], NULL, f, (byte *) jobs + i * size))
+            die("pthread_create");
+    f(jobs);
+    for (size_t i = 1; i < n; ++i)
+        if (pthread_join(threads[i], NULL))
+            die("pthread_join");
+}
+
+void file_id_get(char const *filename, struct file_id *id)
+{
+    struct stat st;
+
+    memset(id, 0, sizeof(*id));
+    if (stat(filename, &st))
+        return;
+    id->dev = st.st_dev;
+    id->ino = st.st_ino;
+    id->size = st.st_size;
+    id->mtime_sec = st.st_mtim.tv_sec;
+    id->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+/* whether both names refer to the same existing file, e.g. through a link */
+bool file_same(char const *a, char const *b)
+{
+    struct stat sa, sb;
+
+    if (stat(a, &sa) || stat(b, &sb))
+        return false;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static unsigned unhex_digit(char c)
+{
+    assert(isxdigit(c));
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    else if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    die("not a hex digit");
+}
+
+size_t unhex(byte **ret, char const *hex)
+{
+    size_t len = 0;
+    *ret = malloc_strict(strlen(hex) / 2);
+    for (char const *p = hex; *p; ) {
+        while (isspace(*p)) ++p;
+        if (!(isxdigit(p[0]) && isxdigit(p[1]))) {
+            free(*ret);
+            *ret = NULL;
+            return 0;
+        }
+        (*ret)[len] = unhex_digit(*p++) << 4;
+        (*ret)[len++] |= unhex_digit(*p++);
+    }
+    *ret = realloc_strict(*ret, len); /* shrink to what we actually used */
+    return len;
+}
+
+/* parses "a:b", "a:" or "a" with the usual hex/dec/oct prefixes into
+ * [from, to), clamped to len. no range at all means everything. */
+bool parse_range(char const *range, size_t len, size_t *from, size_t *to)
+{
+    char *end;
+
+    *from = 0, *to = len;
+    if (!range)
+        return true;
+
+    errno = 0;
+    *from = strtoull(range, &end, 0);
+    if (errno || end == range || (*end && *end != ':'))
+        return false;
+    if (*end == ':' && end[1]) {
+        range = end + 1;
+        *to = strtoull(range, &end, 0);
+        if (errno || end == range || *end)
+            return false;
+    }
+
+    *to = min(*to, len);
+    return *from <= *to;
+}
@@ -17,6 +17,42 @@
 /* mmap files larger than this */
 #define CONFIG_LARGE_FILESIZE (256 * (1 << 20)) /* 256 megabytes */
 
+/* default limit for heap copies of files and undo histories, summed over all buffers */
+#define CONFIG_MEMORY_BUDGET ((size_t) 1 << 30) /* 1 gigabyte */
+
+/* bytes that must match to re-align the blobs in compare mode */
+#define CONFIG_RESYNC_WINDOW 16
+
+/* how far to look for a re-alignment in compare mode */
+#define CONFIG_RESYNC_RADIUS (1 << 20) /* 1 megabyte */
+
+/* microseconds between fsync()s of the edit journal */
+#define CONFIG_JOURNAL_INTERVAL (1000000) /* 1 second */
+
+/* journal records buffered before they are written out regardless */
+#define CONFIG_JOURNAL_BUFFER (1 << 20) /* 1 megabyte */
+
+/* bytes below which bulk operations stay on a single thread */
+#define CONFIG_PARALLEL_MIN (16 * (1 << 20)) /* 16 megabytes */
+
+/* most threads a bulk operation is split across */
+#define CONFIG_PARALLEL_MAX 64
+
+/* most threads running background jobs */
+#define CONFIG_JOB_WORKERS 4
+
+/* microseconds between progress updates of background jobs */
+#define CONFIG_JOB_REFRESH (200000) /* 200 milliseconds */
+
+/* pages of another process's memory cached while it is being viewed */
+#define CONFIG_PROCESS_CACHE 4096 /* 16 megabytes */
+
+/* largest count accepted before a command */
+#define CONFIG_MAX_COUNT ((size_t) 1 << 30)
+
+/* microseconds between checks for growth of a followed file */
+#define CONFIG_FOLLOW_INTERVAL (250000) /* 250 milliseconds */
+
 /* microseconds to wait for the rest of what could be an escape sequence */
 #define CONFIG_WAIT_ESCAPE (10000) /* 10 milliseconds */
 
@@ -40,6 +76,7 @@ void *realloc_strict(void *ptr, size_t len);
 
 void *mmap_strict(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
 void munmap_strict(void *addr, size_t len);
+void *mremap_strict(void *addr, size_t old_len, size_t new_len);
 
 off_t lseek_strict(int fildes, off_t offset, int whence);
 
@@ -47,4 +84,17 @@ char *fgets_retry(char *s, int size, FILE *stream);
 
 uint64_t monotonic_microtime();
 
+size_t parallel_threads(size_t len);
+void parallel_run(void *(*f)(void *), void *jobs, size_t size, size_t n);
+
+/* identifies a file and its version on disk; all zero if it doesn't exist */
+struct file_id {
+    uint64_t dev, ino, size, mtime_sec, mtime_nsec;
+};
+void file_id_get(char const *filename, struct file_id *id);
+bool file_same(char const *a, char const *b);
+
+size_t unhex(byte **ret, char const *hex);
+bool parse_range(char const *range, size_t len, size_t *from, size_t *to);
+
 #endif
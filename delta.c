@@ -0,0 +1,418 @@
+#include "common.h"
+#include "blob.h"
+#include "scan.h"
+#include "delta.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * A delta describes the blob in terms of the file it was loaded from,
+ * so that modifications can be kept without touching that file:
+ *
+ *     "HYXDELTA" $srclen $len $op... 'E'
+ *
+ * All numbers are LEB128 varints. The ops walk the original file (the
+ * source) and the blob from the front:
+ *
+ *     'C' $n          copy n bytes of the source
+ *     'S' $n          skip n bytes of the source
+ *     'R' $n $bytes   replace n bytes of the source
+ *     'I' $n $bytes   insert n bytes
+ */
+
+#define DELTA_MAGIC "HYXDELTA"
+#define DELTA_CHUNK 0x10000
+#define DELTA_MIN_COPY 8 /* shorter equal runs are folded into replacements */
+
+/* the blob as a sequence of pieces of the source and of new content */
+
+#define PIECE_NEW SIZE_MAX
+
+struct piece {
+    size_t len, src;
+};
+
+struct pieces {
+    size_t n, cap;
+    struct piece *p;
+};
+
+static void pieces_insert(struct pieces *ps, size_t i, size_t len, size_t src)
+{
+    if (ps->n == ps->cap)
+        ps->p = realloc_strict(ps->p, (ps->cap = max(16, 2 * ps->cap)) * sizeof(*ps->p));
+    memmove(ps->p + i + 1, ps->p + i, (ps->n - i) * sizeof(*ps->p));
+    ps->p[i].len = len;
+    ps->p[i].src = src;
+    ++ps->n;
+}
+
+/* index of the piece starting at pos, splitting one if necessary */
+static size_t pieces_split(struct pieces *ps, size_t pos)
+{
+    size_t i, off = 0;
+
+    for (i = 0; i < ps->n && off + ps->p[i].len <= pos; ++i)
+        off += ps->p[i].len;
+
+    if (i < ps->n && off < pos) {
+        size_t head = pos - off, src = ps->p[i].src;
+        pieces_insert(ps, i + 1, ps->p[i].len - head, src == PIECE_NEW ? src : src + head);
+        ps->p[i].len = head;
+        ++i;
+    }
+    return i;
+}
+
+static void pieces_edit(void *arg, enum op_type type, size_t pos, size_t len)
+{
+    struct pieces *ps = arg;
+    size_t i = pieces_split(ps, pos), j;
+
+    if (type != INSERT) {
+        j = pieces_split(ps, pos + len);
+        memmove(ps->p + i, ps->p + j, (ps->n - j) * sizeof(*ps->p));
+        ps->n -= j - i;
+    }
+    if (type != DELETE)
+        pieces_insert(ps, i, len, PIECE_NEW);
+}
+
+/* recovers the pieces from the undo history, or fails if it doesn't reach
+ * back to the last save */
+static bool pieces_from_history(struct pieces *ps, struct blob const *blob, size_t srclen)
+{
+    size_t len = 0;
+
+    ps->n = 0;
+    if (srclen)
+        pieces_insert(ps, 0, srclen, 0);
+
+    if (blob->saved_dist < 0 || !history_replay(blob->undo, blob->saved_dist, pieces_edit, ps))
+        return false;
+
+    for (size_t i = 0; i < ps->n; ++i)
+        len += ps->p[i].len;
+    return len == blob_length(blob);
+}
+
+static void pieces_from_dirty(struct pieces *ps, struct blob const *blob)
+{
+    struct ranges const *dirty = blob_modified(blob);
+    size_t pos = 0, end;
+
+    ps->n = 0;
+    for (size_t i = 0; i <= dirty->n; ++i) {
+        end = i < dirty->n ? min(dirty->r[i].pos, blob_length(blob)) : blob_length(blob);
+        if (end > pos)
+            pieces_insert(ps, ps->n, end - pos, pos);
+        if (i == dirty->n || end == blob_length(blob))
+            break;
+        pos = min(range_end(&dirty->r[i]), blob_length(blob));
+        pieces_insert(ps, ps->n, pos - end, PIECE_NEW);
+    }
+}
+
+struct writer {
+    FILE *fp;
+    struct blob *blob;
+    int src_fd;
+    size_t pos, src; /* progress in the blob and the source */
+    size_t size;     /* bytes written so far */
+    bool short_src;  /* the source is shorter than it used to be */
+
+    char op;         /* the pending op */
+    size_t op_pos, op_len;
+
+    byte *buf, *src_buf;
+};
+
+static void put_varint(struct writer *w, size_t n)
+{
+    do {
+        putc((n & 0x7f) | (n > 0x7f ? 0x80 : 0), w->fp);
+        ++w->size;
+    } while (n >>= 7);
+}
+
+static void put_flush(struct writer *w)
+{
+    if (!w->op_len)
+        return;
+
+    putc(w->op, w->fp);
+    ++w->size;
+    put_varint(w, w->op_len);
+
+    if (w->op == 'R' || w->op == 'I') {
+        for (size_t i = 0, n; i < w->op_len; i += n) {
+            byte const *ptr = blob_lookup(w->blob, w->op_pos + i, &n);
+            fwrite(ptr, 1, n = min(n, w->op_len - i), w->fp);
+        }
+        w->size += w->op_len;
+    }
+
+    w->op_len = 0;
+}
+
+/* appends an op, merging it with the pending one if possible */
+static void put(struct writer *w, char op, size_t len)
+{
+    if (!len)
+        return;
+
+    if (w->op != op || !w->op_len) {
+        put_flush(w);
+        w->op = op;
+        w->op_pos = w->pos;
+    }
+    w->op_len += len;
+
+    if (op != 'S') w->pos += len;
+    if (op != 'I') w->src += len;
+}
+
+/* replaces len source bytes with the blob's, copying the parts that didn't change */
+static void put_replace(struct writer *w, size_t len)
+{
+    for (size_t done = 0, k; done < len; done += k) {
+        byte const *a = w->src_buf, *b = w->buf;
+        ssize_t r;
+
+        k = min(len - done, DELTA_CHUNK);
+        for (size_t i = 0; i < k; i += r) {
+            if (0 >= (r = pread(w->src_fd, w->src_buf + i, k - i, w->src + i))) {
+                if (r && errno == EINTR) {
+                    r = 0;
+                    continue;
+                }
+                if (r)
+                    pdie("pread");
+                /* can't compare, so treat the rest as changed */
+                w->short_src = true;
+                memset(w->src_buf + i, 0, k - i);
+                break;
+            }
+        }
+        blob_read_strict(w->blob, w->pos, w->buf, k);
+
+        for (size_t i = 0, m; i < k; i += m) {
+            m = scan_diff(a + i, b + i, k - i);
+            put(w, m >= DELTA_MIN_COPY ? 'C' : 'R', m);
+            i += m;
+            put(w, 'R', m = scan_same(a + i, b + i, k - i));
+        }
+    }
+}
+
+enum delta_error delta_save(struct blob *blob, char const *filename, size_t *size)
+{
+    struct writer w;
+    struct pieces ps = {0};
+    struct stat st, dst;
+    size_t srclen;
+
+    if (!blob->filename)
+        return DELTA_NO_ORIGINAL;
+
+    memset(&w, 0, sizeof(w));
+    w.blob = blob;
+
+    if (0 > (w.src_fd = open(blob->filename, O_RDONLY)))
+        return DELTA_NO_ORIGINAL;
+    if (fstat(w.src_fd, &st))
+        pdie("fstat");
+    srclen = blob->alloc == BLOB_MMAP ? blob_length(blob) : (size_t) st.st_size;
+
+    /* truncating the original would lose the bytes the delta refers to */
+    if (!stat(filename, &dst) && dst.st_dev == st.st_dev && dst.st_ino == st.st_ino) {
+        close(w.src_fd);
+        return DELTA_SAME_FILE;
+    }
+
+    if (!(w.fp = fopen(filename, "wb"))) {
+        close(w.src_fd);
+        return DELTA_UNWRITABLE;
+    }
+
+    if (blob->alloc == BLOB_MMAP)
+        pieces_from_dirty(&ps, blob);
+    else if (!pieces_from_history(&ps, blob, srclen)) {
+        /* the history is incomplete: compare everything in place */
+        ps.n = 0;
+        if (blob_length(blob))
+            pieces_insert(&ps, 0, blob_length(blob), PIECE_NEW);
+    }
+
+    w.buf = malloc_strict(DELTA_CHUNK);
+    w.src_buf = malloc_strict(DELTA_CHUNK);
+
+    fwrite(DELTA_MAGIC, 1, strlen(DELTA_MAGIC), w.fp);
+    w.size = strlen(DELTA_MAGIC);
+    put_varint(&w, srclen);
+    put_varint(&w, blob_length(blob));
+
+    for (size_t i = 0; i < ps.n; ++i) {
+        struct piece const *p = &ps.p[i];
+
+        if (p->src != PIECE_NEW) {
+            assert(p->src >= w.src);
+            put(&w, 'S', p->src - w.src);
+            put(&w, 'C', p->len);
+        }
+        else {
+            /* new content overwrites the source up to the next copied piece */
+            size_t next = srclen, n;
+            for (size_t j = i + 1; j < ps.n; ++j)
+                if (ps.p[j].src != PIECE_NEW) {
+                    next = ps.p[j].src;
+                    break;
+                }
+            put_replace(&w, n = min(p->len, next - w.src));
+            put(&w, 'I', p->len - n);
+        }
+    }
+    put(&w, 'S', srclen - w.src);
+    put_flush(&w);
+    putc('E', w.fp);
+    ++w.size;
+
+    free(ps.p);
+    free(w.buf);
+    free(w.src_buf);
+    close(w.src_fd);
+
+    if (ferror(w.fp) | fclose(w.fp))
+        return DELTA_UNWRITABLE;
+    if (w.short_src) {
+        unlink(filename);
+        return DELTA_MISMATCH;
+    }
+
+    *size = w.size;
+    return DELTA_OK;
+}
+
+static bool get_varint(FILE *fp, size_t *n)
+{
+    int c;
+    *n = 0;
+    for (unsigned shift = 0; shift < 8 * sizeof(*n); shift += 7) {
+        if (EOF == (c = getc(fp)))
+            return false;
+        *n |= (size_t) (c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static enum delta_error delta_read(struct blob *blob, FILE *fp)
+{
+    char magic[sizeof(DELTA_MAGIC) - 1];
+    size_t srclen, len, n, pos = 0, src = 0;
+    byte *buf;
+    int op;
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, DELTA_MAGIC, sizeof(magic)))
+        return DELTA_SYNTAX;
+    if (!get_varint(fp, &srclen) || !get_varint(fp, &len))
+        return DELTA_SYNTAX;
+    if (srclen != blob_length(blob))
+        return DELTA_MISMATCH;
+    if (len != srclen && !blob_can_move(blob))
+        return DELTA_RESIZE;
+
+    /* invariant: blob[pos..] is still source[src..] */
+    while ('E' != (op = getc(fp))) {
+        if (!get_varint(fp, &n) || !n || (op != 'I' && n > srclen - src))
+            return DELTA_SYNTAX;
+
+        switch (op) {
+        case 'C':
+            pos += n;
+            src += n;
+            break;
+        case 'S':
+            if (!blob_can_move(blob))
+                return DELTA_RESIZE;
+            blob_delete(blob, pos, n, true);
+            src += n;
+            break;
+        case 'R':
+        case 'I':
+            if (op == 'I' && !blob_can_move(blob))
+                return DELTA_RESIZE;
+            buf = malloc_strict(min(n, DELTA_CHUNK));
+            for (size_t k; n; n -= k, pos += k) {
+                if ((k = fread(buf, 1, min(n, DELTA_CHUNK), fp)) != min(n, DELTA_CHUNK)) {
+                    free(buf);
+                    return DELTA_SYNTAX;
+                }
+                if (op == 'R') {
+                    blob_replace(blob, pos, buf, k, true);
+                    src += k;
+                }
+                else
+                    blob_insert(blob, pos, buf, k, true);
+            }
+            free(buf);
+            break;
+        default:
+            return DELTA_SYNTAX;
+        }
+    }
+
+    if (src != srclen || pos != blob_length(blob) || pos != len)
+        return DELTA_SYNTAX;
+    return DELTA_OK;
+}
+
+/* applies a delta written by delta_save() as a single undo step */
+enum delta_error delta_apply(struct blob *blob, char const *filename)
+{
+    enum delta_error err;
+    ssize_t dist = blob->saved_dist;
+    FILE *fp;
+
+    if (!(fp = fopen(filename, "rb")))
+        return DELTA_UNREADABLE;
+
+    blob_batch_begin(blob);
+    err = delta_read(blob, fp);
+    blob_batch_end(blob);
+    fclose(fp);
+
+    if (err && blob->saved_dist != dist) {
+        /* roll back what was applied before the error */
+        blob_undo(blob, 1, NULL);
+        blob->history_mem -= history_free(&blob->redo);
+    }
+    return err;
+}
+
+char const *delta_strerror(enum delta_error err)
+{
+    switch (err) {
+    case DELTA_OK: return "success";
+    case DELTA_NO_ORIGINAL: return "original file is not readable";
+    case DELTA_UNREADABLE: return "delta is not readable";
+    case DELTA_UNWRITABLE: return "delta is not writable";
+    case DELTA_MISMATCH: return "delta does not match the original file";
+    case DELTA_SYNTAX: return "malformed delta";
+    case DELTA_RESIZE: return "delta resizes a memory-mapped file";
+    case DELTA_SAME_FILE: return "delta would overwrite the original file";
+    }
+    die("unknown delta error");
+}
+
+#undef DELTA_MAGIC
+#undef DELTA_CHUNK
+#undef DELTA_MIN_COPY
+#undef PIECE_NEW
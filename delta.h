@@ -0,0 +1,22 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "common.h"
+#include "blob.h"
+
+enum delta_error {
+    DELTA_OK = 0,
+    DELTA_NO_ORIGINAL,
+    DELTA_UNREADABLE,
+    DELTA_UNWRITABLE,
+    DELTA_MISMATCH,
+    DELTA_SYNTAX,
+    DELTA_RESIZE,
+    DELTA_SAME_FILE,
+};
+
+enum delta_error delta_save(struct blob *blob, char const *filename, size_t *size);
+enum delta_error delta_apply(struct blob *blob, char const *filename);
+char const *delta_strerror(enum delta_error err);
+
+#endif
@@ -0,0 +1,143 @@
+
+#include "common.h"
+#include "blob.h"
+#include "view.h"
+#include "dump.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define DUMP_BUFSIZE (1 << 20)
+
+static char const hexdigits[] = "0123456789abcdef";
+
+/* "xx " for every byte, and its column in the ascii gutter */
+static char hextab[256][4];
+static char asciitab[256];
+
+static void dump_tables(void)
+{
+    for (unsigned b = 0; b < 256; ++b) {
+        hextab[b][0] = hexdigits[b >> 4];
+        hextab[b][1] = hexdigits[b & 0xf];
+        hextab[b][2] = hextab[b][3] = ' ';
+        /* like isprint() in the C locale, but without the lookup */
+        asciitab[b] = b >= 0x20 && b < 0x7f ? b : '.';
+    }
+}
+
+static void write_all(int fd, char const *buf, size_t len)
+{
+    ssize_t r;
+    for (size_t i = 0; i < len; i += r) {
+        if (0 > (r = write(fd, buf + i, len - i))) {
+            if (errno == EINTR) {
+                r = 0;
+                continue;
+            }
+            pdie("write");
+        }
+    }
+}
+
+/* writes [from, to) of blob as text lines in the same layout as the editor */
+void dump_blob(struct blob const *blob, int fd, size_t cols, size_t from, size_t to)
+{
+    unsigned digits = max(4, view_pos_digits(blob_length(blob)));
+    size_t linelen = digits + strlen(": ") + 3 * cols + strlen("||") + cols + 1;
+    size_t bufsize = max(DUMP_BUFSIZE, linelen), n = 0;
+    char *buf = malloc_strict(bufsize);
+    byte *tmp = malloc_strict(cols);
+    byte const *ptr = NULL;
+    size_t avail = 0;
+
+    assert(cols && from <= to && to <= blob_length(blob));
+
+    dump_tables();
+
+    for (size_t off = from; off < to; off += cols) {
+        size_t cnt = min(cols, to - off);
+        byte const *p;
+        char *line, *hex, *ascii;
+
+        if (bufsize - n < linelen) {
+            write_all(fd, buf, n);
+            n = 0;
+        }
+        line = buf + n;
+
+        for (size_t k = digits, v = off; k--; v >>= 4)
+            line[k] = hexdigits[v & 0xf];
+        line[digits] = ':';
+        line[digits + 1] = ' ';
+
+        hex = line + digits + 2;
+        ascii = hex + 3 * cols + 1;
+
+        if (avail < cnt) {
+            /* line straddles two spans: gather it first */
+            for (size_t j = 0, l; j < cnt; j += l, ptr += l, avail -= l) {
+                if (!avail)
+                    ptr = blob_lookup(blob, off + j, &avail);
+                memcpy(tmp + j, ptr, l = min(avail, cnt - j));
+            }
+            p = tmp;
+        }
+        else {
+            p = ptr;
+            ptr += cnt, avail -= cnt;
+        }
+
+        /* each entry carries a spare byte, which the next one overwrites */
+        for (size_t j = 0; j < cnt; ++j) {
+            memcpy(hex + 3 * j, hextab[p[j]], 4);
+            ascii[j] = asciitab[p[j]];
+        }
+        if (cnt < cols)
+            memset(hex + 3 * cnt, ' ', 3 * (cols - cnt));
+        hex[3 * cols] = '|';
+
+        ascii[cnt] = '|';
+        ascii[cnt + 1] = '\n';
+        n += ascii + cnt + 2 - line;
+    }
+
+    write_all(fd, buf, n);
+    free(tmp);
+    free(buf);
+}
+
+int dump_main(char const *filename, size_t cols, char const *range)
+{
+    struct blob blob;
+    size_t from, to;
+
+    blob_init(&blob);
+    if (filename)
+        blob_load(&blob, filename);
+    else if (!isatty(fileno(stdin)))
+        blob_load_stream(&blob, stdin);
+    else
+        die("nothing to dump.");
+
+    if (!cols) {
+        struct winsize winsz;
+        unsigned digits = max(4, view_pos_digits(blob_length(&blob)));
+        bool tty = !ioctl(fileno(stdout), TIOCGWINSZ, &winsz);
+        cols = view_fit_cols(tty ? winsz.ws_col : 80, digits, false);
+        if (!cols)
+            cols = CONFIG_ROUND_COLS;
+    }
+
+    if (!parse_range(range, blob_length(&blob), &from, &to))
+        die("invalid range.");
+    dump_blob(&blob, fileno(stdout), cols, from, to);
+
+    blob_free(&blob);
+    return EXIT_SUCCESS;
+}
+
+#undef DUMP_BUFSIZE
@@ -0,0 +1,9 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "blob.h"
+
+int dump_main(char const *filename, size_t cols, char const *range);
+void dump_blob(struct blob const *blob, int fd, size_t cols, size_t from, size_t to);
+
+#endif
@@ -0,0 +1,521 @@
+
+#include "common.h"
+#include "hash.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define HASH_CHUNK (16 * (1 << 20)) /* bytes hashed between progress reports */
+
+
+#define CRC32_POLY  0xedb88320 /* reflected */
+#define CRC32C_POLY 0x82f63b78
+
+static struct {
+    char const *name;
+    size_t size;
+} const algos[] = {
+    [HASH_CRC32]  = {"crc32", 4},
+    [HASH_CRC32C] = {"crc32c", 4},
+    [HASH_MD5]    = {"md5", 16},
+    [HASH_SHA1]   = {"sha1", 20},
+    [HASH_SHA256] = {"sha256", 32},
+    [HASH_XXH64]  = {"xxh64", 8},
+};
+
+bool hash_lookup(char const *name, enum hash_algo *algo)
+{
+    for (size_t i = 0; i < sizeof(algos) / sizeof(*algos); ++i) {
+        if (!strcmp(algos[i].name, name)) {
+            *algo = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+char const *hash_name(enum hash_algo algo)
+{
+    return algos[algo].name;
+}
+
+size_t hash_size(enum hash_algo algo)
+{
+    return algos[algo].size;
+}
+
+static inline uint32_t rol32(uint32_t x, unsigned n)
+    { return x << n | x >> (32 - n); }
+static inline uint32_t ror32(uint32_t x, unsigned n)
+    { return x >> n | x << (32 - n); }
+static inline uint64_t rol64(uint64_t x, unsigned n)
+    { return x << n | x >> (64 - n); }
+
+static inline uint32_t le32(byte const *p)
+    { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24; }
+static inline uint32_t be32(byte const *p)
+    { return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static inline uint64_t le64(byte const *p)
+    { return le32(p) | (uint64_t) le32(p + 4) << 32; }
+
+static void put_le32(byte *p, uint32_t v)
+{
+    for (unsigned k = 0; k < 4; ++k)
+        p[k] = v >> 8 * k;
+}
+
+static void put_be(byte *p, uint64_t v, unsigned len)
+{
+    for (unsigned k = 0; k < len; ++k)
+        p[k] = v >> 8 * (len - 1 - k);
+}
+
+/*
+ * CRCs: slice-by-8 tables, or the SSE 4.2 instruction for crc32c.
+ */
+
+static uint32_t crc_tab[2][8][256];
+
+static void crc_tables(void)
+{
+    static bool ready;
+    uint32_t polys[2] = {CRC32_POLY, CRC32C_POLY};
+
+    if (ready)
+        return;
+    for (unsigned t = 0; t < 2; ++t) {
+        for (unsigned i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (unsigned k = 0; k < 8; ++k)
+                c = c & 1 ? c >> 1 ^ polys[t] : c >> 1;
+            crc_tab[t][0][i] = c;
+        }
+        for (unsigned i = 0; i < 256; ++i)
+            for (unsigned k = 1; k < 8; ++k)
+                crc_tab[t][k][i] = crc_tab[t][k - 1][i] >> 8 ^ crc_tab[t][0][crc_tab[t][k - 1][i] & 0xff];
+    }
+    ready = true;
+}
+
+static uint32_t crc_sw(uint32_t tab[8][256], uint32_t crc, byte const *p, size_t len)
+{
+    crc = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a = crc ^ le32(p), b = le32(p + 4);
+        crc = tab[7][a & 0xff] ^ tab[6][a >> 8 & 0xff] ^ tab[5][a >> 16 & 0xff] ^ tab[4][a >> 24]
+            ^ tab[3][b & 0xff] ^ tab[2][b >> 8 & 0xff] ^ tab[1][b >> 16 & 0xff] ^ tab[0][b >> 24];
+    }
+    while (len--)
+        crc = tab[0][(crc ^ *p++) & 0xff] ^ crc >> 8;
+    return ~crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, byte const *p, size_t len)
+{
+    unsigned long long c = ~crc & 0xffffffff, w;
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, sizeof(w));
+        c = __builtin_ia32_crc32di(c, w);
+    }
+    while (len--)
+        c = __builtin_ia32_crc32qi(c, *p++);
+    return ~(uint32_t) c;
+}
+#define HAVE_CRC32C_HW
+#endif
+
+static uint32_t crc_update(enum hash_algo algo, uint32_t crc, byte const *p, size_t len)
+{
+#ifdef HAVE_CRC32C_HW
+    if (algo == HASH_CRC32C && __builtin_cpu_supports("sse4.2"))
+        return crc32c_hw(crc, p, len);
+#endif
+    return crc_sw(crc_tab[algo == HASH_CRC32C], crc, p, len);
+}
+
+/* a(x) * b(x) modulo the reflected polynomial; a must be nonzero */
+static uint32_t multmodp(uint32_t a, uint32_t b, uint32_t poly)
+{
+    uint32_t m = (uint32_t) 1 << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if (!(a & (m - 1)))
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? b >> 1 ^ poly : b >> 1;
+    }
+    return p;
+}
+
+/* the crc of the concatenation of two pieces, the second len2 bytes long */
+static uint32_t crc_combine(enum hash_algo algo, uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+    uint32_t poly = algo == HASH_CRC32C ? CRC32C_POLY : CRC32_POLY;
+    uint32_t x = (uint32_t) 1 << 30, p = (uint32_t) 1 << 31; /* x^1 and x^0 */
+
+    for (unsigned k = 0; k < 3; ++k)
+        x = multmodp(x, x, poly);
+    for (; len2; len2 >>= 1, x = multmodp(x, x, poly))
+        if (len2 & 1)
+            p = multmodp(x, p, poly);
+    return multmodp(p, crc1, poly) ^ crc2;
+}
+
+/*
+ * MD5 (RFC 1321)
+ */
+
+static void md5_block(uint32_t h[4], byte const *p)
+{
+    static uint32_t const K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+    };
+    static unsigned const S[4][4] = {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+    uint32_t w[16], a = h[0], b = h[1], c = h[2], d = h[3], f, t;
+    unsigned g;
+
+    for (unsigned i = 0; i < 16; ++i)
+        w[i] = le32(p + 4 * i);
+
+    for (unsigned i = 0; i < 64; ++i) {
+        switch (i / 16) {
+        case 0: f = (b & c) | (~b & d); g = i; break;
+        case 1: f = (d & b) | (~d & c); g = (5 * i + 1) % 16; break;
+        case 2: f = b ^ c ^ d; g = (3 * i + 5) % 16; break;
+        default: f = c ^ (b | ~d); g = 7 * i % 16; break;
+        }
+        t = d;
+        d = c;
+        c = b;
+        b += rol32(a + f + K[i] + w[g], S[i / 16][i % 4]);
+        a = t;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+}
+
+/*
+ * SHA-1 and SHA-256 (FIPS 180-4)
+ */
+
+static void sha1_block(uint32_t h[5], byte const *p)
+{
+    uint32_t w[80], a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f, k, t;
+
+    for (unsigned i = 0; i < 16; ++i)
+        w[i] = be32(p + 4 * i);
+    for (unsigned i = 16; i < 80; ++i)
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (unsigned i = 0; i < 80; ++i) {
+        switch (i / 20) {
+        case 0: f = (b & c) | (~b & d); k = 0x5a827999; break;
+        case 1: f = b ^ c ^ d; k = 0x6ed9eba1; break;
+        case 2: f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; break;
+        default: f = b ^ c ^ d; k = 0xca62c1d6; break;
+        }
+        t = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+static void sha256_block(uint32_t h[8], byte const *p)
+{
+    static uint32_t const K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    uint32_t w[64], s[8], t1, t2;
+
+    for (unsigned i = 0; i < 16; ++i)
+        w[i] = be32(p + 4 * i);
+    for (unsigned i = 16; i < 64; ++i)
+        w[i] = w[i - 16] + (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^ w[i - 15] >> 3)
+             + w[i - 7] + (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^ w[i - 2] >> 10);
+
+    memcpy(s, h, sizeof(s));
+    for (unsigned i = 0; i < 64; ++i) {
+        t1 = s[7] + (ror32(s[4], 6) ^ ror32(s[4], 11) ^ ror32(s[4], 25))
+           + ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+        t2 = (ror32(s[0], 2) ^ ror32(s[0], 13) ^ ror32(s[0], 22))
+           + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(*s));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+
+    for (unsigned i = 0; i < 8; ++i)
+        h[i] += s[i];
+}
+
+/*
+ * XXH64 with seed 0
+ */
+
+#define XXH_P1 0x9e3779b185ebca87ull
+#define XXH_P2 0xc2b2ae3d27d4eb4full
+#define XXH_P3 0x165667b19e3779f9ull
+#define XXH_P4 0x85ebca77c2b2ae63ull
+#define XXH_P5 0x27d4eb2f165667c5ull
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t in)
+    { return rol64(acc + in * XXH_P2, 31) * XXH_P1; }
+static inline uint64_t xxh_merge(uint64_t h, uint64_t v)
+    { return (h ^ xxh_round(0, v)) * XXH_P1 + XXH_P4; }
+
+static void xxh64_block(uint64_t v[4], byte const *p)
+{
+    for (unsigned i = 0; i < 4; ++i)
+        v[i] = xxh_round(v[i], le64(p + 8 * i));
+}
+
+static uint64_t xxh64_final(struct hash const *hash)
+{
+    uint64_t const *v = hash->v;
+    byte const *p = hash->buf;
+    size_t len = hash->buflen;
+    uint64_t h;
+
+    if (hash->total >= 32) {
+        h = rol64(v[0], 1) + rol64(v[1], 7) + rol64(v[2], 12) + rol64(v[3], 18);
+        for (unsigned i = 0; i < 4; ++i)
+            h = xxh_merge(h, v[i]);
+    }
+    else
+        h = XXH_P5;
+    h += hash->total;
+
+    for (; len >= 8; p += 8, len -= 8)
+        h = rol64(h ^ xxh_round(0, le64(p)), 27) * XXH_P1 + XXH_P4;
+    if (len >= 4) {
+        h = rol64(h ^ le32(p) * XXH_P1, 23) * XXH_P2 + XXH_P3;
+        p += 4, len -= 4;
+    }
+    for (; len; ++p, --len)
+        h = rol64(h ^ *p * XXH_P5, 11) * XXH_P1;
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * streaming interface
+ */
+
+void hash_init(struct hash *hash, enum hash_algo algo)
+{
+    static uint32_t const md5_iv[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    static uint32_t const sha1_iv[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    static uint32_t const sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memset(hash, 0, sizeof(*hash));
+    hash->algo = algo;
+
+    switch (algo) {
+    case HASH_CRC32: case HASH_CRC32C:
+        crc_tables();
+        break;
+    case HASH_MD5:
+        memcpy(hash->h, md5_iv, sizeof(md5_iv));
+        break;
+    case HASH_SHA1:
+        memcpy(hash->h, sha1_iv, sizeof(sha1_iv));
+        break;
+    case HASH_SHA256:
+        memcpy(hash->h, sha256_iv, sizeof(sha256_iv));
+        break;
+    case HASH_XXH64:
+        hash->v[0] = XXH_P1 + XXH_P2;
+        hash->v[1] = XXH_P2;
+        hash->v[2] = 0;
+        hash->v[3] = -XXH_P1;
+        break;
+    }
+}
+
+static size_t block_size(enum hash_algo algo)
+{
+    return algo == HASH_XXH64 ? 32 : 64;
+}
+
+static void hash_block(struct hash *hash, byte const *p)
+{
+    switch (hash->algo) {
+    case HASH_MD5: md5_block(hash->h, p); break;
+    case HASH_SHA1: sha1_block(hash->h, p); break;
+    case HASH_SHA256: sha256_block(hash->h, p); break;
+    case HASH_XXH64: xxh64_block(hash->v, p); break;
+    default: die("not a block hash");
+    }
+}
+
+void hash_update(struct hash *hash, byte const *data, size_t len)
+{
+    size_t bs = block_size(hash->algo), n;
+
+    hash->total += len;
+
+    if (hash->algo == HASH_CRC32 || hash->algo == HASH_CRC32C) {
+        hash->crc = crc_update(hash->algo, hash->crc, data, len);
+        return;
+    }
+
+    if (hash->buflen) {
+        memcpy(hash->buf + hash->buflen, data, n = min(len, bs - hash->buflen));
+        data += n, len -= n;
+        if ((hash->buflen += n) < bs)
+            return;
+        hash_block(hash, hash->buf);
+        hash->buflen = 0;
+    }
+    for (; len >= bs; data += bs, len -= bs)
+        hash_block(hash, data);
+    memcpy(hash->buf, data, hash->buflen = len);
+}
+
+/* md5 and sha pad with 0x80, zeros and the length in bits */
+static void md_pad(struct hash *hash, bool big_endian)
+{
+    uint64_t bits = hash->total * 8;
+    byte tail[72] = {0x80};
+    size_t n = 64 - (hash->total + 8) % 64;
+
+    if (big_endian)
+        put_be(tail + n, bits, 8);
+    else {
+        put_le32(tail + n, bits);
+        put_le32(tail + n + 4, bits >> 32);
+    }
+    hash_update(hash, tail, n + 8);
+}
+
+void hash_final(struct hash *hash, byte *digest)
+{
+    switch (hash->algo) {
+    case HASH_CRC32: case HASH_CRC32C:
+        put_be(digest, hash->crc, 4);
+        break;
+    case HASH_MD5:
+        md_pad(hash, false);
+        for (unsigned i = 0; i < 4; ++i)
+            put_le32(digest + 4 * i, hash->h[i]);
+        break;
+    case HASH_SHA1: case HASH_SHA256:
+        md_pad(hash, true);
+        for (unsigned i = 0; i < hash_size(hash->algo) / 4; ++i)
+            put_be(digest + 4 * i, hash->h[i], 4);
+        break;
+    case HASH_XXH64:
+        put_be(digest, xxh64_final(hash), 8);
+        break;
+    }
+}
+
+/*
+ * hashing blob ranges
+ */
+
+struct crc_job {
+    struct blob const *blob;
+    enum hash_algo algo;
+    size_t pos, len;
+    uint32_t crc;
+};
+
+static void *crc_thread(void *arg)
+{
+    struct crc_job *job = arg;
+    byte const *ptr;
+
+    job->crc = 0;
+    for (size_t i = 0, n; i < job->len; i += n) {
+        ptr = blob_lookup(job->blob, job->pos + i, &n);
+        job->crc = crc_update(job->algo, job->crc, ptr, n = min(n, job->len - i));
+    }
+    return NULL;
+}
+
+/* splits each round of a long CRC across threads and combines the pieces */
+static bool hash_crc_parallel(struct hash *hash, struct blob const *blob, size_t from, size_t to, size_t threads,
+        bool (*progress)(void *, size_t, size_t), void *arg)
+{
+    struct crc_job jobs[CONFIG_PARALLEL_MAX];
+    size_t pos = from, n;
+
+    while (pos < to) {
+        for (n = 0; n < threads && pos < to; ++n, pos += jobs[n - 1].len) {
+            jobs[n].blob = blob;
+            jobs[n].algo = hash->algo;
+            jobs[n].pos = pos;
+            jobs[n].len = min(HASH_CHUNK, to - pos);
+        }
+        parallel_run(crc_thread, jobs, sizeof(*jobs), n);
+
+        for (size_t i = 0; i < n; ++i)
+            hash->crc = crc_combine(hash->algo, hash->crc, jobs[i].crc, jobs[i].len);
+        hash->total += pos - jobs[0].pos;
+
+        if (progress && !progress(arg, pos - from, to - from))
+            return false;
+    }
+    return true;
+}
+
+/* hashes [from, to) of blob into digest; returns false if cancelled */
+bool hash_blob(struct blob const *blob, size_t from, size_t to, enum hash_algo algo, byte *digest,
+        bool (*progress)(void *arg, size_t done, size_t total), void *arg)
+{
+    struct hash hash;
+    byte const *ptr;
+    size_t threads = blob_concurrent(blob) ? parallel_threads(to - from) : 1;
+
+    hash_init(&hash, algo);
+
+    if ((algo == HASH_CRC32 || algo == HASH_CRC32C) && threads > 1) {
+        if (!hash_crc_parallel(&hash, blob, from, to, threads, progress, arg))
+            return false;
+    }
+    else {
+        for (size_t pos = from, end, n; pos < to; pos = end) {
+            for (end = min(to, pos + HASH_CHUNK); pos < end; pos += n) {
+                ptr = blob_lookup(blob, pos, &n);
+                hash_update(&hash, ptr, n = min(n, end - pos));
+            }
+            if (progress && !progress(arg, end - from, to - from))
+                return false;
+        }
+    }
+
+    hash_final(&hash, digest);
+    return true;
+}
+
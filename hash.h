@@ -0,0 +1,42 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "common.h"
+#include "blob.h"
+
+/* checksums and digests of blob ranges */
+
+enum hash_algo {
+    HASH_CRC32,
+    HASH_CRC32C,
+    HASH_MD5,
+    HASH_SHA1,
+    HASH_SHA256,
+    HASH_XXH64,
+};
+
+#define HASH_MAX_SIZE 32 /* bytes in the largest digest */
+
+struct hash {
+    enum hash_algo algo;
+    uint64_t total;  /* bytes hashed so far */
+    uint32_t crc;
+    uint32_t h[8];   /* md5, sha1, sha256 */
+    uint64_t v[4];   /* xxh64 accumulators */
+    byte buf[64];    /* partial block */
+    size_t buflen;
+};
+
+bool hash_lookup(char const *name, enum hash_algo *algo);
+char const *hash_name(enum hash_algo algo);
+size_t hash_size(enum hash_algo algo);
+
+void hash_init(struct hash *hash, enum hash_algo algo);
+void hash_update(struct hash *hash, byte const *data, size_t len);
+void hash_final(struct hash *hash, byte *digest);
+
+/* progress is called between rounds; hashing stops if it returns false */
+bool hash_blob(struct blob const *blob, size_t from, size_t to, enum hash_algo algo, byte *digest,
+        bool (*progress)(void *arg, size_t done, size_t total), void *arg);
+
+#endif
@@ -0,0 +1,344 @@
+#include "common.h"
+#include "blob.h"
+#include "history.h"
+#include "histfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * Undo and redo history that outlives the editor and the heap. When a
+ * buffer is closed, the history that applies to the file on disk is
+ * written to $XDG_CACHE_HOME/hyx/undo-$dev-$ino:
+ *
+ *     "HYXUNDO1" $file_id $record... $end $record... $end
+ *
+ * with the undo list first and the redo list second, each oldest first.
+ * When the same, unchanged file is opened again, that file is mapped and
+ * the diffs point into the mapping instead of being read into memory.
+ * A history whose file was changed since is discarded.
+ *
+ * During a session, diff data can be moved to an unnamed temporary file
+ * and mapped back in the same way when the memory budget runs out.
+ */
+
+#define HISTFILE_MAGIC "HYXUNDO1"
+
+struct histfile_rec {
+    uint64_t pos, len;
+    uint8_t type, join, has_data, end;
+};
+
+/* where the history of the file with the given identity is kept */
+static char *histfile_path(struct file_id const *id)
+{
+    char const *cache = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char dir[PATH_MAX], *path;
+
+    if (cache && *cache)
+        snprintf(dir, sizeof(dir), "%s", cache);
+    else if (home && *home)
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else
+        return NULL;
+
+    mkdir(dir, S_IRWXU);
+    strncat(dir, "/hyx", sizeof(dir) - strlen(dir) - 1);
+
+    if (mkdir(dir, S_IRWXU) && errno != EEXIST)
+        return NULL;
+
+    path = malloc_strict(strlen(dir) + strlen("/undo-") + 2 * 16 + strlen("-.tmp") + 1);
+    sprintf(path, "%s/undo-%llx-%llx", dir, (unsigned long long) id->dev, (unsigned long long) id->ino);
+    return path;
+}
+
+static void histfile_add_map(struct histfile *hf, void *ptr, size_t len)
+{
+    if (hf->n == hf->cap)
+        hf->maps = realloc_strict(hf->maps, (hf->cap = max(4, 2 * hf->cap)) * sizeof(*hf->maps));
+    hf->maps[hf->n].ptr = ptr;
+    hf->maps[hf->n].len = len;
+    ++hf->n;
+}
+
+/* rebuilds a list from records; returns where it ended or NULL if malformed */
+static byte *read_list(struct diff **list, struct blob *blob, byte *p, byte const *end)
+{
+    struct histfile_rec rec;
+    struct diff *diff;
+
+    for (;;) {
+        if ((size_t) (end - p) < sizeof(rec))
+            return NULL;
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+
+        if (rec.end)
+            return p;
+        if (rec.type > DELETE || (rec.has_data && (size_t) (end - p) < rec.len))
+            return NULL;
+
+        diff = malloc_strict(sizeof(*diff));
+        diff->type = rec.type;
+        diff->pos = rec.pos;
+        diff->len = rec.len;
+        diff->join = rec.join;
+        diff->mapped = true;
+        diff->data = rec.has_data ? p : NULL;
+        diff->next = *list;
+        *list = diff;
+        blob->history_mem += diff_memory(diff);
+
+        if (rec.has_data)
+            p += rec.len;
+    }
+}
+
+/* whether the diffs of a list, applied in turn to len bytes, stay within
+ * them and carry the bytes they put in */
+static bool list_fits(struct diff const *list, size_t len)
+{
+    for (struct diff const *d = list; d; d = d->next) {
+        if (!d->len || d->pos > len)
+            return false;
+        switch (d->type) {
+        case REPLACE:
+            if (!d->data || d->len > len - d->pos)
+                return false;
+            break;
+        case INSERT:
+            if (!d->data || d->len > SIZE_MAX - len)
+                return false;
+            len += d->len;
+            break;
+        case DELETE:
+            if (d->len > len - d->pos)
+                return false;
+            len -= d->len;
+            break;
+        }
+    }
+    return true;
+}
+
+/* picks up the history left by an earlier session; also sets the blob up
+ * for spilling its history later */
+void histfile_open(struct blob *blob)
+{
+    struct histfile *hf = malloc_strict(sizeof(*hf));
+    char *path, magic[sizeof(HISTFILE_MAGIC) - 1];
+    struct file_id id;
+    struct stat st;
+    size_t hdr = sizeof(magic) + sizeof(id);
+    byte *map, *p;
+    int fd;
+
+    memset(hf, 0, sizeof(*hf));
+    hf->spill_fd = -1;
+    blob->histfile = hf;
+
+    assert(!blob->undo && !blob->redo);
+
+    if (!blob->filename)
+        return;
+    file_id_get(blob->filename, &hf->id);
+    if (!hf->id.ino || !(path = histfile_path(&hf->id)))
+        return;
+
+    if (0 > (fd = open(path, O_RDONLY))) {
+        free(path);
+        return;
+    }
+    if (fstat(fd, &st))
+        pdie("fstat");
+
+    if ((size_t) st.st_size > hdr) {
+        map = mmap_strict(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        memcpy(magic, map, sizeof(magic));
+        memcpy(&id, map + sizeof(magic), sizeof(id));
+
+        p = NULL;
+        if (!memcmp(magic, HISTFILE_MAGIC, sizeof(magic)) && !memcmp(&id, &hf->id, sizeof(id))
+                && (p = read_list(&blob->undo, blob, map + hdr, map + st.st_size)))
+            p = read_list(&blob->redo, blob, p, map + st.st_size);
+        /* both lists start from the file as it is */
+        if (p && !(list_fits(blob->undo, blob_length(blob)) && list_fits(blob->redo, blob_length(blob))))
+            p = NULL;
+
+        if (p)
+            histfile_add_map(hf, map, st.st_size);
+        else {
+            /* the file changed underneath, or the history is damaged */
+            blob->history_mem -= history_free(&blob->undo);
+            blob->history_mem -= history_free(&blob->redo);
+            munmap_strict(map, st.st_size);
+            unlink(path);
+        }
+    }
+
+    close(fd);
+    free(path);
+}
+
+/* the history now applies to the file as just written */
+void histfile_saved(struct blob *blob)
+{
+    if (blob->histfile)
+        file_id_get(blob->filename, &blob->histfile->id);
+}
+
+/* moves all diff data on the heap to the spill file; returns the bytes released */
+size_t histfile_spill(struct blob *blob)
+{
+    struct histfile *hf = blob->histfile;
+    struct diff *lists[] = {blob->undo, blob->redo};
+    size_t total = 0, off, pos, page = sysconf(_SC_PAGESIZE);
+    FILE *fp;
+    byte *map;
+
+    if (!hf)
+        return 0;
+
+    for (size_t i = 0; i < sizeof(lists) / sizeof(*lists); ++i)
+        for (struct diff *d = lists[i]; d; d = d->next)
+            if (d->data && !d->mapped)
+                total += d->len;
+    if (!total)
+        return 0;
+
+    if (hf->spill_fd < 0) {
+        if (!(fp = tmpfile()))
+            return 0;
+        hf->spill_fd = dup(fileno(fp));
+        fclose(fp);
+        if (hf->spill_fd < 0)
+            return 0;
+    }
+
+    /* mappings must start on a page boundary */
+    pos = off = (hf->spill_len + page - 1) / page * page;
+    for (size_t i = 0; i < sizeof(lists) / sizeof(*lists); ++i)
+        for (struct diff *d = lists[i]; d; d = d->next) {
+            if (!d->data || d->mapped)
+                continue;
+            for (size_t k = 0; k < d->len; ) {
+                ssize_t r = pwrite(hf->spill_fd, d->data + k, d->len - k, pos + k);
+                if (r < 0 && errno != EINTR)
+                    return 0;
+                k += r < 0 ? 0 : r;
+            }
+            pos += d->len;
+        }
+
+    if (MAP_FAILED == (map = mmap(NULL, total, PROT_READ, MAP_SHARED, hf->spill_fd, off)))
+        return 0;
+    histfile_add_map(hf, map, total);
+    hf->spill_len = off + total;
+
+    for (size_t i = 0; i < sizeof(lists) / sizeof(*lists); ++i)
+        for (struct diff *d = lists[i]; d; d = d->next) {
+            if (!d->data || d->mapped)
+                continue;
+            free(d->data);
+            d->data = map;
+            d->mapped = true;
+            map += d->len;
+        }
+
+    blob->history_mem -= total;
+    return total;
+}
+
+/* writes the diffs below the newest skip steps, oldest first */
+static size_t write_list(FILE *fp, struct diff const *list, size_t skip)
+{
+    struct diff const **all = NULL;
+    struct histfile_rec rec;
+    size_t n = 0, cap = 0;
+
+    for (; list && skip; list = list->next)
+        skip -= !list->join;
+    for (; list; list = list->next) {
+        if (n == cap)
+            all = realloc_strict(all, (cap = max(16, 2 * cap)) * sizeof(*all));
+        all[n++] = list;
+    }
+
+    for (size_t i = n; i--; ) {
+        memset(&rec, 0, sizeof(rec));
+        rec.pos = all[i]->pos;
+        rec.len = all[i]->len;
+        rec.type = all[i]->type;
+        rec.join = all[i]->join;
+        rec.has_data = !!all[i]->data;
+        fwrite(&rec, sizeof(rec), 1, fp);
+        if (rec.has_data)
+            fwrite(all[i]->data, 1, rec.len, fp);
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.end = 1;
+    fwrite(&rec, sizeof(rec), 1, fp);
+
+    free(all);
+    return n;
+}
+
+/* stores the history that applies to the file on disk, if any */
+void histfile_persist(struct blob *blob)
+{
+    struct histfile *hf = blob->histfile;
+    struct file_id id;
+    char *path, *tmp;
+    size_t n;
+    FILE *fp;
+
+    if (!hf || !blob->filename || blob->saved_dist < 0)
+        return;
+
+    /* don't attach history to a file that was changed behind our back */
+    file_id_get(blob->filename, &id);
+    if (!id.ino || memcmp(&id, &hf->id, sizeof(id)) || !(path = histfile_path(&id)))
+        return;
+
+    tmp = malloc_strict(strlen(path) + strlen(".tmp") + 1);
+    sprintf(tmp, "%s.tmp", path);
+
+    if ((fp = fopen(tmp, "wb"))) {
+        fwrite(HISTFILE_MAGIC, 1, strlen(HISTFILE_MAGIC), fp);
+        fwrite(&id, sizeof(id), 1, fp);
+        /* steps newer than the last save don't apply to the file on disk */
+        n = write_list(fp, blob->undo, blob->saved_dist);
+        n += write_list(fp, blob->saved_dist ? NULL : blob->redo, 0);
+
+        if ((ferror(fp) | fclose(fp)) || !n || rename(tmp, path))
+            unlink(tmp);
+        if (!n)
+            unlink(path);
+    }
+
+    free(tmp);
+    free(path);
+}
+
+void histfile_free(struct histfile *hf)
+{
+    if (!hf)
+        return;
+    for (size_t i = 0; i < hf->n; ++i)
+        munmap_strict(hf->maps[i].ptr, hf->maps[i].len);
+    if (hf->spill_fd >= 0)
+        close(hf->spill_fd);
+    free(hf->maps);
+    free(hf);
+}
+
+#undef HISTFILE_MAGIC
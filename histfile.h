@@ -0,0 +1,29 @@
+#ifndef HISTFILE_H
+#define HISTFILE_H
+
+#include "common.h"
+
+struct blob;
+
+struct histfile_map {
+    void *ptr;
+    size_t len;
+};
+
+struct histfile {
+    struct file_id id; /* the file on disk when the history was last in sync with it */
+
+    int spill_fd; /* unnamed file holding diff data moved off the heap */
+    size_t spill_len;
+
+    size_t n, cap;
+    struct histfile_map *maps;
+};
+
+void histfile_open(struct blob *blob);
+void histfile_saved(struct blob *blob);
+size_t histfile_spill(struct blob *blob);
+void histfile_persist(struct blob *blob);
+void histfile_free(struct histfile *hf);
+
+#endif
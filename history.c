@@ -5,14 +5,6 @@
 
 #include <string.h>
 
-struct diff {
-    enum op_type type;
-    size_t pos;
-    byte *data;
-    size_t len;
-    struct diff *next;
-};
-
 static void diff_apply(struct blob *blob, struct diff *diff)
 {
     switch (diff->type) {
@@ -35,25 +27,53 @@ void history_init(struct diff **history)
     *history = NULL;
 }
 
-void history_free(struct diff **history)
+size_t diff_memory(struct diff const *diff)
 {
+    return sizeof(*diff) + (diff->data && !diff->mapped ? diff->len : 0);
+}
+
+void diff_free(struct diff *diff)
+{
+    if (!diff->mapped)
+        free(diff->data);
+    free(diff);
+}
+
+/* returns the number of bytes released */
+size_t history_free(struct diff **history)
+{
+    size_t mem = 0;
     struct diff *tmp, *cur = *history;
     while (cur) {
         tmp = cur;
         cur = cur->next;
-        free(tmp->data);
-        free(tmp);
+        mem += diff_memory(tmp);
+        diff_free(tmp);
     }
     *history = NULL;
+    return mem;
+}
+
+/* drops the oldest entries until at most keep bytes remain; returns the bytes released */
+size_t history_truncate(struct diff **history, size_t keep)
+{
+    size_t mem = 0;
+    for (struct diff **cur = history; *cur; cur = &(*cur)->next) {
+        if ((mem += diff_memory(*cur)) > keep)
+            return history_free(cur);
+    }
+    return 0;
 }
 
 /* pushes a diff that _undoes_ the passed operation */
-void history_save(struct diff **history, enum op_type type, struct blob *blob, size_t pos, size_t len)
+void history_save(struct diff **history, enum op_type type, struct blob *blob, size_t pos, size_t len, bool join)
 {
     struct diff *diff = malloc_strict(sizeof(*diff));
     diff->type = type;
     diff->pos = pos;
     diff->len = len;
+    diff->join = join;
+    diff->mapped = false;
     diff->next = *history;
 
     switch (type) {
@@ -72,26 +92,137 @@ void history_save(struct diff **history, enum op_type type, struct blob *blob, s
     }
 
     *history = diff;
+    blob->history_mem += diff_memory(diff);
 }
 
-bool history_step(struct diff **from, struct blob *blob, struct diff **to, size_t *pos)
+/* calls f with the operations that the newest steps entries undo, oldest
+ * first. returns false without calling f if the history is shorter. */
+bool history_replay(struct diff const *history, size_t steps,
+        void (*f)(void *arg, enum op_type type, size_t pos, size_t len), void *arg)
 {
-    struct diff *diff = *from;
+    struct diff const **list = NULL, *diff;
+    size_t n = 0, cap = 0;
+
+    for (diff = history; diff && steps; diff = diff->next) {
+        if (n == cap)
+            list = realloc_strict(list, (cap = max(16, 2 * cap)) * sizeof(*list));
+        list[n++] = diff;
+        steps -= !diff->join;
+    }
+
+    if (!steps) {
+        while (n--) {
+            diff = list[n];
+            f(arg, diff->type == INSERT ? DELETE : diff->type == DELETE ? INSERT : REPLACE, diff->pos, diff->len);
+        }
+    }
 
-    if (!diff)
-        return false;
+    free(list);
+    return !steps;
+}
 
-    if (pos)
-        *pos = diff->pos;
+/* consecutive inserts or deletes that form one contiguous range, not yet
+ * applied to the blob */
+struct run {
+    enum op_type type;
+    size_t pos, len;
+    byte *data; /* the bytes to insert */
+};
 
-    if (to)
-        history_save(to, diff->type, blob, diff->pos, diff->len);
+static void run_flush(struct run *run, struct blob *blob)
+{
+    if (run->type == INSERT && run->len)
+        blob_insert(blob, run->pos, run->data, run->len, false);
+    else if (run->type == DELETE && run->len)
+        blob_delete(blob, run->pos, run->len, false);
+    free(run->data);
+    memset(run, 0, sizeof(*run));
+    run->type = REPLACE;
+}
 
-    *from = diff->next;
-    diff_apply(blob, diff);
-    free(diff->data);
-    free(diff);
+/* adds the diff to the run if that keeps it contiguous. the diff applies
+ * to the blob as if the run had been applied; returns where its bytes are
+ * in the blob as it is, or SIZE_MAX if it doesn't fit the run. */
+static size_t run_add(struct run *run, struct diff const *diff)
+{
+    size_t at;
 
-    return true;
+    if (diff->type != run->type && run->len)
+        return SIZE_MAX;
+
+    switch (diff->type) {
+    case INSERT:
+        if (run->len && diff->pos != run->pos && diff->pos != run->pos + run->len)
+            return SIZE_MAX;
+        at = run->len ? diff->pos - run->pos : 0;
+        run->data = realloc_strict(run->data, run->len + diff->len);
+        memmove(run->data + at + diff->len, run->data + at, run->len - at);
+        memcpy(run->data + at, diff->data, diff->len);
+        if (!run->len)
+            run->pos = diff->pos;
+        run->type = INSERT;
+        run->len += diff->len;
+        return diff->pos;
+    case DELETE:
+        if (!run->len)
+            at = run->pos = diff->pos;
+        else if (diff->pos == run->pos)
+            at = run->pos + run->len;
+        else if (diff->pos + diff->len == run->pos)
+            at = run->pos = diff->pos;
+        else
+            return SIZE_MAX;
+        run->type = DELETE;
+        run->len += diff->len;
+        return at;
+    default:
+        return SIZE_MAX;
+    }
 }
 
+/* moves up to steps joined groups from one list to the other, applying them
+ * to the blob on the way. adjacent inserts or deletes are merged before
+ * they are applied, so that undoing many small edits moves the blob's
+ * bytes once rather than once per edit. returns the number of steps taken. */
+size_t history_step(struct diff **from, struct blob *blob, struct diff **to, size_t steps, size_t *pos)
+{
+    struct run run = {.type = REPLACE};
+    struct diff *diff;
+    bool join, more;
+    size_t n, at;
+
+    for (n = 0; n < steps && *from; ++n) {
+        join = false;
+        do {
+            diff = *from;
+            more = diff->join;
+
+            if (pos)
+                *pos = diff->pos;
+
+            if (SIZE_MAX == (at = run_add(&run, diff))) {
+                run_flush(&run, blob);
+                at = run_add(&run, diff);
+            }
+            if (SIZE_MAX == at)
+                at = diff->pos;
+
+            /* the reversed step is joined in the opposite order. the bytes
+             * a delete removes are read where they are before the run */
+            if (to) {
+                history_save(to, diff->type, blob, at, diff->len, join);
+                (*to)->pos = diff->pos;
+            }
+            join = true;
+
+            *from = diff->next;
+            if (run.type == REPLACE)
+                diff_apply(blob, diff);
+            blob->history_mem -= diff_memory(diff);
+            diff_free(diff);
+        } while (more && *from);
+    }
+    run_flush(&run, blob);
+
+    return n;
+}
@@ -1,6 +1,8 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
+#include "common.h"
+
 struct blob;
 
 enum op_type {
@@ -9,11 +11,25 @@ enum op_type {
     DELETE,
 };
 
-struct diff;
+struct diff {
+    enum op_type type;
+    size_t pos;
+    byte *data;
+    size_t len;
+    bool join;   /* undone and redone together with the next one */
+    bool mapped; /* data lives in a file mapping, not on the heap */
+    struct diff *next;
+};
+
+size_t diff_memory(struct diff const *diff);
+void diff_free(struct diff *diff);
 
 void history_init(struct diff **history);
-void history_free(struct diff **history);
-void history_save(struct diff **history, enum op_type type, struct blob *blob, size_t pos, size_t len);
-bool history_step(struct diff **history, struct blob *blob, struct diff **target, size_t *pos);
+size_t history_free(struct diff **history);
+size_t history_truncate(struct diff **history, size_t keep);
+void history_save(struct diff **history, enum op_type type, struct blob *blob, size_t pos, size_t len, bool join);
+bool history_replay(struct diff const *history, size_t steps,
+        void (*f)(void *arg, enum op_type type, size_t pos, size_t len), void *arg);
+size_t history_step(struct diff **history, struct blob *blob, struct diff **target, size_t steps, size_t *pos);
 
 #endif
@@ -21,6 +21,12 @@
 #include "blob.h"
 #include "view.h"
 #include "input.h"
+#include "buffer.h"
+#include "script.h"
+#include "dump.h"
+#include "patch.h"
+#include "delta.h"
+#include "jobs.h"
 #include "ansi.h"
 
 #include <stdlib.h>
@@ -30,7 +36,8 @@
 #include <setjmp.h>
 
 
-struct blob blob;
+struct buffers buffers;
+struct blob cmp;
 struct view view;
 struct input input;
 
@@ -95,6 +102,24 @@ __attribute__((noreturn)) void help(int st)
     printf("    %sinvocation:%s hyx [filename]\n",
             tty ? color_yellow : "", tty ? color_normal : "");
 
+    printf("    %sinvocation:%s hyx [filename] [filename]   (compare mode)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
+    printf("    %sinvocation:%s hyx [-j $jobs] -s [script] [filename...]   (batch mode)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
+    printf("    %sinvocation:%s hyx --dump [--cols $n] [--range $a:$b] [filename]   (text output)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
+    printf("    %sinvocation:%s hyx --apply [patchfile] [filename]   (xxd dump, IPS or offset: hex lines)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
+    printf("    %sinvocation:%s hyx -p [pid]   (memory of a running process; :w writes changes back)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
+    printf("    %sinvocation:%s hyx --overlay [delta] [filename]   (open with changes saved by :wdelta)\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+
     printf("    %sinvocation:%s [command] | hyx\n\n",
             tty ? color_yellow : "", tty ? color_normal : "");
 
@@ -111,6 +136,9 @@ __attribute__((noreturn)) void help(int st)
     printf("u               undo\n");
     printf("ctrl+r          redo\n");
     printf("\n");
+    printf("#$n (key)       repeat movement, delete, paste, undo/redo or ctrl+a/x $n times\n");
+    printf(".               repeat the last delete, paste or ctrl+a/x\n");
+    printf("\n");
     printf("v               start a selection\n");
     printf("escape          abort a selection\n");
     printf("x               delete current byte or selection\n");
@@ -124,6 +152,8 @@ __attribute__((noreturn)) void help(int st)
     printf("ctrl+u, ctrl+d  scroll up/down one page\n");
     printf("g, G            jump to start/end of screen or file\n");
     printf("^, $            jump to start/end of current line\n");
+    printf("}, {            jump to next/previous hole or data region, or mapping of a process\n");
+    printf("), (            skip over current run of equal bytes\n");
     printf("\n");
     printf(":               enter command (see below)\n");
     printf("\n");
@@ -134,6 +164,8 @@ __attribute__((noreturn)) void help(int st)
     printf("\n");
     printf("ctrl+a, ctrl+x  increment/decrement current byte\n");
     printf("\n");
+    printf(">, <            jump to next/previous difference (compare mode)\n");
+    printf("\n");
     printf("ctrl+g          show file name and current position\n");
     printf("ctrl+z          suspend editor; use \"fg\" to continue\n");
     printf("\n");
@@ -142,9 +174,54 @@ __attribute__((noreturn)) void help(int st)
             tty ? color_yellow : "", tty ? color_normal : "");
     printf("$offset         jump to offset (supports hex/dec/oct)\n");
     printf("q               quit\n");
-    printf("w [$filename]   save\n");
+    printf("w [$filename]   save (in the background)\n");
     printf("wq [$filename]  save and quit\n");
+    printf("w! [$filename]  save even if someone else changed the file meanwhile\n");
+    printf("wdelta $file    save changes as a delta to the file on disk (see --overlay)\n");
+    printf("e $filename     edit another file in a new buffer\n");
+    printf("apply $file     apply a patch or hex dump as a single undo step\n");
+    printf("undo [$n]       undo $n steps, or up to the saved state with \"saved\", or \"all\"\n");
+    printf("redo [$n]       redo $n steps, or up to the saved state with \"saved\", or \"all\"\n");
+    printf("fill $hex       overwrite the selection (or file) with a repeated pattern\n");
+    printf("xor/and/or $hex combine the selection (or file) with a repeated key\n");
+    printf("not             invert the bits of the selection (or file)\n");
+    printf("add $n [$w [le/be]]  add $n to each $w-byte element (default 1)\n");
+    printf("reverse         reverse the order of the bytes in the selection (or file)\n");
+    printf("swap-endian $w  swap the byte order of each $w-byte element\n");
+    printf("hash $algo [$a:$b]  crc32, crc32c, md5, sha1, sha256 or xxh64 of a range,\n");
+    printf("                the selection or the file, computed in the background\n");
+    printf("strings [$n] [$enc]  list strings of >= $n (4) characters, ascii, utf16le\n");
+    printf("                or utf16be, in the selection or the file; alone, reopen the list\n");
+    printf("template [$file]  annotate the view with a structure template; alone, remove it\n");
+    printf("mapping         show the process mapping at the cursor\n");
+    printf("mark-state $n   remember the current contents under a name\n");
+    printf("restore $n      go back to a remembered state (undoable)\n");
+    printf("drop-state $n   forget a remembered state\n");
+    printf("states          list remembered states and the memory they use\n");
+    printf("bn, bp          switch to next/previous buffer\n");
+    printf("ls              list buffers\n");
+    printf("budget [$size]  show or set the memory budget (suffixes k, M, G)\n");
     printf("color y/n       toggle colors\n");
+    printf("overview [y/n]  toggle a column of per-block entropy; click it to jump\n");
+    printf("follow [y/n]    toggle showing data appended to the file, like tail -f\n");
+    printf("reload          take in changes made to the file by others; own changes stay\n");
+    printf("cancel          stop the jobs running in the background, such as hash\n");
+    printf("inspect [y/n]   toggle a panel decoding the bytes at the cursor\n");
+    printf("delta $n        show second file shifted by $n bytes (compare mode)\n");
+    printf("resync [y/n]    re-align files at cursor, or toggle automatic re-aligning\n");
+    printf("run $n          jump to next run of >= $n equal bytes (backwards if $n < 0)\n");
+
+    printf("\n");
+
+    printf("    %sscript commands:%s\n\n",
+            tty ? color_yellow : "", tty ? color_normal : "");
+    printf("goto $offset    jump to offset (also +$n, -$n, end)\n");
+    printf("write $bytes    overwrite bytes at cursor (hex or \"string\")\n");
+    printf("insert $bytes   insert bytes at cursor\n");
+    printf("delete $n       delete bytes at cursor\n");
+    printf("search $bytes   jump to next match\n");
+    printf("replace $a $b   replace all matches of $a after cursor with $b\n");
+    printf("save [$name]    save\n");
 
     printf("\n");
 
@@ -154,33 +231,97 @@ __attribute__((noreturn)) void help(int st)
 int main(int argc, char **argv)
 {
     struct sigaction sigact;
+    static bool over_budget = false; /* survives the longjmp to the main loop */
 
-    char *filename = NULL;
+    char *filename = NULL, *cmpname = NULL, *script = NULL, *range = NULL, *overlay = NULL;
+    bool dump = false;
+    long pid = 0;
+    long cols = 0, jobs = sysconf(_SC_NPROCESSORS_ONLN);
 
     for (size_t i = 1; i < (size_t) argc; ++i) {
         if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
             help(0);
         else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--version"))
             version();
+        else if (!strcmp(argv[i], "-s") && i + 1 < (size_t) argc)
+            script = argv[++i];
+        else if (!strcmp(argv[i], "-j") && i + 1 < (size_t) argc)
+            jobs = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--apply") && i + 2 == (size_t) argc - 1)
+            return patch_main(argv[i + 1], argv[i + 2]);
+        else if (!strcmp(argv[i], "-p") && i + 1 < (size_t) argc)
+            pid = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--overlay") && i + 1 < (size_t) argc)
+            overlay = argv[++i];
+        else if (!strcmp(argv[i], "--dump"))
+            dump = true;
+        else if (!strcmp(argv[i], "--cols") && i + 1 < (size_t) argc)
+            cols = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--range") && i + 1 < (size_t) argc)
+            range = argv[++i];
+        else if (script)
+            /* all remaining arguments are files to patch */
+            return script_main(script, argv + i, argc - i, jobs > 0 ? jobs : 1);
         else if (!filename)
             filename = argv[i];
+        else if (!cmpname)
+            cmpname = argv[i];
         else
             help(EXIT_FAILURE);
     }
 
-    blob_init(&blob);
-    if (!isatty(fileno(stdin))) {
+    if (script || cols < 0 || ((cols || range) && !dump) || (overlay && (dump || !filename)))
+        help(EXIT_FAILURE);
+    if (pid && (pid < 0 || filename || dump || overlay))
+        help(EXIT_FAILURE);
+
+    if (dump) {
+        if (cmpname) help(EXIT_FAILURE);
+        return dump_main(filename, cols, range);
+    }
+
+    buffers_init(&buffers);
+    if (pid) {
+        /* edits go straight back into the process: no journal or history file */
+        blob_load_process(&buffers_add(&buffers)->blob, pid);
+    }
+    else if (!isatty(fileno(stdin))) {
         if (filename) help(EXIT_FAILURE);
-        blob_load_stream(&blob, stdin);
+        blob_load_stream(&buffers_add(&buffers)->blob, stdin);
         if (!freopen("/dev/tty", "r", stdin))
             pdie("could not reopen controlling TTY");
     }
     else {
-        blob_load(&blob, filename);
+        struct blob *blob = &buffers_add(&buffers)->blob;
+        blob_load(blob, filename);
+        histfile_open(blob);
+        blob->journal = journal_open(blob);
+    }
+
+    /* keys are waited for with poll(), which can't see what stdio buffered */
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    if (overlay) {
+        enum delta_error err = delta_apply(buffers_blob(&buffers), overlay);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", overlay, delta_strerror(err));
+            exit(EXIT_FAILURE);
+        }
     }
 
-    view_init(&view, &blob, &input);
+    view_init(&view, buffers_blob(&buffers), &input);
     input_init(&input, &view);
+    input.buffers = &buffers;
+
+    /* address zero is never mapped: start at the first mapping */
+    if (blob_unmapped(buffers_blob(&buffers), 0))
+        input.cur = range_end(&buffers_blob(&buffers)->holes.r[0]);
+
+    if (cmpname) {
+        blob_init(&cmp);
+        blob_load(&cmp, cmpname);
+        view.cmp = &cmp;
+    }
 
     /* set up signal handler */
     memset(&sigact, 0, sizeof(sigact));
@@ -193,6 +334,7 @@ int main(int argc, char **argv)
 
     view_recompute(&view, true);
     view_visual(&view);
+    input_recovered(&input);
 
     do {
         /* This is used to redraw immediately when the window size changes. */
@@ -214,17 +356,35 @@ int main(int argc, char **argv)
             view_visual(&view);
             view.cont = false;
         }
+        if (buffers_memory(&buffers) > buffers.budget) {
+            bool over = buffers_enforce_budget(&buffers, 0);
+            if (!over)
+                view_error(&view, "memory budget exceeded: moved or dropped old undo steps.");
+            else if (!over_budget)
+                view_error(&view, "over memory budget, even without undo history.");
+            over_budget = over;
+        }
+        else
+            over_budget = false;
+
         assert(input.cur >= view.start && input.cur < view.start + view.rows * view.cols);
         view_update(&view);
+        while (view_idle(&view) && !input_pending());
 
+        buffers_commit(&buffers);
+        input_wait(&input);
         input_get(&input, &quit);
 
     } while (!quit);
 
+    /* finishes saves still running */
+    jobs_shutdown();
     view_text(&view, true);
 
     input_free(&input);
     view_free(&view);
-    blob_free(&blob);
+    if (view.cmp)
+        blob_free(&cmp);
+    buffers_free(&buffers);
 }
 
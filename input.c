@@ -3,6 +3,12 @@
 #include "blob.h"
 #include "view.h"
 #include "input.h"
+#include "buffer.h"
+#include "patch.h"
+#include "delta.h"
+#include "xform.h"
+#include "hash.h"
+#include "jobs.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,6 +19,7 @@
 
 #include <time.h>
 #include <sys/time.h>
+#include <poll.h>
 
 extern jmp_buf jmp_mainloop; /* hyx.c */
 
@@ -20,11 +27,13 @@ void input_init(struct input *input, struct view *view)
 {
     memset(input, 0, sizeof(*input));
     input->view = view;
+    strs_list_init(&input->strings);
 }
 
 void input_free(struct input *input)
 {
     free(input->search.needle);
+    strs_list_free(&input->strings);
 }
 
 /*
@@ -40,11 +49,25 @@ enum {
     KEY_SPECIAL_UP, KEY_SPECIAL_DOWN, KEY_SPECIAL_RIGHT, KEY_SPECIAL_LEFT,
     KEY_SPECIAL_PGUP, KEY_SPECIAL_PGDOWN,
     KEY_SPECIAL_HOME, KEY_SPECIAL_END,
+    KEY_MOUSE,
 };
 
+/* button and 0-based screen position of the last KEY_MOUSE */
+static struct {
+    unsigned button, row, col;
+} mouse;
+
+/* a key that was read too far, for the next getch() */
+static int pushback = EOF;
+
 static key getch()
 {
     int c;
+    if (pushback != EOF) {
+        c = pushback;
+        pushback = EOF;
+        return c;
+    }
     errno = 0;
     if (EOF == (c = getc(stdin))) {
         if (errno == EINTR)
@@ -56,8 +79,8 @@ static key getch()
 
 static void ungetch(int c)
 {
-    if (c != ungetc(c, stdin))
-        pdie("ungetc");
+    assert(pushback == EOF);
+    pushback = c;
 }
 
 static key get_key()
@@ -73,9 +96,12 @@ static key get_key()
         have_escape,
         have_bracket,
         need_tilde,
+        need_mouse,
     } state = none;
     static key r;
     static uint64_t tick;
+    static byte m[3];
+    static unsigned mlen;
 
     key k;
 
@@ -147,6 +173,7 @@ start_timer:
         case '6': state = need_tilde; r = KEY_SPECIAL_PGDOWN; goto next;
         case '7': state = need_tilde; r = KEY_SPECIAL_HOME; goto next;
         case '8': state = need_tilde; r = KEY_SPECIAL_END; goto next;
+        case 'M': state = need_mouse; mlen = 0; goto next;
         default:
 discard_sequence:
               /* We don't know this one. Enter discarding state and
@@ -155,6 +182,18 @@ discard_sequence:
               goto start_timer;
         }
 
+    case need_mouse:
+        /* button, column and row, each offset by 32 */
+        m[mlen++] = k;
+        if (mlen < sizeof(m))
+            goto next;
+        mouse.button = m[0] - 32;
+        mouse.col = m[1] - 33;
+        mouse.row = m[2] - 33;
+        state = none;
+        r = KEY_MOUSE;
+        goto stop_timer;
+
     case need_tilde:
         if (k != '~')
             goto discard_sequence;
@@ -215,11 +254,31 @@ static size_t sat_add_step(size_t x, size_t y, size_t z, size_t b)
 }
 
 enum cur_move_direction { MOVE_LEFT, MOVE_RIGHT };
+/* keeps the cursor out of the gaps between the mappings of a process;
+ * false if there is no mapping in that direction */
+static bool cur_skip_gap(struct input *input, bool forward)
+{
+    struct ranges const *holes = &input->view->blob->holes;
+    struct range const *h;
+
+    if (!blob_unmapped(input->view->blob, input->cur))
+        return true;
+    h = &holes->r[ranges_find(holes, input->cur)];
+    if (forward && range_end(h) < cur_bound(input))
+        input->cur = range_end(h);
+    else if (!forward && h->pos)
+        input->cur = h->pos - 1;
+    else
+        return false;
+    return true;
+}
+
 static void cur_move_rel(struct input *input, enum cur_move_direction dir, size_t off, size_t step)
 {
     assert(input->cur <= cur_bound(input));
 
     struct view *V = input->view;
+    size_t old = input->cur;
 
     do_reset_soft(input);
     view_dirty_at(V, input->cur);
@@ -228,11 +287,30 @@ static void cur_move_rel(struct input *input, enum cur_move_direction dir, size_
     case MOVE_RIGHT: input->cur = sat_add_step(input->cur, off, step, cur_bound(input)); break;
     default: die("unexpected direction");
     }
+
+    if (!cur_skip_gap(input, dir == MOVE_RIGHT))
+        input->cur = old;
+
     assert(input->cur < cur_bound(input));
     view_dirty_at(V, input->cur);
     view_adjust(V);
 }
 
+static void cur_move_abs(struct input *input, size_t pos)
+{
+    struct view *V = input->view;
+
+    do_reset_soft(input);
+    view_dirty_at(V, input->cur);
+    input->cur = min(pos, cur_bound(input) - 1);
+    if (!cur_skip_gap(input, true))
+        cur_skip_gap(input, false);
+    view_dirty_at(V, input->cur);
+    if (input->mode == SELECT)
+        view_dirty_from(V, 0); /* FIXME suboptimal */
+    view_adjust(V);
+}
+
 static void cur_adjust(struct input *input)
 {
     struct view *V = input->view;
@@ -294,27 +372,45 @@ static void do_yank(struct input *input)
     }
 }
 
-static size_t do_paste(struct input *input)
+static size_t do_paste(struct input *input, size_t count)
 {
     struct view *V = input->view;
     struct blob *B = V->blob;
-    size_t retval;
+    struct clipboard const *clip = B->clipboard;
+    size_t retval, len = blob_length(B) - input->cur;
 
     if (input->mode != INPUT)
         return 0;
+    /* overwriting past the end is cut off */
+    if (clip->data && count <= len / clip->len)
+        len = clip->len * max(count, 1);
+    if (!input->input_mode.insert && !blob_writable(B, input->cur, len)) {
+        view_error(V, "can't paste: not all of it is mapped.");
+        return 0;
+    }
+    /* the pasted bytes are copied once and then into the blob */
+    if (clip->data && input->input_mode.insert) {
+        count = max(count, 1);
+        if (count > SIZE_MAX / 2 / clip->len
+                || buffers_enforce_budget(input->buffers, 2 * clip->len * count)) {
+            view_error(V, "can't paste: exceeds the memory budget.");
+            return 0;
+        }
+    }
     view_adjust(input->view);
     do_reset_soft(input);
-    retval = blob_paste(B, input->cur, input->input_mode.insert ? INSERT : REPLACE);
+    retval = blob_paste(B, input->cur, input->input_mode.insert ? INSERT : REPLACE, count);
     view_recompute(V, false);
     if (input->input_mode.insert)
         view_dirty_from(input->view, input->cur);
     else
-        view_dirty_fromto(input->view, input->cur, input->cur + input->view->blob->clipboard.len);
+        view_dirty_fromto(input->view, input->cur, input->cur + retval);
 
     return retval;
 }
 
-static bool do_delete(struct input *input, bool back)
+/* deletes the selection, or count bytes at (or before) the cursor */
+static bool do_delete(struct input *input, bool back, size_t count)
 {
     struct view *V = input->view;
     struct blob *B = V->blob;
@@ -329,7 +425,8 @@ static bool do_delete(struct input *input, bool back)
     if (back) {
         if (!input->cur)
             return false;
-        cur_move_rel(input, MOVE_LEFT, 1, 1);
+        count = min(count, input->cur);
+        cur_move_rel(input, MOVE_LEFT, count, 1);
         if (!input->input_mode.insert)
             return true;
     }
@@ -338,7 +435,7 @@ static bool do_delete(struct input *input, bool back)
     case INPUT:
         input->mode = SELECT;
         cur_adjust(input);
-        input->sel = input->cur;
+        input->sel = min(input->cur + count, blob_length(B)) - 1;
         /* fall-through */
     case SELECT:
         do_reset_soft(input);
@@ -357,13 +454,636 @@ static bool do_delete(struct input *input, bool back)
     return true;
 }
 
+static void do_switch_buffer(struct input *input, size_t idx)
+{
+    struct view *V = input->view;
+
+    do_reset_hard(input);
+    buffers_switch(input->buffers, input, idx);
+    view_recompute(V, true);
+    cur_adjust(input);
+    view_dirty_from(V, 0);
+    view_adjust(V);
+}
+
 static void do_quit(struct input *input, bool *quit, bool force)
 {
     struct view *V = input->view;
-    if (force || blob_is_saved(V->blob))
+    ssize_t idx;
+
+    if (force || (idx = buffers_unsaved(input->buffers)) < 0)
         *quit = true;
-    else
+    else if ((size_t) idx == input->buffers->cur)
         view_error(V, "unsaved changes! use :q! if you are sure.");
+    else {
+        do_switch_buffer(input, idx);
+        view_error(V, "unsaved changes in this buffer! use :q! if you are sure.");
+    }
+}
+
+/* tells the user about edits replayed from the journal of a crashed session,
+ * or about one that couldn't be replayed */
+void input_recovered(struct input *input)
+{
+    struct blob *blob = input->view->blob;
+    struct journal *j = blob->journal;
+    char buf[128];
+
+    if (blob->journal_note) {
+        view_error(input->view, blob->journal_note);
+        blob->journal_note = NULL;
+        return;
+    }
+    if (!j || !j->recovered)
+        return;
+    snprintf(buf, sizeof(buf), "recovered %zu unsaved edits from the journal.", j->recovered);
+    view_message(input->view, buf, NULL);
+    j->recovered = 0;
+}
+
+static void do_edit(struct input *input, char const *filename)
+{
+    struct view *V = input->view;
+    size_t idx;
+
+    switch (buffers_open(input->buffers, filename, &idx)) {
+    case BUFFERS_OPEN_OK:
+        do_switch_buffer(input, idx);
+        input_recovered(input);
+        break;
+    case BUFFERS_OPEN_UNREADABLE:
+        view_error(V, "can't open: file is not readable.");
+        break;
+    case BUFFERS_OPEN_TYPE:
+        view_error(V, "can't open: unsupported file type.");
+        break;
+    case BUFFERS_OPEN_BUDGET:
+        view_error(V, "can't open: file exceeds the memory budget.");
+        break;
+    default:
+        die("can't open: unknown error");
+    }
+}
+
+static void do_apply(struct input *input, char const *filename)
+{
+    struct view *V = input->view;
+    struct patch patch;
+    enum patch_error err;
+    unsigned line;
+    char buf[256];
+
+    patch_init(&patch);
+
+    if (!(err = patch_load(&patch, filename, &line)))
+        err = patch_apply(&patch, V->blob, true);
+
+    if (err == PATCH_SYNTAX)
+        snprintf(buf, sizeof(buf), "can't apply: %s (%s %u).", patch_strerror(err), patch.ips ? "record" : "line", line);
+    else if (err)
+        snprintf(buf, sizeof(buf), "can't apply: %s.", patch_strerror(err));
+    else
+        snprintf(buf, sizeof(buf), "applied %zu bytes in %zu regions.", patch.bytes, patch.n);
+
+    if (!err && patch.n) {
+        view_recompute(V, false);
+        view_dirty_from(V, 0);
+        cur_move_abs(input, patch.r[0].pos);
+    }
+
+    if (err)
+        view_error(V, buf);
+    else
+        view_message(V, buf, NULL);
+
+    patch_free(&patch);
+}
+
+static void do_write_delta(struct input *input, char const *filename)
+{
+    struct view *V = input->view;
+    enum delta_error err;
+    size_t size;
+    char buf[256];
+
+    if ((err = delta_save(V->blob, filename, &size))) {
+        snprintf(buf, sizeof(buf), "can't write delta: %s.", delta_strerror(err));
+        view_error(V, buf);
+    }
+    else {
+        snprintf(buf, sizeof(buf), "wrote %zu bytes of delta.", size);
+        view_message(V, buf, NULL);
+    }
+}
+
+/* runs a transformation over the selection, or the whole file without one;
+ * a process has to be selected from. returns false if name is not a
+ * transformation. */
+static bool do_transform(struct input *input, char const *name, char *args)
+{
+    struct view *V = input->view;
+    struct xform x;
+    enum xform_error err;
+    size_t pos = 0, len = blob_length(V->blob);
+    char buf[128];
+
+    xform_init(&x);
+    if ((err = xform_parse(&x, name, args)) == XFORM_UNKNOWN)
+        return false;
+
+    if (err) {
+        snprintf(buf, sizeof(buf), "can't %s: %s.", name, xform_strerror(err));
+        view_error(V, buf);
+    }
+    else {
+        if (input->mode == SELECT) {
+            pos = min(input->sel, input->cur);
+            len = absdiff(input->sel, input->cur) + 1;
+        }
+        if (V->blob->alloc == BLOB_PROCESS && input->mode != SELECT) {
+            snprintf(buf, sizeof(buf), "can't %s: select the memory to transform.", name);
+            view_error(V, buf);
+        }
+        else if (!blob_writable(V->blob, pos, len)) {
+            snprintf(buf, sizeof(buf), "can't %s: selection is not all mapped.", name);
+            view_error(V, buf);
+        }
+        else {
+            xform_apply(&x, V->blob, pos, len);
+            view_dirty_from(V, 0);
+            snprintf(buf, sizeof(buf), "transformed %zu bytes.", len);
+            view_message(V, buf, NULL);
+        }
+    }
+
+    xform_free(&x);
+    return true;
+}
+
+bool input_pending(void)
+{
+    struct pollfd pfd = {.fd = fileno(stdin), .events = POLLIN};
+    return pushback != EOF || poll(&pfd, 1, 0) > 0;
+}
+
+/* waits for a key; meanwhile, follow mode shows what is appended to the file,
+ * changes to the file by someone else are pointed out, and background jobs
+ * report their progress and results */
+void input_wait(struct input *input)
+{
+    struct view *V = input->view;
+    struct watch *w = V->blob->watch;
+    struct pollfd pfd[3] = {
+        {.fd = fileno(stdin), .events = POLLIN},
+        {.fd = -1, .events = POLLIN},
+        {.fd = -1, .events = POLLIN},
+    };
+    char buf[128];
+    size_t old;
+    bool busy;
+    int timeout;
+
+    while (true) {
+        jobs_deliver();
+        if (input->strings_ready)
+            return;
+        old = blob_length(V->blob);
+        if (blob_grow(V->blob)) {
+            view_recompute(V, false);
+            view_dirty_from(V, old);
+            /* a cursor at the end stays there, unless in the middle of typing a byte */
+            if (old && input->cur + 1 >= old && !input->low_nibble)
+                cur_move_abs(input, cur_bound(input) - 1);
+            view_update(V);
+        }
+        /* our own save doesn't count as a change */
+        if (w && !V->blob->saving && watch_poll(w, V->blob->filename))
+            view_error(V, "file was changed by someone else; :reload takes in the changes.");
+        if ((busy = jobs_busy(buf, sizeof(buf))))
+            view_message(V, buf, NULL);
+
+        /* stdin is unbuffered, so poll() sees every key not yet read */
+        pfd[1].fd = w ? w->fd : -1;
+        pfd[2].fd = jobs_fd();
+        if (pushback != EOF || (V->blob->follow_fd < 0 && pfd[1].fd < 0 && pfd[2].fd < 0))
+            return;
+
+        timeout = V->blob->follow_fd >= 0 ? CONFIG_FOLLOW_INTERVAL / 1000 : -1;
+        if (busy && (timeout < 0 || timeout > CONFIG_JOB_REFRESH / 1000))
+            timeout = CONFIG_JOB_REFRESH / 1000;
+        if (0 > poll(pfd, 3, timeout)) {
+            if (errno != EINTR)
+                pdie("poll");
+            longjmp(jmp_mainloop, 0); /* window size change */
+        }
+        if (pfd[0].revents)
+            return;
+    }
+}
+
+/* shows how far a long operation got; any key cancels it */
+static bool show_progress(void *arg, size_t done, size_t total)
+{
+    struct input *input = arg;
+    char buf[64];
+
+    if (input_pending()) {
+        getch();
+        return false;
+    }
+    if (done < total) {
+        snprintf(buf, sizeof(buf), "%zu%%, press any key to cancel", done * 100 / total);
+        view_message(input->view, buf, NULL);
+    }
+    return true;
+}
+
+static void show_digest(struct view *V, enum hash_algo algo, byte const *digest, size_t from, size_t to)
+{
+    char buf[256];
+    size_t n;
+
+    n = snprintf(buf, sizeof(buf), "%s ", hash_name(algo));
+    for (size_t i = 0; i < hash_size(algo); ++i)
+        n += snprintf(buf + n, sizeof(buf) - n, "%02x", digest[i]);
+    snprintf(buf + n, sizeof(buf) - n, " (%zu bytes at 0x%zx)", to - from, from);
+    view_message(V, buf, NULL);
+}
+
+struct hash_job {
+    struct view *view;
+    enum hash_algo algo;
+    size_t from, to;
+    byte digest[HASH_MAX_SIZE];
+};
+
+static bool hash_run(struct job *job)
+{
+    struct hash_job *h = job->arg;
+    return hash_blob(job->blob, h->from, h->to, h->algo, h->digest, job_progress, job);
+}
+
+static void hash_finish(struct job *job)
+{
+    struct hash_job *h = job->arg;
+
+    if (job->ok)
+        show_digest(h->view, h->algo, h->digest, h->from, h->to);
+    else
+        view_error(h->view, "hashing cancelled.");
+}
+
+/* hashes the range if given, else the selection or the whole file */
+static void do_hash(struct input *input, char const *name, char const *range)
+{
+    struct view *V = input->view;
+    struct hash_job *h;
+    enum hash_algo algo;
+    byte digest[HASH_MAX_SIZE];
+    size_t from = 0, to = blob_length(V->blob);
+
+    if (!name || !hash_lookup(name, &algo)) {
+        view_error(V, "expected crc32, crc32c, md5, sha1, sha256 or xxh64.");
+        return;
+    }
+    if (range) {
+        if (!parse_range(range, blob_length(V->blob), &from, &to)) {
+            view_error(V, "invalid range.");
+            return;
+        }
+    }
+    else if (input->mode == SELECT) {
+        from = min(input->sel, input->cur);
+        to = max(input->sel, input->cur) + 1;
+    }
+
+    /* in the background, unless the blob can't be read from another thread */
+    if (blob_concurrent(V->blob)) {
+        h = malloc_strict(sizeof(*h));
+        h->view = V;
+        h->algo = algo;
+        h->from = from;
+        h->to = to;
+        jobs_submit(job_new("hashing", V->blob, hash_run, hash_finish, h));
+        return;
+    }
+
+    if (!hash_blob(V->blob, from, to, algo, digest, show_progress, input)) {
+        view_error(V, "cancelled.");
+        return;
+    }
+    show_digest(V, algo, digest, from, to);
+}
+
+/* browses the results of :strings until one is chosen or the list is closed */
+static void do_strings_list(struct input *input)
+{
+    struct view *V = input->view;
+    struct strs_list *L = &input->strings;
+    char buf[0x100], *p;
+    unsigned rows;
+
+    view_visual(V);
+    view_dirty_from(V, 0); /* the list is drawn over everything */
+
+    while (true) {
+        rows = V->rows + V->panel - 1; /* the last line is for the status */
+        if (L->sel < L->top)
+            L->top = L->sel;
+        if (L->sel >= L->top + rows)
+            L->top = L->sel - rows + 1;
+        view_strings(V, L);
+
+        switch (get_key()) {
+        case 'j': case KEY_SPECIAL_DOWN:
+            L->sel += L->sel + 1 < L->n;
+            break;
+        case 'k': case KEY_SPECIAL_UP:
+            L->sel -= !!L->sel;
+            break;
+        case KEY_SPECIAL_PGDOWN:
+            L->sel = L->n ? min(L->sel + rows, L->n - 1) : 0;
+            break;
+        case KEY_SPECIAL_PGUP:
+            L->sel = L->sel > rows ? L->sel - rows : 0;
+            break;
+        case 'g': case KEY_SPECIAL_HOME:
+            L->sel = 0;
+            break;
+        case 'G': case KEY_SPECIAL_END:
+            L->sel = L->n ? L->n - 1 : 0;
+            break;
+        case '/':
+            printf("\x1b[%uH", rows + 1); /* move to last line */
+            view_text(V, false);
+            printf("/");
+            if (!fgets_retry(buf, sizeof(buf), stdin))
+                pdie("fgets");
+            if ((p = strchr(buf, '\n')))
+                *p = 0;
+            strs_list_filter(L, buf);
+            view_visual(V);
+            break;
+        case '\n':
+            if (L->n)
+                cur_move_abs(input, L->found.r[L->idx[L->sel]].pos);
+            return;
+        case 'q': case KEY_SPECIAL_ESCAPE:
+            return;
+        }
+    }
+}
+
+struct strings_job {
+    struct input *input;
+    enum strs_enc enc;
+    size_t minlen, from, to;
+    struct strs found;
+};
+
+static bool strings_run(struct job *job)
+{
+    struct strings_job *S = job->arg;
+    return strs_find(&S->found, job->blob, S->from, S->to, S->enc, S->minlen, job_progress, job);
+}
+
+/* keeps the results; the list opens once the main loop is back at the keyboard */
+static void strings_finish(struct job *job)
+{
+    struct strings_job *S = job->arg;
+    struct view *V = S->input->view;
+    struct strs_list *L = &S->input->strings;
+    char buf[128];
+
+    if (!job->ok) {
+        strs_free(&S->found);
+        view_error(V, "strings cancelled.");
+        return;
+    }
+
+    strs_list_free(L);
+    L->found = S->found;
+    strs_list_filter(L, NULL);
+
+    if (!L->n)
+        snprintf(buf, sizeof(buf), "no strings of %zu or more characters.", S->minlen);
+    else if (L->found.blob != V->blob)
+        snprintf(buf, sizeof(buf), "found %zu strings in another buffer; :strings there shows them.", L->n);
+    else {
+        S->input->strings_ready = true;
+        return;
+    }
+    view_message(V, buf, NULL);
+}
+
+/* strings(1) over the selection or the file; without arguments, reopens the last results */
+static void do_strings(struct input *input, char *args)
+{
+    struct view *V = input->view;
+    struct strs_list *L = &input->strings;
+    struct strings_job *S;
+    enum strs_enc enc = STRS_ASCII;
+    size_t minlen = 4, from = 0, to = blob_length(V->blob);
+    char buf[64], *p, *end;
+
+    if (!args && input->mode == INPUT && L->found.blob == V->blob) {
+        do_strings_list(input);
+        return;
+    }
+
+    for (p = args ? strtok(args, " ") : NULL; p; p = strtok(NULL, " ")) {
+        if (strs_lookup_enc(p, &enc))
+            continue;
+        minlen = strtoull(p, &end, 0);
+        if (*end || !minlen) {
+            view_error(V, "expected a minimum length, ascii, utf16le or utf16be.");
+            return;
+        }
+    }
+    if (input->mode == SELECT) {
+        from = min(input->sel, input->cur);
+        to = max(input->sel, input->cur) + 1;
+    }
+
+    /* in the background, unless the blob can't be read from another thread */
+    if (blob_concurrent(V->blob)) {
+        S = malloc_strict(sizeof(*S));
+        S->input = input;
+        S->enc = enc;
+        S->minlen = minlen;
+        S->from = from;
+        S->to = to;
+        strs_init(&S->found);
+        jobs_submit(job_new("strings", V->blob, strings_run, strings_finish, S));
+        return;
+    }
+
+    strs_list_free(L);
+    if (!strs_find(&L->found, V->blob, from, to, enc, minlen, show_progress, input)) {
+        strs_list_free(L);
+        view_error(V, "cancelled.");
+        return;
+    }
+    strs_list_filter(L, NULL);
+
+    if (!L->n) {
+        snprintf(buf, sizeof(buf), "no strings of %zu or more characters.", minlen);
+        view_message(V, buf, NULL);
+        return;
+    }
+    do_strings_list(input);
+}
+
+/* applies a structure template to the buffer; without a file, removes it */
+static void do_template(struct input *input, char *path)
+{
+    struct view *V = input->view;
+    struct template t;
+    enum tpl_error err;
+    unsigned line;
+    char buf[0x100];
+
+    if (path) {
+        if ((err = tpl_load(&t, path, &line))) {
+            if (line)
+                snprintf(buf, sizeof(buf), "%s:%u: %s", path, line, tpl_strerror(err));
+            else
+                snprintf(buf, sizeof(buf), "%s: %s", path, tpl_strerror(err));
+            view_error(V, buf);
+            return;
+        }
+    }
+
+    layout_free(V->blob->layout);
+    V->blob->layout = path ? layout_new(&t, V->blob) : NULL;
+    view_recompute(V, true);
+    view_dirty_from(V, 0);
+}
+
+/* takes up to steps undo or redo steps and redraws once */
+static size_t do_history(struct input *input, size_t steps, bool redo)
+{
+    struct view *V = input->view;
+    size_t n;
+
+    if (redo)
+        n = blob_redo(V->blob, steps, &input->cur);
+    else
+        n = blob_undo(V->blob, steps, &input->cur);
+
+    if (n) {
+        view_recompute(V, false);
+        cur_adjust(input);
+        view_adjust(V);
+        view_dirty_from(V, 0);
+    }
+    return n;
+}
+
+/* :undo and :redo take a count, "saved" or "all" */
+static void do_history_cmd(struct input *input, char const *arg, bool redo)
+{
+    struct blob const *B = input->view->blob;
+    size_t steps = 1, n;
+    char buf[128], *end;
+
+    if (!arg)
+        ;
+    else if (!strcmp(arg, "all"))
+        steps = SIZE_MAX;
+    else if (!strcmp(arg, "saved")) {
+        if (redo ? B->saved_dist >= 0 : B->saved_dist <= 0) {
+            view_error(input->view, redo ? "saved state is not ahead." : "saved state is not behind.");
+            return;
+        }
+        steps = redo ? -B->saved_dist : B->saved_dist;
+    }
+    else if (!(steps = strtoull(arg, &end, 0)) || *end) {
+        view_error(input->view, "invalid count.");
+        return;
+    }
+
+    n = do_history(input, steps, redo);
+    snprintf(buf, sizeof(buf), "%s %zu step%s%s", redo ? "redid" : "undid",
+            n, n == 1 ? "" : "s", blob_is_saved(B) ? " (saved state)." : ".");
+    view_message(input->view, buf, NULL);
+}
+
+static void do_restore_state(struct input *input, char const *name)
+{
+    struct view *V = input->view;
+
+    if (!snap_restore(V->blob, name)) {
+        view_error(V, "no such state.");
+        return;
+    }
+
+    view_recompute(V, false);
+    cur_adjust(input);
+    view_adjust(V);
+    view_dirty_from(V, 0);
+}
+
+static void do_list_states(struct input *input)
+{
+    struct snapshots const *snaps = &input->view->blob->snaps;
+    char buf[256];
+    size_t n = 0;
+
+    if (!snaps->n) {
+        view_message(input->view, "no marked states.", NULL);
+        return;
+    }
+
+    for (size_t i = 0; i < snaps->n && n < sizeof(buf); ++i)
+        n += snprintf(buf + n, sizeof(buf) - n, "%s ", snaps->layers[i].name);
+    if (n < sizeof(buf))
+        snprintf(buf + n, sizeof(buf) - n, "(%zu bytes in %zu extents)",
+                snaps->mem, snap_extents(snaps));
+    view_message(input->view, buf, NULL);
+}
+
+static void do_list_buffers(struct input *input)
+{
+    struct buffers const *bufs = input->buffers;
+    char buf[256];
+    size_t n = 0;
+
+    for (size_t i = 0; i < bufs->n && n < sizeof(buf); ++i) {
+        struct blob const *B = &bufs->list[i]->blob;
+        n += snprintf(buf + n, sizeof(buf) - n, "%s%zu%s\"%s\"%s",
+                i ? "  " : "",
+                i + 1,
+                i == bufs->cur ? "%" : " ",
+                B->filename ? B->filename : "[no name]",
+                blob_is_saved(B) ? "" : " [+]");
+    }
+    view_message(input->view, buf, NULL);
+}
+
+/* parses a positive size with an optional k/M/G suffix */
+static bool parse_size(char const *s, size_t *size)
+{
+    char *end;
+    unsigned long long n;
+    unsigned shift = 0;
+
+    if (!isdigit(*s))
+        return false;
+    errno = 0;
+    n = strtoull(s, &end, 0);
+    if (errno)
+        return false;
+
+    switch (*end) {
+    case 'k': case 'K': shift = 10; ++end; break;
+    case 'm': case 'M': shift = 20; ++end; break;
+    case 'g': case 'G': shift = 30; ++end; break;
+    }
+    if (*end || !n || n > SIZE_MAX >> shift)
+        return false;
+    *size = n << shift;
+    return true;
 }
 
 static void do_search_cont(struct input *input, ssize_t dir)
@@ -386,6 +1106,13 @@ static void do_search_cont(struct input *input, ssize_t dir)
     view_adjust(V);
 }
 
+/* lets '.' repeat an edit */
+static void remember(struct input *input, key k, size_t count)
+{
+    input->last.k = k;
+    input->last.count = count;
+}
+
 static void do_inc_dec(struct input *input, byte diff)
 {
     struct view *V = input->view;
@@ -413,18 +1140,279 @@ void do_home_end(struct input *input, size_t soft, size_t hard)
     do_reset_soft(input);
     view_dirty_at(V, input->cur);
     input->cur = input->cur == soft ? hard : soft;
+    if (!cur_skip_gap(input, true))
+        cur_skip_gap(input, false);
     view_dirty_at(V, input->cur);
     if (input->mode == SELECT)
         view_dirty_from(V, 0); /* FIXME suboptimal */
     view_adjust(V);
 }
 
+static void do_next_extent(struct input *input, ssize_t dir)
+{
+    struct view *V = input->view;
+    struct blob *B = V->blob;
+
+    if (!B->holes.n) {
+        view_error(V, "no holes in file.");
+        return;
+    }
+
+    cur_move_abs(input, blob_next_extent(B, input->cur, dir));
+}
+
+/* tells the user why a save failed */
+static void save_error(struct view *V, enum blob_save_error err)
+{
+    switch (err) {
+    case BLOB_SAVE_OK:
+        break;
+    case BLOB_SAVE_FILENAME:
+        view_error(V, "can't save: no filename.");
+        break;
+    case BLOB_SAVE_NONEXISTENT:
+        view_error(V, "can't save: nonexistent path.");
+        break;
+    case BLOB_SAVE_PERMISSIONS:
+        view_error(V, "can't save: insufficient permissions.");
+        break;
+    case BLOB_SAVE_BUSY:
+        view_error(V, "can't save: file is busy.");
+        break;
+    case BLOB_SAVE_PROCESS:
+        view_error(V, "can't save: process memory is only written back to the process.");
+        break;
+    case BLOB_SAVE_FAULT:
+        view_error(V, "can't save: the process refused some of the changes.");
+        break;
+    case BLOB_SAVE_CHANGED:
+        view_error(V, "can't save: file was changed by someone else; :reload or :w! to overwrite.");
+        break;
+    case BLOB_SAVE_PENDING:
+        view_error(V, "can't save: still saving.");
+        break;
+    case BLOB_SAVE_WRITE:
+        view_error(V, "can't save: write failed; the file may be incomplete.");
+        break;
+    default:
+        die("can't save: unknown error");
+    }
+}
+
+struct save_job {
+    struct view *view;
+    struct blob_image *img;
+    bool ran;
+};
+
+static bool save_run(struct job *job)
+{
+    struct save_job *S = job->arg;
+    S->ran = true;
+    blob_save_write(S->img, job_progress, job);
+    return true;
+}
+
+static void save_finish(struct job *job)
+{
+    struct save_job *S = job->arg;
+    enum blob_save_error err;
+
+    /* a save can't be cancelled: finish it here if it never got to run */
+    if (!S->ran)
+        blob_save_write(S->img, NULL, NULL);
+    if ((err = blob_save_end(S->img)))
+        save_error(S->view, err);
+    else
+        view_message(S->view, "saved.", NULL);
+}
+
+/* saves in the background, so that editing can go on meanwhile */
+static void do_save(struct input *input, bool force, bool and_quit, char const *filename, bool *quit)
+{
+    struct blob *B = input->view->blob;
+    struct save_job *S;
+    enum blob_save_error err;
+
+    /* overwrite the file even if someone else changed it */
+    if (force && B->watch)
+        watch_resync(B->watch, B->filename);
+
+    if (and_quit || !blob_concurrent(B))
+        err = blob_save(B, filename);
+    else if (!(err = blob_save_begin(B, filename))) {
+        S = malloc_strict(sizeof(*S));
+        S->view = input->view;
+        S->img = B->saving;
+        S->ran = false;
+        jobs_submit(job_new("saving", NULL, save_run, save_finish, S));
+    }
+
+    if (err)
+        save_error(input->view, err);
+    else if (and_quit)
+        do_quit(input, quit, false);
+}
+
+/* takes in what someone else changed in the file, around our own changes */
+static void do_reload(struct input *input)
+{
+    struct view *V = input->view;
+    size_t old = blob_length(V->blob), changed, kept;
+    char buf[128];
+
+    switch (blob_reload(V->blob, &changed, &kept)) {
+    case BLOB_RELOAD_OK:
+        break;
+    case BLOB_RELOAD_UNWATCHED:
+        view_error(V, "can't reload: not a file.");
+        return;
+    case BLOB_RELOAD_MOVED:
+        view_error(V, "can't reload: bytes were inserted or deleted; save or undo them first.");
+        return;
+    case BLOB_RELOAD_UNREADABLE:
+        view_error(V, "can't reload: file is unreadable.");
+        return;
+    case BLOB_RELOAD_SHRUNK:
+        view_error(V, "can't reload: file has shrunk.");
+        return;
+    default:
+        die("can't reload: unknown error");
+    }
+
+    if (blob_length(V->blob) != old) {
+        view_recompute(V, false);
+        if (input->cur >= cur_bound(input))
+            cur_move_abs(input, cur_bound(input) - 1);
+    }
+    view_dirty_from(V, 0);
+    view_update(V);
+
+    if (kept)
+        snprintf(buf, sizeof(buf), "reloaded %zu blocks; kept own changes in %zu blocks that also changed on disk.", changed, kept);
+    else if (changed)
+        snprintf(buf, sizeof(buf), "reloaded %zu blocks.", changed);
+    else
+        snprintf(buf, sizeof(buf), "file is unchanged.");
+    view_message(V, buf, NULL);
+}
+
+/* where the cursor is in the address space of a process */
+static void do_mapping(struct input *input)
+{
+    struct view *V = input->view;
+    struct procmem const *pm = V->blob->proc;
+    struct procmem_region const *r;
+    char buf[256];
+    size_t i;
+
+    if (V->blob->alloc != BLOB_PROCESS) {
+        view_error(V, "not a process.");
+        return;
+    }
+
+    i = procmem_region(pm, input->cur);
+    if (i == pm->n || (r = &pm->regions[i])->pos > input->cur) {
+        view_message(V, "not mapped.", NULL);
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%zx-%zx %s %s (mapping %zu of %zu)",
+            r->pos, r->pos + r->len, r->perms, *r->name ? r->name : "[anonymous]", i + 1, pm->n);
+    view_message(V, buf, NULL);
+}
+
+static void do_skip_fill(struct input *input, ssize_t dir)
+{
+    struct view *V = input->view;
+    struct blob *B = V->blob;
+    ssize_t pos;
+
+    if (input->cur >= blob_length(B))
+        return;
+
+    if (0 > (pos = blob_skip_fill(B, input->cur, blob_at(B, input->cur), dir))) {
+        view_error(V, dir > 0 ? "fill run extends to end of file." : "fill run extends to start of file.");
+        return;
+    }
+    cur_move_abs(input, pos);
+}
+
+static void do_find_run(struct input *input, size_t minlen, ssize_t dir)
+{
+    struct view *V = input->view;
+    struct blob *B = V->blob;
+    ssize_t pos;
+
+    if (input->cur >= blob_length(B) || !minlen)
+        return;
+
+    if (0 > (pos = blob_find_run(B, input->cur, minlen, dir))) {
+        view_error(V, "no such run.");
+        return;
+    }
+    cur_move_abs(input, pos);
+}
+
+static void do_resync(struct input *input, size_t pos, bool quiet)
+{
+    struct view *V = input->view;
+
+    if (!blob_resync(V->blob, V->cmp, &V->cmp_delta, pos)) {
+        if (!quiet)
+            view_error(V, "can't re-align: no match nearby.");
+        return;
+    }
+    view_dirty_from(V, 0);
+}
+
+/* moves to the start of the next/previous run of differing bytes */
+static void do_next_diff(struct input *input, ssize_t dir)
+{
+    struct view *V = input->view;
+    struct blob *A = V->blob, *B = V->cmp;
+    ssize_t p = input->cur, q;
+
+    if (!B) {
+        view_error(V, "not comparing files.");
+        return;
+    }
+
+    if (dir > 0) {
+        if (0 <= (p = blob_compare(A, B, V->cmp_delta, p, +1, false)))
+            p = blob_compare(A, B, V->cmp_delta, p, +1, true);
+        if (p >= 0 && V->cmp_resync) {
+            /* only re-align if the blobs don't agree again right after the difference */
+            ssize_t next = -1;
+            if (0 <= (q = blob_compare(A, B, V->cmp_delta, p, +1, false)))
+                next = blob_compare(A, B, V->cmp_delta, q, +1, true);
+            if (q < 0 || (next >= 0 && next < q + CONFIG_RESYNC_WINDOW))
+                do_resync(input, p, true);
+        }
+    }
+    else {
+        if (p && 0 <= (p = blob_compare(A, B, V->cmp_delta, p - 1, -1, false)))
+            p = blob_compare(A, B, V->cmp_delta, p, -1, true);
+        if (p >= 0)
+            p = blob_compare(A, B, V->cmp_delta, p, -1, false) + 1;
+    }
+
+    if (p < 0) {
+        view_error(V, "no more differences.");
+        return;
+    }
+    if ((size_t) p >= cur_bound(input))
+        view_error(V, "files differ in length.");
+    cur_move_abs(input, p);
+}
+
 void do_pgup_pgdown(struct input *input, size_t (*f)(size_t, size_t, size_t, size_t))
 {
     struct view *V = input->view;
 
     do_reset_soft(input);
     input->cur = f(input->cur, V->rows, V->cols, cur_bound(input));
+    if (!cur_skip_gap(input, f != sat_sub_step))
+        cur_skip_gap(input, f == sat_sub_step);
     V->start = f(V->start, V->rows, V->cols, cur_bound(input));
     view_dirty_from(V, 0);
     view_adjust(V);
@@ -441,9 +1429,33 @@ void input_get(struct input *input, bool *quit)
 
     struct view *V = input->view;
     struct blob *B = V->blob;
+    size_t count;
+    bool counted;
+
+    /* results of :strings from the background */
+    if (input->strings_ready) {
+        input->strings_ready = false;
+        if (input->strings.found.blob == V->blob)
+            do_strings_list(input);
+        return;
+    }
 
     k = get_key();
 
+    /* counts are typed after '#' since digits are data */
+    if (input->counting && k >= '0' && k <= '9') {
+        char buf[32];
+        if (input->count < CONFIG_MAX_COUNT)
+            input->count = input->count * 10 + (k - '0');
+        snprintf(buf, sizeof(buf), "#%zu", input->count);
+        view_message(V, buf, NULL);
+        return;
+    }
+    counted = input->counting && input->count;
+    count = counted ? input->count : 1;
+    input->counting = false;
+    input->count = 0;
+
     if (input->mode == INPUT) {
 
         if (input->input_mode.ascii && isprint(k)) {
@@ -513,19 +1525,44 @@ void input_get(struct input *input, bool *quit)
 
     /* function keys */
 
+repeat:
     switch (k) {
 
+    case '#':
+        input->counting = true;
+        view_message(V, "#", NULL);
+        break;
+
+    case '.':
+        if (!input->last.k)
+            break;
+        k = input->last.k;
+        if (!counted)
+            count = input->last.count;
+        goto repeat;
+
     case KEY_SPECIAL_ESCAPE:
         do_reset_hard(input);
         break;
 
+    case KEY_MOUSE:
+        /* a press on the overview column jumps there */
+        {
+            size_t pos;
+            if ((mouse.button & 3) == 0 && view_overview_pos(V, mouse.row, mouse.col, &pos))
+                cur_move_abs(input, pos);
+        }
+        break;
+
     case 0x7f: /* backspace */
-        do_delete(input, true);
+        do_delete(input, true, count);
+        remember(input, k, count);
         break;
 
     case 'x':
     case KEY_SPECIAL_DELETE:
-        do_delete(input, false);
+        do_delete(input, false, count);
+        remember(input, k, count);
         break;
 
     case 'q':
@@ -546,16 +1583,18 @@ void input_get(struct input *input, bool *quit)
             input->sel = input->cur;
             input->cur = tmp;
         }
-        if (do_delete(input, false) && !input->input_mode.insert)
+        if (do_delete(input, false, 1) && !input->input_mode.insert)
             toggle_mode_insert(input);
         break;
 
     case 'p':
-        do_paste(input);
+        do_paste(input, count);
+        remember(input, k, count);
         break;
 
     case 'P':
-        cur_move_rel(input, MOVE_RIGHT, do_paste(input), 1);
+        cur_move_rel(input, MOVE_RIGHT, do_paste(input, count), 1);
+        remember(input, k, count);
         break;
 
     case 'i':
@@ -568,31 +1607,25 @@ void input_get(struct input *input, bool *quit)
 
     case 'u':
         if (input->mode != INPUT) break;
-        if (!blob_undo(B, &input->cur))
-            break;
-        view_recompute(V, false);
-        cur_adjust(input);
-        view_adjust(V);
-        view_dirty_from(V, 0); /* FIXME suboptimal */
+        do_history(input, count, false);
         break;
 
     case 0x12: /* ctrl + R */
         if (input->mode != INPUT) break;
-        if (!blob_redo(B, &input->cur))
-            break;
-        view_recompute(V, false);
-        cur_adjust(input);
-        view_adjust(V);
-        view_dirty_from(V, 0); /* FIXME suboptimal */
+        do_history(input, count, true);
         break;
 
     case 0x7: /* ctrl + G */
         {
-             char buf[256];
-             snprintf(buf, sizeof(buf), "\"%s\" %s%s %zd/%zd bytes --%zd%%--",
+             char buf[256], mod[32] = "";
+             if (input->view->blob->alloc != BLOB_MALLOC && blob_modified(input->view->blob)->n)
+                 snprintf(mod, sizeof(mod), "[%zu ranges]", blob_modified(input->view->blob)->n);
+             snprintf(buf, sizeof(buf), "\"%s\" %s%s%s %zd/%zd bytes --%zd%%--",
                  input->view->blob->filename,
-                 input->view->blob->alloc == BLOB_MMAP ? "[mmap]" : "",
+                 input->view->blob->alloc == BLOB_MMAP ? "[mmap]"
+                 : input->view->blob->alloc == BLOB_PROCESS ? "[process]" : "",
                  input->view->blob->saved_dist ? "[modified]" : "[saved]",
+                 mod,
                  input->cur,
                  blob_length(input->view->blob),
                  ((input->cur+1) * 100) / blob_length(input->view->blob));
@@ -601,6 +1634,9 @@ void input_get(struct input *input, bool *quit)
         break;
 
     case 0xc: /* ctrl + L */
+        /* process memory may have changed under us */
+        if (V->blob->alloc == BLOB_PROCESS)
+            blob_release(V->blob);
         view_dirty_from(V, 0);
         break;
 
@@ -631,31 +1667,33 @@ void input_get(struct input *input, bool *quit)
         break;
 
     case 0x1: /* ctrl + A */
-        do_inc_dec(input, 1);
+        do_inc_dec(input, count);
+        remember(input, k, count);
         break;
 
     case 0x18: /* ctrl + X */
-        do_inc_dec(input, -1);
+        do_inc_dec(input, -count);
+        remember(input, k, count);
         break;
 
     case 'j':
     case KEY_SPECIAL_DOWN:
-        cur_move_rel(input, MOVE_RIGHT, 1, V->cols);
+        cur_move_rel(input, MOVE_RIGHT, count, V->cols);
         break;
 
     case 'k':
     case KEY_SPECIAL_UP:
-        cur_move_rel(input, MOVE_LEFT, 1, V->cols);
+        cur_move_rel(input, MOVE_LEFT, count, V->cols);
         break;
 
     case 'l':
     case KEY_SPECIAL_RIGHT:
-        cur_move_rel(input, MOVE_RIGHT, 1, 1);
+        cur_move_rel(input, MOVE_RIGHT, count, 1);
         break;
 
     case 'h':
     case KEY_SPECIAL_LEFT:
-        cur_move_rel(input, MOVE_LEFT, 1, 1);
+        cur_move_rel(input, MOVE_LEFT, count, 1);
         break;
 
     case '^':
@@ -694,6 +1732,30 @@ void input_get(struct input *input, bool *quit)
         view_set_cols(V, true, +1);
         break;
 
+    case '}':
+        do_next_extent(input, +1);
+        break;
+
+    case '{':
+        do_next_extent(input, -1);
+        break;
+
+    case '>':
+        do_next_diff(input, +1);
+        break;
+
+    case '<':
+        do_next_diff(input, -1);
+        break;
+
+    case ')':
+        do_skip_fill(input, +1);
+        break;
+
+    case '(':
+        do_skip_fill(input, -1);
+        break;
+
     }
 }
 
@@ -710,35 +1772,115 @@ void input_cmd(struct input *input, bool *quit)
 
     if (!(p = strtok(buf, " ")))
         return;
-    else if (!strcmp(p, "w") || !strcmp(p, "wq")) {
-        switch (blob_save(input->view->blob, strtok(NULL, " "))) {
-        case BLOB_SAVE_OK:
-            if (!strcmp(p, "wq"))
-                do_quit(input, quit, false);
-            break;
-        case BLOB_SAVE_FILENAME:
-            view_error(input->view, "can't save: no filename.");
-            break;
-        case BLOB_SAVE_NONEXISTENT:
-            view_error(input->view, "can't save: nonexistent path.");
-            break;
-        case BLOB_SAVE_PERMISSIONS:
-            view_error(input->view, "can't save: insufficient permissions.");
-            break;
-        case BLOB_SAVE_BUSY:
-            view_error(input->view, "can't save: file is busy.");
-            break;
-        default:
-            die("can't save: unknown error");
-        }
+    else if (!strcmp(p, "w") || !strcmp(p, "wq") || !strcmp(p, "w!") || !strcmp(p, "wq!")) {
+        do_save(input, p[strlen(p) - 1] == '!', p[1] == 'q', strtok(NULL, " "), quit);
     }
     else if (!strcmp(p, "q") || !strcmp(p, "q!")) {
         do_quit(input, quit, !strcmp(p, "q!"));
     }
+    else if (!strcmp(p, "e")) {
+        if ((p = strtok(NULL, "")))
+            do_edit(input, p);
+        else
+            view_error(input->view, "no filename given.");
+    }
+    else if (!strcmp(p, "wdelta")) {
+        if ((p = strtok(NULL, "")))
+            do_write_delta(input, p);
+        else
+            view_error(input->view, "no filename given.");
+    }
+    else if (!strcmp(p, "apply")) {
+        if ((p = strtok(NULL, "")))
+            do_apply(input, p);
+        else
+            view_error(input->view, "no filename given.");
+    }
+    else if (!strcmp(p, "undo") || !strcmp(p, "redo")) {
+        do_history_cmd(input, strtok(NULL, " "), p[0] == 'r');
+    }
+    else if (!strcmp(p, "hash")) {
+        p = strtok(NULL, " ");
+        do_hash(input, p, p ? strtok(NULL, " ") : NULL);
+    }
+    else if (!strcmp(p, "strings")) {
+        do_strings(input, strtok(NULL, ""));
+    }
+    else if (!strcmp(p, "template")) {
+        do_template(input, strtok(NULL, ""));
+    }
+    else if (!strcmp(p, "mark-state")) {
+        if ((p = strtok(NULL, " ")))
+            snap_mark(input->view->blob, p);
+        else
+            view_error(input->view, "no name given.");
+    }
+    else if (!strcmp(p, "restore")) {
+        if ((p = strtok(NULL, " ")))
+            do_restore_state(input, p);
+        else
+            view_error(input->view, "no name given.");
+    }
+    else if (!strcmp(p, "drop-state")) {
+        if ((p = strtok(NULL, " ")) && !snap_drop(input->view->blob, p))
+            view_error(input->view, "no such state.");
+        else if (!p)
+            view_error(input->view, "no name given.");
+    }
+    else if (!strcmp(p, "mapping")) {
+        do_mapping(input);
+    }
+    else if (!strcmp(p, "states")) {
+        do_list_states(input);
+    }
+    else if (!strcmp(p, "bn") || !strcmp(p, "bp")) {
+        size_t n = input->buffers->n;
+        do_switch_buffer(input, (input->buffers->cur + (p[1] == 'n' ? 1 : n - 1)) % n);
+    }
+    else if (!strcmp(p, "ls")) {
+        do_list_buffers(input);
+    }
+    else if (!strcmp(p, "budget")) {
+        char buf[128];
+        size_t size;
+        if ((p = strtok(NULL, " "))) {
+            if (parse_size(p, &size))
+                input->buffers->budget = size;
+            else
+                view_error(input->view, "invalid size.");
+        }
+        else {
+            snprintf(buf, sizeof(buf), "using %zu of %zu bytes",
+                    buffers_memory(input->buffers), input->buffers->budget);
+            view_message(input->view, buf, NULL);
+        }
+    }
     else if (!strcmp(p, "color")) {
         if ((p = strtok(NULL, " ")))
             input->view->color = *p == '1' || *p == 'y';
     }
+    else if (!strcmp(p, "overview")) {
+        p = strtok(NULL, " ");
+        if (input->view->blob->alloc == BLOB_PROCESS)
+            view_error(input->view, "no overview of process memory.");
+        else
+            view_set_overview(input->view, p ? *p == '1' || *p == 'y' : !input->view->overview);
+    }
+    else if (!strcmp(p, "cancel")) {
+        jobs_cancel();
+    }
+    else if (!strcmp(p, "reload")) {
+        do_reload(input);
+    }
+    else if (!strcmp(p, "follow")) {
+        p = strtok(NULL, " ");
+        if (!blob_follow(input->view->blob, p ? *p == '1' || *p == 'y' : input->view->blob->follow_fd < 0))
+            view_error(input->view, "can't follow this file.");
+    }
+    else if (!strcmp(p, "inspect")) {
+        p = strtok(NULL, " ");
+        view_set_inspect(input->view, p ? *p == '1' || *p == 'y' : !input->view->inspect);
+    }
     else if (!strcmp(p, "columns")) {
         if ((p = strtok(NULL, " "))) {
             if (!strcmp(p, "auto")) {
@@ -751,6 +1893,37 @@ void input_cmd(struct input *input, bool *quit)
             }
         }
     }
+    else if (!strcmp(p, "delta")) {
+        long long m;
+        if (!input->view->cmp)
+            view_error(input->view, "not comparing files.");
+        else if ((p = strtok(NULL, " "))) {
+            m = strtoll(p, &p, 0);
+            if (!*p) {
+                input->view->cmp_delta = m;
+                view_dirty_from(input->view, 0);
+            }
+        }
+    }
+    else if (!strcmp(p, "resync")) {
+        if (!input->view->cmp)
+            view_error(input->view, "not comparing files.");
+        else if ((p = strtok(NULL, " ")))
+            input->view->cmp_resync = *p == '1' || *p == 'y';
+        else
+            do_resync(input, input->cur, false);
+    }
+    else if (!strcmp(p, "run")) {
+        long long m;
+        if ((p = strtok(NULL, " "))) {
+            m = strtoll(p, &p, 0);
+            if (!*p)
+                do_find_run(input, m < 0 ? (size_t) 0 - (size_t) m : (size_t) m, m < 0 ? -1 : +1);
+        }
+    }
+    else if (do_transform(input, p, strtok(NULL, ""))) {
+        /* done */
+    }
     else {
         /* try to interpret the input as an offset */
         n = strtoull(p, &p, 0);
@@ -764,36 +1937,6 @@ void input_cmd(struct input *input, bool *quit)
     }
 }
 
-static unsigned unhex_digit(char c)
-{
-    assert(isxdigit(c));
-    if (c >= '0' && c <= '9')
-        return c - '0';
-    else if (c >= 'a' && c <= 'f')
-        return c - 'a' + 10;
-    else if (c >= 'A' && c <= 'F')
-        return c - 'A' + 10;
-    die("not a hex digit");
-}
-
-static size_t unhex(byte **ret, char const *hex)
-{
-    size_t len = 0;
-    *ret = malloc_strict(strlen(hex) / 2);
-    for (char const *p = hex; *p; ) {
-        while (isspace(*p)) ++p;
-        if (!(isxdigit(p[0]) && isxdigit(p[1]))) {
-            free(*ret);
-            *ret = NULL;
-            return 0;
-        }
-        (*ret)[len] = unhex_digit(*p++) << 4;
-        (*ret)[len++] |= unhex_digit(*p++);
-    }
-    *ret = realloc_strict(*ret, len); /* shrink to what we actually used */
-    return len;
-}
-
 /* NB: this accepts some technically invalid inputs */
 static size_t utf8_to_ucs2(byte **ret, char const *str)
 {
@@ -2,9 +2,13 @@
 #define INPUT_H
 
 #include "view.h"
+#include "strs.h"
+
+struct buffers;
 
 struct input {
     struct view *view;
+    struct buffers *buffers;
 
     enum mode {
         INPUT,
@@ -24,6 +28,16 @@ struct input {
         byte *needle;
     } search;
 
+    bool counting; /* reading a count after '#' */
+    size_t count;
+    struct {
+        uint16_t k; /* key of the last repeatable edit, 0 if none */
+        size_t count;
+    } last;
+
+    struct strs_list strings; /* results of :strings */
+    bool strings_ready; /* new results are to be shown */
+
     bool quit;
 };
 
@@ -31,5 +45,8 @@ void input_init(struct input *input, struct view *view);
 void input_free(struct input *input);
 
 void input_get(struct input *input, bool *quit);
+bool input_pending(void);
+void input_wait(struct input *input);
+void input_recovered(struct input *input);
 
 #endif
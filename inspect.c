@@ -0,0 +1,138 @@
+
+#include "common.h"
+#include "inspect.h"
+
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <time.h>
+
+static uint64_t load(byte const *p, unsigned width, bool big_endian)
+{
+    uint64_t v = 0;
+    for (unsigned k = 0; k < width; ++k)
+        v |= (uint64_t) p[big_endian ? width - 1 - k : k] << 8 * k;
+    return v;
+}
+
+static void add(char *line, char const *fmt, ...)
+{
+    size_t len = strlen(line);
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line + len, INSPECT_WIDTH - len, fmt, ap);
+    va_end(ap);
+}
+
+/* the code point starting at data, or -1 if the encoding is broken */
+static long utf8_decode(byte const *data, size_t n)
+{
+    unsigned len = data[0] < 0x80 ? 1 : data[0] < 0xc2 ? 0 : data[0] < 0xe0 ? 2 : data[0] < 0xf0 ? 3 : data[0] < 0xf5 ? 4 : 0;
+    long c = data[0] & (len == 1 ? 0x7f : 0x7f >> len);
+
+    if (!len || len > n)
+        return -1;
+    for (unsigned i = 1; i < len; ++i) {
+        if ((data[i] & 0xc0) != 0x80)
+            return -1;
+        c = c << 6 | (data[i] & 0x3f);
+    }
+    /* overlong forms, surrogates and values beyond unicode */
+    if ((len == 3 && c < 0x800) || (len == 4 && c < 0x10000) || (c >= 0xd800 && c < 0xe000) || c > 0x10ffff)
+        return -1;
+    return c;
+}
+
+static long utf16_decode(byte const *data, size_t n, bool big_endian)
+{
+    long hi, lo;
+
+    if (n < 2)
+        return -1;
+    hi = load(data, 2, big_endian);
+    if (hi < 0xd800 || hi >= 0xe000)
+        return hi;
+    if (hi >= 0xdc00 || n < 4 || (lo = load(data + 2, 2, big_endian)) < 0xdc00 || lo >= 0xe000)
+        return -1;
+    return 0x10000 + ((hi - 0xd800) << 10) + (lo - 0xdc00);
+}
+
+static void add_char(char *line, char const *label, long c, bool have)
+{
+    if (!have)
+        add(line, "%s -", label);
+    else if (c < 0)
+        add(line, "%s invalid", label);
+    else
+        add(line, "%s U+%04lX", label, c);
+}
+
+static void add_time(char *line, char const *label, int64_t t, bool have)
+{
+    char buf[32];
+    struct tm tm;
+    time_t tt = t;
+
+    if (!have)
+        add(line, "%s -", label);
+    else if (tt != t || !gmtime_r(&tt, &tm) || !strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm))
+        add(line, "%s out of range", label);
+    else
+        add(line, "%s %s", label, buf);
+}
+
+/* unsigned, signed and floating point values of one byte order */
+static void add_ints(char lines[2][INSPECT_WIDTH], byte const *data, size_t n, bool big_endian)
+{
+    uint64_t v;
+    uint32_t u;
+    float f;
+    double d;
+
+    add(lines[0], "%s", big_endian ? "be " : "le ");
+    if (n >= 2) {
+        v = load(data, 2, big_endian);
+        add(lines[0], " u16 %" PRIu16 "  s16 %" PRId16, (uint16_t) v, (int16_t) v);
+    }
+    if (n >= 4) {
+        v = load(data, 4, big_endian);
+        u = v;
+        memcpy(&f, &u, sizeof(f));
+        add(lines[0], "  u32 %" PRIu32 "  s32 %" PRId32 "  f32 %.9g", (uint32_t) v, (int32_t) v, f);
+    }
+    add(lines[1], "   ");
+    if (n >= 8) {
+        v = load(data, 8, big_endian);
+        memcpy(&d, &v, sizeof(d));
+        add(lines[1], " u64 %" PRIu64 "  s64 %" PRId64 "  f64 %.17g", v, (int64_t) v, d);
+    }
+}
+
+void inspect_format(byte const *data, size_t n, char lines[INSPECT_ROWS][INSPECT_WIDTH])
+{
+    char bin[9] = {0};
+
+    for (unsigned l = 0; l < INSPECT_ROWS; ++l)
+        *lines[l] = 0;
+    if (!n) {
+        add(lines[0], "end of file");
+        return;
+    }
+
+    for (unsigned k = 0; k < 8; ++k)
+        bin[k] = data[0] >> (7 - k) & 1 ? '1' : '0';
+    add(lines[0], "u8 %u  s8 %d  bin %s  ", data[0], (int8_t) data[0], bin);
+    add_char(lines[0], "utf8", utf8_decode(data, n), true);
+    add_char(lines[0], "  utf16 le", utf16_decode(data, n, false), n >= 2);
+    add_char(lines[0], " be", utf16_decode(data, n, true), n >= 2);
+
+    add_ints(lines + 1, data, n, false);
+    add_ints(lines + 3, data, n, true);
+
+    add_time(lines[5], "time32 le", n >= 4 ? (int32_t) load(data, 4, false) : 0, n >= 4);
+    add_time(lines[5], "  be", n >= 4 ? (int32_t) load(data, 4, true) : 0, n >= 4);
+    add_time(lines[6], "time64 le", n >= 8 ? (int64_t) load(data, 8, false) : 0, n >= 8);
+    add_time(lines[6], "  be", n >= 8 ? (int64_t) load(data, 8, true) : 0, n >= 8);
+}
+
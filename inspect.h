@@ -0,0 +1,15 @@
+#ifndef INSPECT_H
+#define INSPECT_H
+
+#include "common.h"
+
+/* decodings of the bytes at the cursor */
+
+#define INSPECT_BYTES 8   /* bytes looked at */
+#define INSPECT_ROWS 7    /* lines of output */
+#define INSPECT_WIDTH 160 /* bytes per line, including the terminator */
+
+/* n < INSPECT_BYTES means the data ends early; wider values are shown as "-" */
+void inspect_format(byte const *data, size_t n, char lines[INSPECT_ROWS][INSPECT_WIDTH]);
+
+#endif
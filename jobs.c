@@ -0,0 +1,289 @@
+
+#include "common.h"
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+
+/*
+ * Jobs only read their blob.  Whatever changes a blob first calls
+ * jobs_quiesce(), which cancels the jobs reading it and waits for them to
+ * stop, so a job either sees one consistent state of the blob throughout
+ * or is reported as cancelled.  Jobs check for cancellation whenever they
+ * report progress.  Finished jobs are queued for the main loop, which is
+ * woken through a pipe.
+ */
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake; /* a job was queued, or the pool is shutting down */
+    pthread_cond_t stopped; /* a job is no longer running */
+    pthread_t threads[CONFIG_JOB_WORKERS];
+    size_t nthreads;
+    struct job *queued, *running, *finished;
+    int pipe[2];
+    bool quit;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .stopped = PTHREAD_COND_INITIALIZER,
+    .pipe = {-1, -1},
+};
+
+static void lock(void)
+{
+    if (pthread_mutex_lock(&pool.lock))
+        die("pthread_mutex_lock");
+}
+
+static void unlock(void)
+{
+    if (pthread_mutex_unlock(&pool.lock))
+        die("pthread_mutex_unlock");
+}
+
+/* with the lock held */
+static void job_finished(struct job *job, bool ok)
+{
+    job->ok = ok && !job->cancelled;
+    job->next = pool.finished;
+    pool.finished = job;
+    /* if the pipe is full, the main loop will be woken anyway */
+    if (0 > write(pool.pipe[1], "", 1) && errno != EAGAIN)
+        pdie("write");
+}
+
+static void *worker(void *unused)
+{
+    struct job *job;
+    bool ok;
+
+    (void) unused;
+    lock();
+    while (true) {
+        while (!pool.queued && !pool.quit)
+            if (pthread_cond_wait(&pool.wake, &pool.lock))
+                die("pthread_cond_wait");
+        if (pool.quit)
+            break;
+
+        job = pool.queued;
+        pool.queued = job->next;
+        job->next = pool.running;
+        pool.running = job;
+
+        unlock();
+        ok = job->run(job);
+        lock();
+
+        for (struct job **p = &pool.running; *p; p = &(*p)->next)
+            if (*p == job) {
+                *p = job->next;
+                break;
+            }
+        job_finished(job, ok);
+        if (pthread_cond_broadcast(&pool.stopped))
+            die("pthread_cond_broadcast");
+    }
+    unlock();
+    return NULL;
+}
+
+static void jobs_start(void)
+{
+    sigset_t all, old;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n = cpus > 1 ? min(cpus, CONFIG_JOB_WORKERS) : 1;
+
+    if (pipe2(pool.pipe, O_NONBLOCK | O_CLOEXEC))
+        pdie("pipe2");
+
+    /* signals are for the main loop, which they interrupt */
+    sigfillset(&all);
+    if (pthread_sigmask(SIG_SETMASK, &all, &old))
+        die("pthread_sigmask");
+    for (; pool.nthreads < n; ++pool.nthreads)
+        if (pthread_create(&pool.threads[pool.nthreads], NULL, worker, NULL))
+            die("pthread_create");
+    if (pthread_sigmask(SIG_SETMASK, &old, NULL))
+        die("pthread_sigmask");
+}
+
+struct job *job_new(char const *name, struct blob const *blob,
+        bool (*run)(struct job *), void (*finish)(struct job *), void *arg)
+{
+    struct job *job = malloc_strict(sizeof(*job));
+
+    memset(job, 0, sizeof(*job));
+    job->name = name;
+    job->blob = blob;
+    job->run = run;
+    job->finish = finish;
+    job->arg = arg;
+    return job;
+}
+
+void jobs_submit(struct job *job)
+{
+    struct job **p;
+
+    if (!pool.nthreads)
+        jobs_start();
+
+    lock();
+    for (p = &pool.queued; *p; p = &(*p)->next);
+    *p = job;
+    job->next = NULL;
+    if (pthread_cond_signal(&pool.wake))
+        die("pthread_cond_signal");
+    unlock();
+}
+
+/* for the progress callbacks of long operations: records how far the job
+ * got, and tells it whether to go on */
+bool job_progress(void *arg, size_t done, size_t total)
+{
+    struct job *job = arg;
+    bool go_on;
+
+    lock();
+    job->done = done;
+    job->total = total;
+    go_on = !job->cancelled;
+    unlock();
+    return go_on;
+}
+
+/* with the lock held; jobs of blob, or all of them if it is NULL */
+static bool jobs_cancel_locked(struct blob const *blob)
+{
+    struct job **p, *job;
+    bool running = false;
+
+    for (p = &pool.queued; (job = *p); ) {
+        if (blob && job->blob != blob) {
+            p = &job->next;
+            continue;
+        }
+        *p = job->next;
+        job->cancelled = true;
+        job_finished(job, false);
+    }
+    for (job = pool.running; job; job = job->next)
+        if (!blob || job->blob == blob)
+            job->cancelled = running = true;
+    return running;
+}
+
+/* the blob is about to change: cancels the jobs reading it and waits until
+ * none of them runs any more */
+void jobs_quiesce(struct blob const *blob)
+{
+    if (!pool.nthreads)
+        return;
+
+    lock();
+    while (jobs_cancel_locked(blob))
+        if (pthread_cond_wait(&pool.stopped, &pool.lock))
+            die("pthread_cond_wait");
+    unlock();
+}
+
+/* cancels all jobs, without waiting for them */
+void jobs_cancel(void)
+{
+    if (!pool.nthreads)
+        return;
+
+    lock();
+    jobs_cancel_locked(NULL);
+    unlock();
+}
+
+/* stops the workers, and delivers what they finished */
+void jobs_shutdown(void)
+{
+    if (!pool.nthreads)
+        return;
+
+    lock();
+    jobs_cancel_locked(NULL);
+    pool.quit = true;
+    if (pthread_cond_broadcast(&pool.wake))
+        die("pthread_cond_broadcast");
+    unlock();
+
+    for (size_t i = 0; i < pool.nthreads; ++i)
+        if (pthread_join(pool.threads[i], NULL))
+            die("pthread_join");
+    jobs_deliver();
+    pool.nthreads = 0;
+
+    close(pool.pipe[0]);
+    close(pool.pipe[1]);
+    pool.pipe[0] = pool.pipe[1] = -1;
+    pool.quit = false;
+}
+
+/* becomes readable when finished jobs are waiting to be delivered */
+int jobs_fd(void)
+{
+    return pool.pipe[0];
+}
+
+/* hands finished jobs to their callbacks, in the order they finished */
+size_t jobs_deliver(void)
+{
+    struct job *list = NULL, *job;
+    char buf[64];
+    size_t n = 0;
+
+    if (!pool.nthreads)
+        return 0;
+
+    while (0 < read(pool.pipe[0], buf, sizeof(buf)));
+
+    lock();
+    while ((job = pool.finished)) {
+        pool.finished = job->next;
+        job->next = list;
+        list = job;
+    }
+    unlock();
+
+    for (; (job = list); ++n) {
+        list = job->next;
+        job->finish(job);
+        free(job->arg);
+        free(job);
+    }
+    return n;
+}
+
+/* describes the jobs still to finish; false if there are none */
+bool jobs_busy(char *buf, size_t size)
+{
+    struct job *job;
+    size_t n = 0;
+
+    if (!pool.nthreads)
+        return false;
+
+    lock();
+    for (job = pool.running; job; job = job->next, ++n)
+        if (!n)
+            snprintf(buf, size, "%s: %zu%%", job->name, job->total ? job->done * 100 / job->total : 0);
+    for (job = pool.queued; job; job = job->next, ++n)
+        if (!n)
+            snprintf(buf, size, "%s: waiting", job->name);
+    unlock();
+
+    if (n > 1)
+        snprintf(buf + strlen(buf), size - strlen(buf), " (and %zu more)", n - 1);
+    return n;
+}
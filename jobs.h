@@ -0,0 +1,37 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "common.h"
+
+struct blob;
+
+/* long operations run by a fixed pool of worker threads, with their
+ * results delivered to the main loop */
+
+struct job {
+    char const *name; /* shown with the progress */
+    struct blob const *blob; /* read by the job, hence not changed while it runs */
+    bool (*run)(struct job *job); /* on a worker; false if cancelled */
+    void (*finish)(struct job *job); /* in the main loop; the blob may be gone by then */
+    void *arg; /* freed along with the job */
+
+    /* guarded by the pool's lock */
+    size_t done, total;
+    bool cancelled, ok;
+    struct job *next;
+};
+
+struct job *job_new(char const *name, struct blob const *blob,
+        bool (*run)(struct job *), void (*finish)(struct job *), void *arg);
+void jobs_submit(struct job *job);
+bool job_progress(void *job, size_t done, size_t total);
+
+void jobs_quiesce(struct blob const *blob);
+void jobs_cancel(void);
+void jobs_shutdown(void);
+
+int jobs_fd(void);
+size_t jobs_deliver(void);
+bool jobs_busy(char *buf, size_t size);
+
+#endif
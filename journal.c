@@ -0,0 +1,321 @@
+#include "common.h"
+#include "blob.h"
+#include "journal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+/*
+ * Write-ahead journal of the edits to a blob, kept next to its file as
+ * ".$name.hyx-journal" while there are unsaved changes. After a header
+ * that identifies the file on disk, each edit is one record
+ *
+ *     $op $pos $len [$bytes]
+ *
+ * where op is 'R', 'I' or 'D' and the numbers are LEB128 varints.
+ * Records are collected in memory and written out together by
+ * journal_commit() before the editor waits for input, so they survive
+ * the editor dying; they are fsync()ed at most every
+ * CONFIG_JOURNAL_INTERVAL. If the editor doesn't exit cleanly, the
+ * journal is replayed the next time the unchanged file is opened.
+ *
+ * The journal is created and locked with the first record, so merely
+ * viewing a file leaves nothing behind, and removed again once the
+ * records are no longer needed or can't be written.
+ */
+
+#define JOURNAL_MAGIC "HYXJRNL1"
+
+struct journal_header {
+    char magic[8];
+    struct file_id id;
+};
+
+static char *journal_path(char const *filename)
+{
+    char const *slash = strrchr(filename, '/');
+    int dirlen = slash ? slash + 1 - filename : 0;
+    char *path = malloc_strict(strlen(filename) + strlen("..hyx-journal") + 1);
+
+    sprintf(path, "%.*s.%s.hyx-journal", dirlen, filename, filename + dirlen);
+    return path;
+}
+
+static void journal_header(struct journal_header *hdr, struct file_id const *id)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, JOURNAL_MAGIC, sizeof(hdr->magic));
+    hdr->id = *id;
+}
+
+static bool write_all(int fd, void const *buf, size_t len)
+{
+    ssize_t r;
+    for (size_t i = 0; i < len; i += r) {
+        if (0 > (r = write(fd, (byte const *) buf + i, len - i))) {
+            if (errno != EINTR)
+                return false;
+            r = 0;
+        }
+    }
+    return true;
+}
+
+/* gives up on the journal. what it holds so far is incomplete, and would
+ * be replayed next time, so it goes away while it is still locked. */
+static void journal_fail(struct journal *j)
+{
+    unlink(j->path);
+    close(j->fd);
+    j->fd = -1;
+    j->failed = true;
+}
+
+/* creates the journal on disk for the first record; false if there can't be one */
+static bool journal_create(struct journal *j)
+{
+    struct journal_header hdr;
+
+    if (j->fd >= 0)
+        return true;
+    if (j->failed)
+        return false;
+
+    /* a journal that appeared meanwhile belongs to another instance */
+    if (0 > (j->fd = open(j->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR))
+            || flock(j->fd, LOCK_EX | LOCK_NB)) {
+        if (j->fd >= 0)
+            close(j->fd);
+        j->fd = -1;
+        j->failed = true;
+        return false;
+    }
+
+    journal_header(&hdr, &j->id);
+    if (!write_all(j->fd, &hdr, sizeof(hdr))) {
+        journal_fail(j);
+        return false;
+    }
+    j->synced = monotonic_microtime();
+    return true;
+}
+
+static bool get_varint(byte const **p, byte const *end, size_t *n)
+{
+    *n = 0;
+    for (unsigned shift = 0; *p < end && shift < 8 * sizeof(*n); shift += 7) {
+        byte c = *(*p)++;
+        *n |= (size_t) (c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* applies complete records as one undo step; returns how many there were */
+static size_t journal_replay(struct blob *blob, byte const *data, size_t len, size_t *valid)
+{
+    byte const *p = data, *end = data + len;
+    size_t n = 0, pos, cnt;
+    char op;
+
+    *valid = 0;
+    blob_batch_begin(blob);
+
+    while (p < end) {
+        op = *p++;
+        if (!get_varint(&p, end, &pos) || !get_varint(&p, end, &cnt) || !cnt)
+            break;
+        if (op != 'D' && (size_t) (end - p) < cnt)
+            break;
+
+        if (op == 'R' && pos <= blob_length(blob) && cnt <= blob_length(blob) - pos)
+            blob_replace(blob, pos, p, cnt, true);
+        else if (op == 'I' && blob_can_move(blob) && pos <= blob_length(blob))
+            blob_insert(blob, pos, p, cnt, true);
+        else if (op == 'D' && blob_can_move(blob) && pos <= blob_length(blob) && cnt <= blob_length(blob) - pos)
+            blob_delete(blob, pos, cnt, true);
+        else
+            break;
+
+        if (op != 'D')
+            p += cnt;
+        *valid = p - data;
+        ++n;
+    }
+
+    blob_batch_end(blob);
+    return n;
+}
+
+/* opens the journal for the blob's file, replaying what a previous session
+ * left behind. returns NULL if there can't be a journal, and then sets
+ * blob->journal_note to tell the user why. */
+struct journal *journal_open(struct blob *blob)
+{
+    struct journal *j;
+    struct journal_header hdr;
+    struct stat st;
+    size_t valid = 0;
+    int fd;
+
+    if (!blob->filename)
+        return NULL;
+
+    j = malloc_strict(sizeof(*j));
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+    j->path = journal_path(blob->filename);
+    file_id_get(blob->filename, &j->id);
+    j->synced = monotonic_microtime();
+
+    /* nothing to recover unless a previous session left a journal */
+    if (0 > (fd = open(j->path, O_RDWR | O_CLOEXEC)))
+        return j;
+
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        blob->journal_note = "another instance is editing the file; not journaling.";
+        goto fail;
+    }
+    if (fstat(fd, &st))
+        pdie("fstat");
+
+    journal_header(&hdr, &j->id);
+    if ((size_t) st.st_size > sizeof(hdr)) {
+        byte *map = mmap_strict(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        bool match = !memcmp(map, &hdr, sizeof(hdr));
+        if (match)
+            j->recovered = journal_replay(blob, map + sizeof(hdr), st.st_size - sizeof(hdr), &valid);
+        munmap_strict(map, st.st_size);
+        /* edits to another version of the file, or from another version of
+         * hyx: keep them for the user rather than overwrite them */
+        if (!match) {
+            blob->journal_note = "journal is for another version of the file; kept it, not journaling.";
+            goto fail;
+        }
+    }
+
+    /* the recovered edits are unsaved again, so the journal stays */
+    if (j->recovered) {
+        j->fd = fd;
+        /* drop a torn last record */
+        if (ftruncate(fd, sizeof(hdr) + valid) || 0 > lseek(fd, 0, SEEK_END))
+            journal_fail(j);
+    }
+    else {
+        unlink(j->path);
+        close(fd);
+    }
+    return j;
+
+fail:
+    close(fd);
+    free(j->path);
+    free(j);
+    return NULL;
+}
+
+/* writes out buffered records; gives up on the journal if that fails */
+static void journal_flush(struct journal *j)
+{
+    if (!j->len)
+        return;
+    if (j->fd >= 0 && !write_all(j->fd, j->buf, j->len))
+        journal_fail(j);
+    j->len = 0;
+    j->unsynced = true;
+}
+
+static void put_varint(struct journal *j, size_t n)
+{
+    do j->buf[j->len++] = (n & 0x7f) | (n > 0x7f ? 0x80 : 0);
+    while (n >>= 7);
+}
+
+void journal_record(struct journal *j, char op, size_t pos, byte const *data, size_t len)
+{
+    size_t n = op == 'D' ? 0 : len;
+    bool direct = n >= CONFIG_JOURNAL_BUFFER; /* don't copy large blocks around */
+    size_t need = j->len + 1 + 2 * 10 + (direct ? 0 : n);
+
+    if (!journal_create(j))
+        return;
+
+    if (need > j->cap)
+        j->buf = realloc_strict(j->buf, j->cap = max(need, 2 * j->cap));
+
+    j->buf[j->len++] = op;
+    put_varint(j, pos);
+    put_varint(j, len);
+
+    if (direct) {
+        journal_flush(j);
+        if (j->fd >= 0 && !write_all(j->fd, data, n))
+            journal_fail(j);
+        j->unsynced = true;
+    }
+    else if (n) {
+        memcpy(j->buf + j->len, data, n);
+        j->len += n;
+    }
+
+    if (j->len >= CONFIG_JOURNAL_BUFFER)
+        journal_flush(j);
+}
+
+/* group commit: called whenever the editor is about to wait for input */
+void journal_commit(struct journal *j)
+{
+    uint64_t now;
+
+    journal_flush(j);
+
+    if (j->fd < 0 || !j->unsynced)
+        return;
+    if ((now = monotonic_microtime()) - j->synced < CONFIG_JOURNAL_INTERVAL)
+        return;
+    if (fdatasync(j->fd))
+        journal_fail(j);
+    j->unsynced = false;
+    j->synced = now;
+}
+
+/* called after the blob was saved, possibly under a new name: the records
+ * so far are no longer needed, and new ones apply to the file as it is now */
+void journal_reset(struct journal *j, struct blob const *blob)
+{
+    if (j->fd >= 0) {
+        unlink(j->path);
+        close(j->fd);
+        j->fd = -1;
+    }
+    free(j->path);
+    j->path = journal_path(blob->filename);
+    file_id_get(blob->filename, &j->id);
+    j->len = 0;
+    j->unsynced = false;
+    j->failed = false;
+}
+
+/* the blob is going away, so nothing needs to be recovered */
+void journal_close(struct journal *j)
+{
+    if (!j)
+        return;
+    if (j->fd >= 0) {
+        unlink(j->path);
+        close(j->fd);
+    }
+    free(j->path);
+    free(j->buf);
+    free(j);
+}
+
+#undef JOURNAL_MAGIC
@@ -0,0 +1,29 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "common.h"
+
+struct blob;
+
+struct journal {
+    int fd; /* -1 until the first record */
+    char *path;
+    struct file_id id; /* the file the records apply to */
+    bool failed; /* gave up after an error */
+
+    byte *buf; /* records not yet written */
+    size_t len, cap;
+
+    bool unsynced;
+    uint64_t synced; /* time of the last fsync() */
+
+    size_t recovered; /* records replayed when the journal was opened */
+};
+
+struct journal *journal_open(struct blob *blob);
+void journal_record(struct journal *j, char op, size_t pos, byte const *data, size_t len);
+void journal_commit(struct journal *j);
+void journal_reset(struct journal *j, struct blob const *blob);
+void journal_close(struct journal *j);
+
+#endif
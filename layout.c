@@ -0,0 +1,572 @@
+
+#include "common.h"
+#include "layout.h"
+#include "blob.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+/*
+ * Parsed structs are nodes in a tree that is only built where somebody
+ * looks: a field is placed when it is needed, and of an array of structs
+ * only the recently used elements are kept. Each node remembers which
+ * bytes its layout was computed from, so that edits drop just the nodes
+ * they affect.
+ */
+
+#define LAYOUT_CACHE 64 /* elements of an array of structs kept parsed */
+
+#define LAYOUT_SEARCH 256 /* arrays up to this long are searched for fields placed elsewhere */
+
+#define LAYOUT_DEPTH 64 /* nesting followed at most */
+
+struct larray {
+    struct lnode *cache[LAYOUT_CACHE]; /* element i is in slot i % LAYOUT_CACHE */
+    size_t *starts, nstarts, cap; /* offsets of the first elements, if their size varies */
+};
+
+struct lfield {
+    enum { LF_NEW, LF_BUSY, LF_DONE, LF_BAD } state;
+    size_t off, count;
+    size_t size; /* SIZE_MAX until known */
+    struct lnode *one; /* a single struct */
+    struct larray *arr; /* an array of structs */
+};
+
+struct lnode {
+    struct tpl_struct const *st;
+    struct lnode *parent;
+    size_t pfield; /* index of the field of parent this is in */
+    size_t base, index;
+    unsigned depth;
+    size_t lo, hi; /* bytes the layout was computed from */
+    struct lfield f[];
+};
+
+static size_t field_size(struct layout *L, struct lnode *N, size_t j);
+
+struct layout *layout_new(struct template *t, struct blob const *blob)
+{
+    struct layout *L = malloc_strict(sizeof(*L));
+    L->t = *t;
+    L->blob = blob;
+    L->root = NULL;
+    L->changed = false;
+    return L;
+}
+
+static struct lnode *node_new(struct tpl_struct const *st, struct lnode *parent, size_t pfield, size_t base, size_t index)
+{
+    struct lnode *N = malloc_strict(sizeof(*N) + st->n * sizeof(*N->f));
+    N->st = st;
+    N->parent = parent;
+    N->pfield = pfield;
+    N->base = base;
+    N->index = index;
+    N->depth = parent ? parent->depth + 1 : 0;
+    N->lo = SIZE_MAX;
+    N->hi = 0;
+    memset(N->f, 0, st->n * sizeof(*N->f));
+    for (size_t j = 0; j < st->n; ++j)
+        N->f[j].size = SIZE_MAX;
+    return N;
+}
+
+static void node_free(struct lnode *N)
+{
+    if (!N)
+        return;
+    for (size_t j = 0; j < N->st->n; ++j) {
+        node_free(N->f[j].one);
+        if (N->f[j].arr) {
+            for (size_t k = 0; k < LAYOUT_CACHE; ++k)
+                node_free(N->f[j].arr->cache[k]);
+            free(N->f[j].arr->starts);
+            free(N->f[j].arr);
+        }
+    }
+    free(N);
+}
+
+/* the struct in field j of N, which is not an array; NULL if nested too deeply */
+static struct lnode *single(struct layout *L, struct lnode *N, size_t j)
+{
+    if (!N->f[j].one && N->depth + 1 < LAYOUT_DEPTH)
+        N->f[j].one = node_new(&L->t.structs[N->st->fields[j].type], N, j, N->f[j].off, 0);
+    return N->f[j].one;
+}
+
+void layout_free(struct layout *L)
+{
+    if (!L)
+        return;
+    node_free(L->root);
+    tpl_free(&L->t);
+    free(L);
+}
+
+static void depend(struct lnode *N, size_t lo, size_t hi)
+{
+    if (N && lo < hi) {
+        N->lo = min(N->lo, lo);
+        N->hi = max(N->hi, hi);
+    }
+}
+
+static bool read_int(struct layout *L, size_t pos, struct tpl_field const *f, uint64_t *v)
+{
+    unsigned w = f->width;
+
+    if (pos > blob_length(L->blob) || blob_length(L->blob) - pos < w)
+        return false;
+    *v = 0;
+    for (unsigned k = 0; k < w; ++k)
+        *v |= (uint64_t) blob_at(L->blob, pos + k) << 8 * (f->big_endian ? w - 1 - k : k);
+    if (f->is_signed && w < 8 && *v >> (8 * w - 1))
+        *v |= ~(uint64_t) 0 << 8 * w;
+    return true;
+}
+
+static bool place(struct layout *L, struct lnode *N, size_t j);
+
+static ssize_t field_index(struct tpl_struct const *st, char const *name, size_t len, size_t bound)
+{
+    for (size_t j = 0; j < min(bound, st->n); ++j)
+        if (strlen(st->fields[j].name) == len && !strncmp(st->fields[j].name, name, len))
+            return j;
+    return -1;
+}
+
+/* values of earlier fields, seen from field bound of N */
+static bool resolve(struct layout *L, struct lnode *N, size_t bound, char const *name, uint64_t *v)
+{
+    struct lnode *M = N, *dep = N;
+    size_t len = strcspn(name, ".");
+    ssize_t j;
+
+    /* the first part may be in any enclosing struct, but only before the path to N */
+    while ((j = field_index(M->st, name, len, bound)) < 0) {
+        if (!M->parent)
+            return false;
+        bound = M->pfield;
+        M = M->parent;
+    }
+
+    while (true) {
+        struct tpl_field const *tf = &M->st->fields[j];
+        if (!place(L, M, j) || tf->count)
+            return false;
+        if (!name[len]) {
+            if (tf->kind == TPL_STRUCT || !read_int(L, M->f[j].off, tf, v))
+                return false;
+            depend(dep, M->f[j].off, M->f[j].off + tf->width);
+            return true;
+        }
+        if (tf->kind != TPL_STRUCT)
+            return false;
+        if (!(M = single(L, M, j)))
+            return false;
+
+        name += len + 1;
+        len = strcspn(name, ".");
+        if ((j = field_index(M->st, name, len, SIZE_MAX)) < 0)
+            return false;
+        /* where that field is depends on how the struct was laid out */
+        if (!place(L, M, j))
+            return false;
+        depend(dep, M->lo, M->hi);
+    }
+}
+
+static bool eval(struct layout *L, struct lnode *N, size_t bound, struct tpl_expr const *e, uint64_t *v)
+{
+    uint64_t a, b;
+
+    switch (e->op) {
+    case TPL_NUM:
+        *v = e->num;
+        return true;
+    case TPL_BASE:
+        *v = N ? N->base : 0;
+        return true;
+    case TPL_NAME:
+        return N && resolve(L, N, bound, e->name, v);
+    case TPL_NEG: case TPL_NOT:
+        if (!eval(L, N, bound, e->a, &a))
+            return false;
+        *v = e->op == TPL_NEG ? -a : ~a;
+        return true;
+    case TPL_BINARY:
+        if (!eval(L, N, bound, e->a, &a) || !eval(L, N, bound, e->b, &b))
+            return false;
+        switch (e->binop) {
+        case '|': *v = a | b; return true;
+        case '^': *v = a ^ b; return true;
+        case '&': *v = a & b; return true;
+        case '<': *v = b < 64 ? a << b : 0; return true;
+        case '>': *v = b < 64 ? a >> b : 0; return true;
+        case '+': *v = a + b; return true;
+        case '-': *v = a - b; return true;
+        case '*': *v = a * b; return true;
+        case '/': if (!b) return false; *v = a / b; return true;
+        case '%': if (!b) return false; *v = a % b; return true;
+        }
+    }
+    return false;
+}
+
+/* computes the offset and count of field j */
+static bool place(struct layout *L, struct lnode *N, size_t j)
+{
+    struct lfield *f = &N->f[j];
+    struct tpl_field const *tf = &N->st->fields[j];
+    uint64_t v;
+    ssize_t p;
+
+    if (f->state != LF_NEW)
+        return f->state == LF_DONE;
+    f->state = LF_BUSY;
+
+    f->count = 1;
+    if (tf->count) {
+        if (!eval(L, N, j, tf->count, &v))
+            goto bad;
+        f->count = v;
+    }
+
+    if (tf->at) {
+        if (!eval(L, N, j, tf->at, &v))
+            goto bad;
+        f->off = v;
+    }
+    else {
+        /* right after the previous field that isn't placed elsewhere */
+        for (p = j - 1; p >= 0 && N->st->fields[p].at; --p);
+        if (p < 0)
+            f->off = N->base;
+        else if (!place(L, N, p) || (v = field_size(L, N, p)) == SIZE_MAX)
+            goto bad;
+        else
+            f->off = N->f[p].off + v;
+    }
+
+    f->state = LF_DONE;
+    return true;
+bad:
+    f->state = LF_BAD;
+    return false;
+}
+
+static size_t node_size(struct layout *L, struct lnode *N)
+{
+    ssize_t p;
+    size_t size;
+
+    for (p = N->st->n - 1; p >= 0 && N->st->fields[p].at; --p);
+    if (p < 0)
+        return 0;
+    if (!place(L, N, p) || (size = field_size(L, N, p)) == SIZE_MAX)
+        return SIZE_MAX;
+    return N->f[p].off + size - N->base;
+}
+
+static struct lnode *element(struct layout *L, struct lnode *N, size_t j, size_t i);
+
+/* offset of element i of array j, which may mean laying out the elements before it */
+static size_t element_start(struct layout *L, struct lnode *N, size_t j, size_t i)
+{
+    struct lfield *f = &N->f[j];
+    struct tpl_field const *tf = &N->st->fields[j];
+    size_t w = tpl_field_width(&L->t, tf), size;
+    struct larray *arr;
+    struct lnode *E;
+
+    if (w != SIZE_MAX)
+        return f->off + i * w;
+
+    if (!(arr = f->arr)) {
+        arr = f->arr = malloc_strict(sizeof(*arr));
+        memset(arr, 0, sizeof(*arr));
+    }
+    if (!arr->nstarts) {
+        arr->starts = realloc_strict(arr->starts, (arr->cap = 16) * sizeof(*arr->starts));
+        arr->starts[arr->nstarts++] = f->off;
+    }
+
+    while (arr->nstarts <= i) {
+        E = element(L, N, j, arr->nstarts - 1);
+        /* elements must take up room, and the data must hold them */
+        if (!E || !(size = node_size(L, E)) || size == SIZE_MAX
+                || arr->starts[arr->nstarts - 1] + size > blob_length(L->blob))
+            return SIZE_MAX;
+        depend(N, E->lo, E->hi);
+        if (arr->nstarts == arr->cap)
+            arr->starts = realloc_strict(arr->starts, (arr->cap *= 2) * sizeof(*arr->starts));
+        arr->starts[arr->nstarts] = arr->starts[arr->nstarts - 1] + size;
+        ++arr->nstarts;
+    }
+    return arr->starts[i];
+}
+
+static struct lnode *element(struct layout *L, struct lnode *N, size_t j, size_t i)
+{
+    struct lfield *f = &N->f[j];
+    struct lnode **slot;
+    size_t start;
+
+    if (!f->arr) {
+        f->arr = malloc_strict(sizeof(*f->arr));
+        memset(f->arr, 0, sizeof(*f->arr));
+    }
+    slot = &f->arr->cache[i % LAYOUT_CACHE];
+    if (*slot && (*slot)->index == i)
+        return *slot;
+
+    if (N->depth + 1 >= LAYOUT_DEPTH || (start = element_start(L, N, j, i)) == SIZE_MAX)
+        return NULL;
+    node_free(*slot);
+    return *slot = node_new(&L->t.structs[N->st->fields[j].type], N, j, start, i);
+}
+
+static size_t field_size(struct layout *L, struct lnode *N, size_t j)
+{
+    struct lfield *f = &N->f[j];
+    struct tpl_field const *tf = &N->st->fields[j];
+    size_t w, end;
+
+    if (f->size != SIZE_MAX)
+        return f->size;
+
+    if ((w = tpl_field_width(&L->t, tf)) != SIZE_MAX) {
+        if (w && f->count > SIZE_MAX / w)
+            return SIZE_MAX;
+        return f->size = f->count * w;
+    }
+
+    if (!tf->count) {
+        if (!single(L, N, j))
+            return SIZE_MAX;
+        if ((f->size = node_size(L, f->one)) != SIZE_MAX)
+            depend(N, f->one->lo, f->one->hi);
+        return f->size;
+    }
+
+    if ((end = element_start(L, N, j, f->count)) == SIZE_MAX)
+        return SIZE_MAX;
+    return f->size = end - f->off;
+}
+
+static struct lnode *root(struct layout *L)
+{
+    uint64_t v = 0;
+
+    if (!L->root && (!L->t.root_at || eval(L, NULL, 0, L->t.root_at, &v)))
+        L->root = node_new(&L->t.structs[L->t.root], NULL, 0, v, 0);
+    return L->root;
+}
+
+static void path_add(char *path, char const *name, size_t index, bool element)
+{
+    size_t n = strlen(path);
+    snprintf(path + n, 0x100 - n, element ? "%s%s[%zu]" : "%s%s", n ? "." : "", name, index);
+}
+
+static bool find(struct layout *L, struct lnode *N, size_t pos, struct layout_hit *hit);
+
+/* looks for pos inside field j of N, which starts before it */
+static bool find_in(struct layout *L, struct lnode *N, size_t j, size_t pos, struct layout_hit *hit)
+{
+    struct lfield *f = &N->f[j];
+    struct tpl_field const *tf = &N->st->fields[j];
+    size_t n = strlen(hit->path), w = tpl_field_width(&L->t, tf), i, size, lo, hi;
+    struct lnode *E;
+
+    if (tf->kind == TPL_STRUCT && tf->count && w == SIZE_MAX) {
+        /* the element containing pos, without laying out the ones after it */
+        if (!f->count || element_start(L, N, j, 0) == SIZE_MAX)
+            return false;
+        while (f->arr->nstarts <= f->count && f->arr->starts[f->arr->nstarts - 1] <= pos)
+            if (element_start(L, N, j, f->arr->nstarts) == SIZE_MAX)
+                break;
+        for (lo = 0, hi = min(f->arr->nstarts, f->count); lo + 1 < hi; ) {
+            i = lo + (hi - lo) / 2;
+            if (f->arr->starts[i] > pos)
+                hi = i;
+            else
+                lo = i;
+        }
+        if (!(E = element(L, N, j, lo)) || (size = node_size(L, E)) == SIZE_MAX || pos >= E->base + size)
+            return false;
+        path_add(hit->path, tf->name, lo, true);
+        if (find(L, E, pos, hit))
+            return true;
+        hit->path[n] = 0;
+        return false;
+    }
+
+    if ((size = field_size(L, N, j)) == SIZE_MAX || pos >= f->off + size)
+        return false;
+
+    if (tf->kind != TPL_STRUCT) {
+        hit->field = tf;
+        hit->element = tf->count && tf->kind == TPL_INT;
+        if (hit->element) {
+            i = (pos - f->off) / w;
+            hit->pos = f->off + i * w;
+            hit->len = w;
+        }
+        else {
+            hit->pos = f->off;
+            hit->len = size;
+        }
+        path_add(hit->path, tf->name, hit->element ? i : 0, hit->element);
+        return true;
+    }
+
+    if (tf->count) {
+        i = (pos - f->off) / w;
+        if (!(E = element(L, N, j, i)))
+            return false;
+        path_add(hit->path, tf->name, i, true);
+    }
+    else {
+        if (!(E = single(L, N, j)))
+            return false;
+        path_add(hit->path, tf->name, 0, false);
+    }
+    if (find(L, E, pos, hit))
+        return true;
+    hit->path[n] = 0;
+    return false;
+}
+
+/* looks for pos in fields that a struct field places elsewhere */
+static bool find_out_of_line(struct layout *L, struct lnode *N, size_t j, size_t pos, struct layout_hit *hit)
+{
+    struct lfield *f = &N->f[j];
+    struct tpl_field const *tf = &N->st->fields[j];
+    size_t n = strlen(hit->path);
+    struct lnode *E;
+
+    if (tf->kind != TPL_STRUCT || !L->t.structs[tf->type].has_at || f->count > LAYOUT_SEARCH)
+        return false;
+
+    for (size_t i = 0; i < f->count; ++i) {
+        if (tf->count)
+            E = element(L, N, j, i);
+        else
+            E = single(L, N, j);
+        if (!E)
+            break;
+        path_add(hit->path, tf->name, i, tf->count);
+        if (find(L, E, pos, hit))
+            return true;
+        hit->path[n] = 0;
+    }
+    return false;
+}
+
+static bool find(struct layout *L, struct lnode *N, size_t pos, struct layout_hit *hit)
+{
+    struct tpl_field const *tf;
+    bool past = false;
+
+    for (size_t j = 0; j < N->st->n; ++j) {
+        tf = &N->st->fields[j];
+        /* fields in sequence after pos can't contain it, and needn't be laid out */
+        if (past && !tf->at)
+            continue;
+        if (!place(L, N, j))
+            continue;
+        if (N->f[j].off > pos) {
+            past |= !tf->at;
+            if (find_out_of_line(L, N, j, pos, hit))
+                return true;
+            continue;
+        }
+        if (find_in(L, N, j, pos, hit) || find_out_of_line(L, N, j, pos, hit))
+            return true;
+    }
+    return false;
+}
+
+bool layout_find(struct layout *L, size_t pos, struct layout_hit *hit)
+{
+    struct lnode *R;
+
+    *hit->path = 0;
+    return (R = root(L)) && find(L, R, pos, hit);
+}
+
+static void touch(struct layout *L, struct lnode **slot, size_t pos, size_t len)
+{
+    struct lnode *N = *slot;
+
+    if (!N)
+        return;
+    if (pos < N->hi && N->lo < pos + len) {
+        node_free(N);
+        *slot = NULL;
+        L->changed = true;
+        return;
+    }
+    for (size_t j = 0; j < N->st->n; ++j) {
+        touch(L, &N->f[j].one, pos, len);
+        if (N->f[j].arr)
+            for (size_t k = 0; k < LAYOUT_CACHE; ++k)
+                touch(L, &N->f[j].arr->cache[k], pos, len);
+    }
+}
+
+/* bytes [pos, pos + len) were changed in place */
+void layout_touch(struct layout *L, size_t pos, size_t len)
+{
+    if (L && len)
+        touch(L, &L->root, pos, len);
+}
+
+/* offsets shifted: start over */
+void layout_moved(struct layout *L)
+{
+    if (!L)
+        return;
+    node_free(L->root);
+    L->root = NULL;
+    L->changed = true;
+}
+
+void layout_describe(struct layout *L, struct layout_hit const *hit, char *buf, size_t size)
+{
+    struct tpl_field const *tf = hit->field;
+    char const *name;
+    uint64_t v;
+    size_t n;
+
+    n = snprintf(buf, size, "%s ", hit->path);
+    if (n >= size)
+        return;
+
+    if (tf->kind == TPL_CHAR) {
+        n += snprintf(buf + n, size - n, "\"");
+        for (size_t k = 0; k < hit->len && k < 64 && n + 2 < size; ++k) {
+            byte b = blob_at(L->blob, hit->pos + k);
+            buf[n++] = isprint(b) ? b : '.';
+        }
+        snprintf(buf + n, size - n, "\"%s", hit->len > 64 ? "..." : "");
+        return;
+    }
+
+    if (!read_int(L, hit->pos, tf, &v)) {
+        snprintf(buf + n, size - n, "(past the end)");
+        return;
+    }
+    n += snprintf(buf + n, size - n, tf->is_signed ? "= %" PRId64 : "= %" PRIu64, v);
+    if (n < size)
+        n += snprintf(buf + n, size - n, " (0x%0*" PRIx64 ")", 2 * tf->width, tf->is_signed && tf->width < 8 ? v & (((uint64_t) 1 << 8 * tf->width) - 1) : v);
+    if (n < size && tf->enm >= 0 && (name = tpl_enum_name(&L->t.enums[tf->enm], v)))
+        snprintf(buf + n, size - n, " %s", name);
+}
+
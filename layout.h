@@ -0,0 +1,36 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "common.h"
+#include "tpl.h"
+
+/* a template applied to a blob, parsed only where it is looked at */
+
+struct blob;
+struct lnode;
+
+struct layout {
+    struct template t;
+    struct blob const *blob;
+    struct lnode *root; /* NULL until needed, or after edits that moved data */
+    bool changed; /* set when edits invalidated parsed parts */
+};
+
+/* the innermost field at some offset */
+struct layout_hit {
+    size_t pos, len;
+    struct tpl_field const *field;
+    bool element; /* one element of an array of integers */
+    char path[0x100];
+};
+
+struct layout *layout_new(struct template *t, struct blob const *blob);
+void layout_free(struct layout *L);
+
+void layout_touch(struct layout *L, size_t pos, size_t len);
+void layout_moved(struct layout *L);
+
+bool layout_find(struct layout *L, size_t pos, struct layout_hit *hit);
+void layout_describe(struct layout *L, struct layout_hit const *hit, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,143 @@
+
+#include "common.h"
+#include "overview.h"
+#include "blob.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define OVERVIEW_STEP 64 /* blocks computed per call to overview_step() */
+
+static size_t overview_blocks(size_t len)
+{
+    return (len + OVERVIEW_BLOCK - 1) / OVERVIEW_BLOCK;
+}
+
+struct overview *overview_new(struct blob const *blob)
+{
+    struct overview *ov = malloc_strict(sizeof(*ov));
+    ov->n = 0;
+    ov->blocks = NULL;
+    ranges_init(&ov->stale);
+    overview_moved(ov, 0, blob_length(blob));
+    return ov;
+}
+
+void overview_free(struct overview *ov)
+{
+    if (!ov)
+        return;
+    ranges_free(&ov->stale);
+    free(ov->blocks);
+    free(ov);
+}
+
+/* bytes [pos, pos + len) were changed in place */
+void overview_touch(struct overview *ov, size_t pos, size_t len)
+{
+    size_t from = pos / OVERVIEW_BLOCK;
+
+    if (ov && len)
+        ranges_add(&ov->stale, from, overview_blocks(pos + len) - from);
+}
+
+/* everything from pos on moved, and the blob is len bytes long now */
+void overview_moved(struct overview *ov, size_t pos, size_t len)
+{
+    size_t n = overview_blocks(len), from = pos / OVERVIEW_BLOCK;
+
+    if (!ov)
+        return;
+
+    if (n != ov->n) {
+        ov->blocks = realloc_strict(ov->blocks, n * sizeof(*ov->blocks));
+        if (n > ov->n)
+            memset(ov->blocks + ov->n, 0, (n - ov->n) * sizeof(*ov->blocks));
+        else
+            ranges_remove(&ov->stale, n, ov->n - n);
+        ov->n = n;
+    }
+    if (n > from)
+        ranges_add(&ov->stale, from, n - from);
+}
+
+static void overview_compute(struct overview_block *blk, struct blob const *blob, size_t pos, size_t len)
+{
+    size_t cnt[4][256] = {{0}}, c, zero, text = 0;
+    double sum = 0;
+    byte const *ptr;
+
+    /* blocks inside a hole are all zero; don't touch their pages */
+    size_t i = ranges_find(&blob->holes, pos);
+    if (i < blob->holes.n && blob->holes.r[i].pos <= pos && range_end(&blob->holes.r[i]) >= pos + len) {
+        blk->entropy = blk->text = 0;
+        blk->zero = 255;
+        return;
+    }
+
+    /* several tables, so that runs of equal bytes don't stall on one counter */
+    for (size_t off = 0, n, k; off < len; off += n) {
+        ptr = blob_lookup(blob, pos + off, &n);
+        n = min(n, len - off);
+        for (k = 0; k + 4 <= n; k += 4) {
+            ++cnt[0][ptr[k]];
+            ++cnt[1][ptr[k + 1]];
+            ++cnt[2][ptr[k + 2]];
+            ++cnt[3][ptr[k + 3]];
+        }
+        for (; k < n; ++k)
+            ++cnt[0][ptr[k]];
+    }
+
+    for (unsigned b = 0; b < 256; ++b) {
+        c = cnt[0][b] + cnt[1][b] + cnt[2][b] + cnt[3][b];
+        cnt[0][b] = c;
+        if (c)
+            sum += c * log2(c);
+        if ((b >= 0x20 && b < 0x7f) || b == '\t' || b == '\n' || b == '\r')
+            text += c;
+    }
+    zero = cnt[0][0];
+
+    /* H = log2(len) - sum(c log2 c) / len */
+    blk->entropy = min(255, (size_t) ((log2(len) - sum / len) * 32 + .5));
+    blk->zero = zero * 255 / len;
+    blk->text = text * 255 / len;
+}
+
+/* computes some stale blocks; [*from, *to) are the indices of those updated.
+ * returns false if nothing was left to do. */
+bool overview_step(struct overview *ov, struct blob const *blob, size_t *from, size_t *to)
+{
+    size_t len = blob_length(blob);
+
+    if (!ov->stale.n)
+        return false;
+
+    *from = ov->stale.r[0].pos;
+    *to = min(range_end(&ov->stale.r[0]), *from + OVERVIEW_STEP);
+    for (size_t i = *from; i < *to; ++i)
+        overview_compute(&ov->blocks[i], blob, i * OVERVIEW_BLOCK, min(OVERVIEW_BLOCK, len - i * OVERVIEW_BLOCK));
+    ranges_remove(&ov->stale, *from, *to - *from);
+    return true;
+}
+
+/* averages the blocks [from, to); stale tells whether any of them is out of date */
+void overview_summary(struct overview const *ov, size_t from, size_t to, struct overview_block *sum, bool *stale)
+{
+    size_t e = 0, z = 0, t = 0, n = to - from;
+
+    assert(from < to && to <= ov->n);
+
+    for (size_t i = from; i < to; ++i) {
+        e += ov->blocks[i].entropy;
+        z += ov->blocks[i].zero;
+        t += ov->blocks[i].text;
+    }
+    sum->entropy = e / n;
+    sum->zero = z / n;
+    sum->text = t / n;
+    *stale = ranges_intersects(&ov->stale, from, n);
+}
+
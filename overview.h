@@ -0,0 +1,34 @@
+#ifndef OVERVIEW_H
+#define OVERVIEW_H
+
+#include "common.h"
+#include "ranges.h"
+
+struct blob;
+
+/* per-block statistics of a blob, for the overview column */
+
+#define OVERVIEW_BLOCK 0x10000
+
+struct overview_block {
+    uint8_t entropy; /* bits per byte, times 32 */
+    uint8_t zero;    /* share of zero bytes, out of 255 */
+    uint8_t text;    /* share of printable ascii, out of 255 */
+};
+
+struct overview {
+    size_t n;
+    struct overview_block *blocks;
+    struct ranges stale; /* indices of blocks that need to be recomputed */
+};
+
+struct overview *overview_new(struct blob const *blob);
+void overview_free(struct overview *ov);
+
+void overview_touch(struct overview *ov, size_t pos, size_t len);
+void overview_moved(struct overview *ov, size_t pos, size_t len);
+
+bool overview_step(struct overview *ov, struct blob const *blob, size_t *from, size_t *to);
+void overview_summary(struct overview const *ov, size_t from, size_t to, struct overview_block *sum, bool *stale);
+
+#endif
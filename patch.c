@@ -0,0 +1,365 @@
+#include "common.h"
+#include "blob.h"
+#include "patch.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+/*
+ * Applying dumps and patches to a blob. Two input formats are understood:
+ *
+ *   - IPS patches, recognized by their "PATCH" header; RLE records and
+ *     the truncation extension are supported.
+ *
+ *   - text lines of the form "$offset: $hex...", where the offset is hex
+ *     and bytes may be grouped by single blanks. Anything after two
+ *     blanks or a '|' is ignored, which makes this read the output of
+ *     xxd and of hyx --dump. Blank lines, '#' comments and the "*" lines
+ *     of xxd -a are skipped.
+ *
+ * All updates are collected first and then sorted by offset, so that the
+ * blob is written front to back and each modified region exactly once.
+ */
+
+void patch_init(struct patch *patch)
+{
+    memset(patch, 0, sizeof(*patch));
+}
+
+void patch_free(struct patch *patch)
+{
+    free(patch->r);
+    free(patch->data);
+    patch_init(patch);
+}
+
+/* room for len more bytes of data; they are claimed by patch_push() */
+static byte *patch_reserve(struct patch *patch, size_t len)
+{
+    if (patch->len + len > patch->data_cap) {
+        patch->data_cap = max(patch->len + len, 2 * patch->data_cap);
+        patch->data = realloc_strict(patch->data, patch->data_cap);
+    }
+    return patch->data + patch->len;
+}
+
+static void patch_push(struct patch *patch, size_t pos, size_t len)
+{
+    struct patch_rec *rec;
+
+    if (patch->n == patch->cap)
+        patch->r = realloc_strict(patch->r, (patch->cap = max(16, 2 * patch->cap)) * sizeof(*patch->r));
+
+    rec = &patch->r[patch->n];
+    rec->pos = pos;
+    rec->len = len;
+    rec->off = patch->len;
+    rec->seq = patch->n++;
+
+    patch->len += len;
+}
+
+static byte hexval(char c)
+{
+    return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+static bool parse_line(struct patch *patch, char *p)
+{
+    char *end;
+    byte *out;
+    size_t pos, n = 0;
+
+    while (isspace(*p)) ++p;
+    if (!*p || *p == '#' || !strcmp(p, "*"))
+        return true;
+
+    errno = 0;
+    pos = strtoull(p, &end, 16);
+    if (errno || end == p || *end != ':')
+        return false;
+
+    for (p = end + 1; *p == ' ' || *p == '\t'; ++p)
+        ;
+    out = patch_reserve(patch, strlen(p) / 2);
+
+    while (isxdigit(p[0])) {
+        if (!isxdigit(p[1]))
+            return false;
+        out[n++] = hexval(p[0]) << 4 | hexval(p[1]);
+        p += 2;
+        /* a single blank separates groups; two start the ascii column */
+        if ((*p == ' ' || *p == '\t') && isxdigit(p[1]))
+            ++p;
+    }
+    if (*p && !isspace(*p) && *p != '|' && *p != '#')
+        return false;
+
+    if (n)
+        patch_push(patch, pos, n);
+    return true;
+}
+
+static enum patch_error parse_text(struct patch *patch, FILE *fp, unsigned *line)
+{
+    char *buf = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    bool ok = true;
+
+    for (*line = 1; ok && 0 <= (len = getline(&buf, &cap, fp)); ++*line) {
+        while (len && (buf[len - 1] == '\n' || buf[len - 1] == '\r'))
+            buf[--len] = 0;
+        ok = parse_line(patch, buf);
+    }
+    free(buf);
+
+    if (!ok) {
+        --*line;
+        return PATCH_SYNTAX;
+    }
+    return ferror(fp) ? PATCH_UNREADABLE : PATCH_OK;
+}
+
+/* reads an n-byte big-endian number */
+static bool read_be(FILE *fp, size_t n, size_t *val)
+{
+    byte buf[3];
+
+    assert(n <= sizeof(buf));
+    if (fread(buf, 1, n, fp) != n)
+        return false;
+    *val = 0;
+    for (size_t i = 0; i < n; ++i)
+        *val = *val << 8 | buf[i];
+    return true;
+}
+
+/* the header has been consumed; line counts records */
+static enum patch_error parse_ips(struct patch *patch, FILE *fp, unsigned *line)
+{
+    size_t pos, len, trunc;
+    int fill;
+
+    for (*line = 1; ; ++*line) {
+        if (!read_be(fp, 3, &pos))
+            return PATCH_SYNTAX;
+        if (pos == 0x454f46) /* "EOF" */
+            break;
+        if (!read_be(fp, 2, &len))
+            return PATCH_SYNTAX;
+
+        if (len) {
+            if (fread(patch_reserve(patch, len), 1, len, fp) != len)
+                return PATCH_SYNTAX;
+        }
+        else {
+            /* run-length encoded record */
+            if (!read_be(fp, 2, &len) || EOF == (fill = getc(fp)))
+                return PATCH_SYNTAX;
+            memset(patch_reserve(patch, len), fill, len);
+        }
+
+        if (len)
+            patch_push(patch, pos, len);
+    }
+
+    if (read_be(fp, 3, &trunc)) {
+        patch->truncate = true;
+        patch->truncate_len = trunc;
+    }
+    return PATCH_OK;
+}
+
+static int rec_cmp_pos(void const *p, void const *q)
+{
+    struct patch_rec const *a = p, *b = q;
+    if (a->pos != b->pos)
+        return a->pos < b->pos ? -1 : 1;
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static int rec_cmp_seq(void const *p, void const *q)
+{
+    struct patch_rec const *a = p, *b = q;
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/* sorts the records and merges overlapping or adjacent ones */
+static void patch_normalize(struct patch *patch)
+{
+    size_t i, j, n = 0;
+
+    qsort(patch->r, patch->n, sizeof(*patch->r), rec_cmp_pos);
+
+    patch->bytes = 0;
+    for (i = 0; i < patch->n; i = j) {
+        struct patch_rec merged = patch->r[i];
+        size_t end = merged.pos + merged.len;
+        bool copy = false;
+
+        for (j = i + 1; j < patch->n && patch->r[j].pos <= end; ++j) {
+            struct patch_rec const *prev = &patch->r[j - 1], *cur = &patch->r[j];
+            /* consecutive lines of a dump are already contiguous in data */
+            if (cur->pos != prev->pos + prev->len || cur->off != prev->off + prev->len)
+                copy = true;
+            end = max(end, cur->pos + cur->len);
+        }
+        merged.len = end - merged.pos;
+
+        if (copy) {
+            /* overlapping updates: replay them in their original order */
+            byte *out = patch_reserve(patch, merged.len);
+            qsort(patch->r + i, j - i, sizeof(*patch->r), rec_cmp_seq);
+            for (size_t k = i; k < j; ++k)
+                memcpy(out + patch->r[k].pos - merged.pos, patch->data + patch->r[k].off, patch->r[k].len);
+            merged.off = patch->len;
+            patch->len += merged.len;
+        }
+
+        patch->r[n++] = merged;
+        patch->bytes += merged.len;
+    }
+    patch->n = n;
+}
+
+enum patch_error patch_load(struct patch *patch, char const *filename, unsigned *line)
+{
+    char magic[5];
+    enum patch_error err;
+    FILE *fp;
+
+    *line = 0;
+    if (!(fp = fopen(filename, "rb")))
+        return PATCH_UNREADABLE;
+
+    patch->ips = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && !memcmp(magic, "PATCH", sizeof(magic));
+
+    if (patch->ips)
+        err = parse_ips(patch, fp, line);
+    else if (fseek(fp, 0, SEEK_SET))
+        err = PATCH_UNREADABLE;
+    else
+        err = parse_text(patch, fp, line);
+
+    fclose(fp);
+
+    if (!err)
+        patch_normalize(patch);
+    return err;
+}
+
+/* fails without touching the blob if it would have to be resized but can't,
+ * or would write to the gaps in a process */
+enum patch_error patch_apply(struct patch const *patch, struct blob *blob, bool save_history)
+{
+    size_t len = blob_length(blob), end = len;
+
+    if (patch->n)
+        end = max(end, patch->r[patch->n - 1].pos + patch->r[patch->n - 1].len);
+    if ((end > len || (patch->truncate && patch->truncate_len < end)) && !blob_can_move(blob))
+        return PATCH_RESIZE;
+    for (size_t i = 0; i < patch->n; ++i)
+        if (patch->r[i].pos < len && !blob_writable(blob, patch->r[i].pos, min(patch->r[i].len, len - patch->r[i].pos)))
+            return PATCH_UNMAPPED;
+
+    if (save_history)
+        blob_batch_begin(blob);
+
+    for (size_t i = 0; i < patch->n; ++i) {
+        struct patch_rec const *rec = &patch->r[i];
+        byte const *data = patch->data + rec->off;
+        size_t n = rec->pos < len ? min(rec->len, len - rec->pos) : 0;
+
+        if (n)
+            blob_replace(blob, rec->pos, data, n, save_history);
+        if (n == rec->len)
+            continue;
+
+        /* the records are sorted, so only the last ones can extend the blob */
+        if (rec->pos > len) {
+            byte *zero = malloc_strict(rec->pos - len);
+            memset(zero, 0, rec->pos - len);
+            blob_insert(blob, len, zero, rec->pos - len, save_history);
+            free(zero);
+        }
+        blob_insert(blob, rec->pos + n, data + n, rec->len - n, save_history);
+        len = blob_length(blob);
+    }
+
+    if (patch->truncate && patch->truncate_len < len)
+        blob_delete(blob, patch->truncate_len, len - patch->truncate_len, save_history);
+
+    if (save_history)
+        blob_batch_end(blob);
+
+    return PATCH_OK;
+}
+
+char const *patch_strerror(enum patch_error err)
+{
+    switch (err) {
+    case PATCH_OK: return "success";
+    case PATCH_UNREADABLE: return "patch is not readable";
+    case PATCH_SYNTAX: return "malformed patch";
+    case PATCH_RESIZE: return "patch resizes a memory-mapped file";
+    case PATCH_UNMAPPED: return "patch writes to unmapped memory";
+    }
+    die("unknown patch error");
+}
+
+static char const *save_strerror(enum blob_save_error err)
+{
+    switch (err) {
+    case BLOB_SAVE_OK: return NULL;
+    case BLOB_SAVE_FILENAME: return "no filename";
+    case BLOB_SAVE_NONEXISTENT: return "nonexistent path";
+    case BLOB_SAVE_PERMISSIONS: return "insufficient permissions";
+    case BLOB_SAVE_BUSY: return "file is busy";
+    case BLOB_SAVE_PROCESS: return "not a file";
+    case BLOB_SAVE_FAULT: return "the process refused some of the changes";
+    case BLOB_SAVE_CHANGED: return "file was changed by someone else";
+    case BLOB_SAVE_PENDING: return "still saving";
+    case BLOB_SAVE_WRITE: return "write failed";
+    }
+    die("can't save: unknown error");
+}
+
+int patch_main(char const *patchfile, char const *target)
+{
+    struct patch patch;
+    struct blob blob;
+    enum patch_error err;
+    char const *msg;
+    unsigned line;
+    bool ok = false;
+
+    patch_init(&patch);
+    if ((err = patch_load(&patch, patchfile, &line))) {
+        if (err == PATCH_SYNTAX)
+            fprintf(stderr, "%s: %s %u: %s\n", patchfile, patch.ips ? "record" : "line", line, patch_strerror(err));
+        else
+            fprintf(stderr, "%s: %s\n", patchfile, patch_strerror(err));
+        patch_free(&patch);
+        return EXIT_FAILURE;
+    }
+
+    blob_init(&blob);
+    blob_load(&blob, target);
+
+    if ((err = patch_apply(&patch, &blob, false)))
+        fprintf(stderr, "%s: can't apply: %s\n", target, patch_strerror(err));
+    else if ((msg = save_strerror(blob_save(&blob, NULL))))
+        fprintf(stderr, "%s: can't save: %s\n", target, msg);
+    else {
+        printf("%s: %zu bytes in %zu regions\n", target, patch.bytes, patch.n);
+        ok = true;
+    }
+
+    blob_free(&blob);
+    patch_free(&patch);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
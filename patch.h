@@ -0,0 +1,45 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "common.h"
+#include "blob.h"
+
+/* a set of byte updates, sorted and coalesced into disjoint regions */
+
+struct patch_rec {
+    size_t pos, len;
+    size_t off; /* into data */
+    size_t seq; /* order in the patch file; later updates win */
+};
+
+struct patch {
+    size_t n, cap;
+    struct patch_rec *r;
+
+    size_t len, data_cap;
+    byte *data;
+
+    bool ips;
+    size_t bytes;
+    bool truncate; /* IPS extension: cut the file to truncate_len */
+    size_t truncate_len;
+};
+
+enum patch_error {
+    PATCH_OK = 0,
+    PATCH_UNREADABLE,
+    PATCH_SYNTAX,
+    PATCH_RESIZE,
+    PATCH_UNMAPPED,
+};
+
+void patch_init(struct patch *patch);
+void patch_free(struct patch *patch);
+
+enum patch_error patch_load(struct patch *patch, char const *filename, unsigned *line);
+enum patch_error patch_apply(struct patch const *patch, struct blob *blob, bool save_history);
+char const *patch_strerror(enum patch_error err);
+
+int patch_main(char const *patchfile, char const *target);
+
+#endif
@@ -0,0 +1,256 @@
+
+#include "common.h"
+#include "procmem.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+
+/*
+ * Pages are read with pread() when first looked at and kept in a
+ * direct-mapped cache, so only what is shown or searched is ever copied.
+ * Modified pages move out of the cache into a list of their own and stay
+ * there until they were written back.
+ */
+
+static void procmem_maps(struct procmem *pm)
+{
+    char path[64], line[0x1000], perms[5];
+    size_t from, to, cap = 0;
+    int name;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%ld/maps", (long) pm->pid);
+    if (!(fp = fopen(path, "r")))
+        pdie("fopen");
+
+    while (fgets(line, sizeof(line), fp)) {
+        name = 0;
+        if (3 > sscanf(line, "%zx-%zx %4s %*s %*s %*s %n", &from, &to, perms, &name) || from >= to)
+            continue;
+        /* pread() takes signed offsets, which rules out [vsyscall] */
+        if (to > (size_t) SSIZE_MAX)
+            continue;
+        if (pm->n == cap)
+            pm->regions = realloc_strict(pm->regions, (cap = max(16, 2 * cap)) * sizeof(*pm->regions));
+        pm->regions[pm->n].pos = from;
+        pm->regions[pm->n].len = to - from;
+        strcpy(pm->regions[pm->n].perms, perms);
+        line[strcspn(line, "\n")] = 0;
+        pm->regions[pm->n++].name = strdup(name ? line + name : "");
+    }
+
+    if (ferror(fp))
+        pdie("fgets");
+    fclose(fp);
+}
+
+struct procmem *procmem_open(pid_t pid)
+{
+    struct procmem *pm = malloc_strict(sizeof(*pm));
+    char path[64];
+
+    memset(pm, 0, sizeof(*pm));
+    pm->pid = pid;
+
+    snprintf(path, sizeof(path), "/proc/%ld/mem", (long) pid);
+    pm->writable = true;
+    if (0 > (pm->fd = open(path, O_RDWR))) {
+        pm->writable = false;
+        if (0 > (pm->fd = open(path, O_RDONLY)))
+            pdie("open");
+    }
+
+    procmem_maps(pm);
+    if (!pm->n)
+        die("no memory mappings");
+
+    pm->cache = malloc_strict(CONFIG_PROCESS_CACHE * sizeof(*pm->cache));
+    for (size_t i = 0; i < CONFIG_PROCESS_CACHE; ++i)
+        pm->cache[i].pos = SIZE_MAX;
+    return pm;
+}
+
+void procmem_free(struct procmem *pm)
+{
+    if (!pm)
+        return;
+    close(pm->fd);
+    for (size_t i = 0; i < pm->n; ++i)
+        free(pm->regions[i].name);
+    free(pm->regions);
+    free(pm->cache);
+    for (size_t i = 0; i < pm->ndirty; ++i)
+        free(pm->dirty[i]);
+    free(pm->dirty);
+    free(pm->stage);
+    free(pm);
+}
+
+/* index of the region containing pos, or else of the first one after it */
+size_t procmem_region(struct procmem const *pm, size_t pos)
+{
+    size_t lo = 0, hi = pm->n, m;
+
+    while (lo < hi) {
+        m = lo + (hi - lo) / 2;
+        if (pm->regions[m].pos + pm->regions[m].len <= pos)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    return lo;
+}
+
+size_t procmem_memory(struct procmem const *pm)
+{
+    return CONFIG_PROCESS_CACHE * sizeof(*pm->cache) + pm->ndirty * sizeof(**pm->dirty);
+}
+
+/* forgets cached pages, so that they are read anew */
+void procmem_drop(struct procmem *pm)
+{
+    for (size_t i = 0; i < CONFIG_PROCESS_CACHE; ++i)
+        pm->cache[i].pos = SIZE_MAX;
+}
+
+/* unreadable parts, such as [vvar], read as zero */
+static void procmem_fetch(struct procmem *pm, struct procmem_page *page, size_t pos)
+{
+    ssize_t r;
+    size_t n = 0;
+
+    page->pos = pos;
+    while (n < PROCMEM_PAGE && 0 < (r = pread(pm->fd, page->data + n, PROCMEM_PAGE - n, pos + n)))
+        n += r;
+    memset(page->data + n, 0, PROCMEM_PAGE - n);
+}
+
+/* index of the first modified page not before pos */
+static size_t procmem_find_dirty(struct procmem const *pm, size_t pos)
+{
+    size_t lo = 0, hi = pm->ndirty, m;
+
+    while (lo < hi) {
+        m = lo + (hi - lo) / 2;
+        if (pm->dirty[m]->pos < pos)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    return lo;
+}
+
+static struct procmem_page *procmem_page(struct procmem *pm, size_t pos)
+{
+    size_t i = procmem_find_dirty(pm, pos);
+    struct procmem_page *page;
+
+    if (i < pm->ndirty && pm->dirty[i]->pos == pos)
+        return pm->dirty[i];
+
+    page = &pm->cache[pos / PROCMEM_PAGE % CONFIG_PROCESS_CACHE];
+    if (page->pos != pos)
+        procmem_fetch(pm, page, pos);
+    return page;
+}
+
+/* the page at pos, moved to the modified ones */
+static struct procmem_page *procmem_dirty_page(struct procmem *pm, size_t pos)
+{
+    size_t i = procmem_find_dirty(pm, pos);
+    struct procmem_page *page, *slot;
+
+    if (i < pm->ndirty && pm->dirty[i]->pos == pos)
+        return pm->dirty[i];
+
+    page = malloc_strict(sizeof(*page));
+    slot = &pm->cache[pos / PROCMEM_PAGE % CONFIG_PROCESS_CACHE];
+    if (slot->pos == pos) {
+        memcpy(page, slot, sizeof(*page));
+        slot->pos = SIZE_MAX;
+    }
+    else
+        procmem_fetch(pm, page, pos);
+
+    if (pm->ndirty == pm->cap)
+        pm->dirty = realloc_strict(pm->dirty, (pm->cap = max(16, 2 * pm->cap)) * sizeof(*pm->dirty));
+    memmove(pm->dirty + i + 1, pm->dirty + i, (pm->ndirty++ - i) * sizeof(*pm->dirty));
+    return pm->dirty[i] = page;
+}
+
+/* the returned bytes stay valid until the next call */
+byte const *procmem_lookup(struct procmem *pm, size_t pos, size_t *len)
+{
+    size_t off = pos % PROCMEM_PAGE;
+
+    if (len)
+        *len = PROCMEM_PAGE - off;
+    return procmem_page(pm, pos - off)->data + off;
+}
+
+static void procmem_read(struct procmem *pm, size_t pos, byte *buf, size_t len)
+{
+    for (size_t i = 0, n; i < len; i += n) {
+        byte const *ptr = procmem_lookup(pm, pos + i, &n);
+        memcpy(buf + i, ptr, n = min(n, len - i));
+    }
+}
+
+byte *procmem_begin_write(struct procmem *pm, size_t pos, size_t len)
+{
+    if (!len || pos / PROCMEM_PAGE == (pos + len - 1) / PROCMEM_PAGE)
+        return procmem_dirty_page(pm, pos / PROCMEM_PAGE * PROCMEM_PAGE)->data + pos % PROCMEM_PAGE;
+
+    pm->stage = realloc_strict(pm->stage, len);
+    procmem_read(pm, pos, pm->stage, len);
+    pm->staged = true;
+    return pm->stage;
+}
+
+void procmem_end_write(struct procmem *pm, size_t pos, size_t len)
+{
+    size_t off, n;
+
+    if (!pm->staged)
+        return;
+    for (size_t i = 0; i < len; i += n) {
+        off = (pos + i) % PROCMEM_PAGE;
+        n = min(PROCMEM_PAGE - off, len - i);
+        memcpy(procmem_dirty_page(pm, pos + i - off)->data + off, pm->stage + i, n);
+    }
+    pm->staged = false;
+}
+
+/* writes [pos, pos + len) to the process; false if some of it could not be written */
+bool procmem_write_back(struct procmem *pm, size_t pos, size_t len)
+{
+    byte const *ptr;
+    ssize_t r;
+
+    if (!pm->writable) {
+        errno = EACCES;
+        return false;
+    }
+
+    for (size_t i = 0, n; i < len; i += n) {
+        ptr = procmem_lookup(pm, pos + i, &n);
+        n = min(n, len - i);
+        if (0 >= (r = pwrite(pm->fd, ptr, n, pos + i)))
+            return false;
+        n = r;
+    }
+    return true;
+}
+
+/* everything was written back: read the process's own copy from now on */
+void procmem_saved(struct procmem *pm)
+{
+    for (size_t i = 0; i < pm->ndirty; ++i)
+        free(pm->dirty[i]);
+    pm->ndirty = 0;
+}
+
@@ -0,0 +1,53 @@
+#ifndef PROCMEM_H
+#define PROCMEM_H
+
+#include "common.h"
+
+#include <sys/types.h>
+
+/* the address space of another process, read and written through /proc/$pid/mem */
+
+#define PROCMEM_PAGE 0x1000
+
+struct procmem_region {
+    size_t pos, len;
+    char perms[5];
+    char *name; /* file or [heap], [stack], ...; empty if anonymous */
+};
+
+struct procmem_page {
+    size_t pos; /* SIZE_MAX if the slot is empty */
+    byte data[PROCMEM_PAGE];
+};
+
+struct procmem {
+    pid_t pid;
+    int fd;
+    bool writable;
+
+    size_t n;
+    struct procmem_region *regions; /* sorted by address */
+
+    struct procmem_page *cache; /* CONFIG_PROCESS_CACHE slots, indexed by page number */
+
+    size_t ndirty, cap;
+    struct procmem_page **dirty; /* modified pages, sorted; kept until written back */
+
+    byte *stage; /* edits spanning several pages are made here */
+    bool staged;
+};
+
+struct procmem *procmem_open(pid_t pid);
+void procmem_free(struct procmem *pm);
+
+size_t procmem_region(struct procmem const *pm, size_t pos);
+size_t procmem_memory(struct procmem const *pm);
+void procmem_drop(struct procmem *pm);
+
+byte const *procmem_lookup(struct procmem *pm, size_t pos, size_t *len);
+byte *procmem_begin_write(struct procmem *pm, size_t pos, size_t len);
+void procmem_end_write(struct procmem *pm, size_t pos, size_t len);
+bool procmem_write_back(struct procmem *pm, size_t pos, size_t len);
+void procmem_saved(struct procmem *pm);
+
+#endif
@@ -0,0 +1,150 @@
+
+#include "common.h"
+#include "ranges.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void ranges_init(struct ranges *rs)
+{
+    memset(rs, 0, sizeof(*rs));
+}
+
+void ranges_free(struct ranges *rs)
+{
+    free(rs->r);
+    ranges_init(rs);
+}
+
+void ranges_clear(struct ranges *rs)
+{
+    rs->n = 0;
+}
+
+static void ranges_make_slot(struct ranges *rs, size_t i)
+{
+    if (rs->n == rs->cap)
+        rs->r = realloc_strict(rs->r, (rs->cap = max(16, 2 * rs->cap)) * sizeof(*rs->r));
+    memmove(rs->r + i + 1, rs->r + i, (rs->n - i) * sizeof(*rs->r));
+    ++rs->n;
+}
+
+/* index of the first range that ends after pos (rs->n if there is none) */
+size_t ranges_find(struct ranges const *rs, size_t pos)
+{
+    size_t lo = 0, hi = rs->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (range_end(&rs->r[mid]) <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool ranges_intersects(struct ranges const *rs, size_t pos, size_t len)
+{
+    size_t i = ranges_find(rs, pos);
+    return len && i < rs->n && rs->r[i].pos < pos + len;
+}
+
+void ranges_add(struct ranges *rs, size_t pos, size_t len)
+{
+    size_t i, j, end = pos + len;
+
+    if (!len)
+        return;
+
+    /* first range touching or following [pos, end) */
+    i = ranges_find(rs, pos ? pos - 1 : 0);
+
+    /* absorb all ranges that overlap or abut the new one */
+    for (j = i; j < rs->n && rs->r[j].pos <= end; ++j) {
+        pos = min(pos, rs->r[j].pos);
+        end = max(end, range_end(&rs->r[j]));
+    }
+
+    if (i == j)
+        ranges_make_slot(rs, i);
+    else {
+        memmove(rs->r + i + 1, rs->r + j, (rs->n - j) * sizeof(*rs->r));
+        rs->n -= j - i - 1;
+    }
+
+    rs->r[i].pos = pos;
+    rs->r[i].len = end - pos;
+}
+
+void ranges_remove(struct ranges *rs, size_t pos, size_t len)
+{
+    size_t i, j, end = pos + len;
+
+    if (!len)
+        return;
+
+    if ((i = ranges_find(rs, pos)) == rs->n)
+        return;
+
+    if (rs->r[i].pos < pos && range_end(&rs->r[i]) > end) {
+        /* split a single range in two */
+        ranges_make_slot(rs, i + 1);
+        rs->r[i + 1].pos = end;
+        rs->r[i + 1].len = range_end(&rs->r[i]) - end;
+        rs->r[i].len = pos - rs->r[i].pos;
+        return;
+    }
+
+    if (rs->r[i].pos < pos) {
+        rs->r[i].len = pos - rs->r[i].pos;
+        ++i;
+    }
+
+    for (j = i; j < rs->n && range_end(&rs->r[j]) <= end; ++j)
+        ;
+    if (j < rs->n && rs->r[j].pos < end) {
+        rs->r[j].len = range_end(&rs->r[j]) - end;
+        rs->r[j].pos = end;
+    }
+
+    memmove(rs->r + i, rs->r + j, (rs->n - j) * sizeof(*rs->r));
+    rs->n -= j - i;
+}
+
+void ranges_insert(struct ranges *rs, size_t pos, size_t len)
+{
+    size_t i = ranges_find(rs, pos);
+
+    if (!len)
+        return;
+
+    if (i < rs->n && rs->r[i].pos < pos) {
+        /* the new bytes split this range */
+        ranges_make_slot(rs, i + 1);
+        rs->r[i + 1].pos = pos;
+        rs->r[i + 1].len = range_end(&rs->r[i]) - pos;
+        rs->r[i].len = pos - rs->r[i].pos;
+        ++i;
+    }
+
+    for (; i < rs->n; ++i)
+        rs->r[i].pos += len;
+}
+
+void ranges_delete(struct ranges *rs, size_t pos, size_t len)
+{
+    size_t i;
+
+    ranges_remove(rs, pos, len);
+
+    for (i = ranges_find(rs, pos); i < rs->n; ++i)
+        rs->r[i].pos -= len;
+
+    /* the ranges around the deleted bytes may now touch */
+    i = ranges_find(rs, pos);
+    if (i && i < rs->n && range_end(&rs->r[i - 1]) == rs->r[i].pos) {
+        rs->r[i - 1].len += rs->r[i].len;
+        memmove(rs->r + i, rs->r + i + 1, (rs->n - i - 1) * sizeof(*rs->r));
+        --rs->n;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef RANGES_H
+#define RANGES_H
+
+#include "common.h"
+
+/* sorted set of disjoint, non-adjacent byte ranges */
+
+struct range {
+    size_t pos, len;
+};
+
+struct ranges {
+    size_t n, cap;
+    struct range *r;
+};
+
+void ranges_init(struct ranges *rs);
+void ranges_free(struct ranges *rs);
+void ranges_clear(struct ranges *rs);
+
+void ranges_add(struct ranges *rs, size_t pos, size_t len);
+void ranges_remove(struct ranges *rs, size_t pos, size_t len);
+
+/* keep ranges in sync with bytes being inserted into or deleted from the underlying data */
+void ranges_insert(struct ranges *rs, size_t pos, size_t len);
+void ranges_delete(struct ranges *rs, size_t pos, size_t len);
+
+size_t ranges_find(struct ranges const *rs, size_t pos);
+bool ranges_intersects(struct ranges const *rs, size_t pos, size_t len);
+
+static inline size_t range_end(struct range const *r)
+    { return r->pos + r->len; }
+
+#endif
@@ -0,0 +1,155 @@
+
+#include "common.h"
+#include "scan.h"
+
+#include <string.h>
+
+#define BLOCK 64 /* bytes compared per iteration of the fast loops */
+
+static inline bool block_is_fill(byte const *ptr, uint64_t pat)
+{
+    uint64_t w[BLOCK / sizeof(uint64_t)], acc = 0;
+    memcpy(w, ptr, sizeof(w));
+    for (size_t k = 0; k < sizeof(w) / sizeof(*w); ++k)
+        acc |= w[k] ^ pat;
+    return !acc;
+}
+
+/* length of the prefix of ptr[0..len) consisting of b only */
+size_t scan_fill(byte const *ptr, size_t len, byte b)
+{
+    uint64_t pat = 0x0101010101010101ull * b;
+    size_t i = 0;
+
+    while (i + BLOCK <= len && block_is_fill(ptr + i, pat))
+        i += BLOCK;
+    while (i < len && ptr[i] == b)
+        ++i;
+    return i;
+}
+
+/* length of the suffix of end[-len..0) consisting of b only */
+size_t scan_fill_back(byte const *end, size_t len, byte b)
+{
+    uint64_t pat = 0x0101010101010101ull * b;
+    size_t i = 0;
+
+    while (i + BLOCK <= len && block_is_fill(end - i - BLOCK, pat))
+        i += BLOCK;
+    while (i < len && end[-(ssize_t) i - 1] == b)
+        ++i;
+    return i;
+}
+
+static inline bool block_equal(byte const *a, byte const *b)
+{
+    uint64_t v[BLOCK / sizeof(uint64_t)], w[BLOCK / sizeof(uint64_t)], acc = 0;
+    memcpy(v, a, sizeof(v));
+    memcpy(w, b, sizeof(w));
+    for (size_t k = 0; k < sizeof(v) / sizeof(*v); ++k)
+        acc |= v[k] ^ w[k];
+    return !acc;
+}
+
+/* length of the common prefix of a[0..len) and b[0..len) */
+size_t scan_diff(byte const *a, byte const *b, size_t len)
+{
+    size_t i = 0;
+
+    while (i + BLOCK <= len && block_equal(a + i, b + i))
+        i += BLOCK;
+    while (i < len && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+/* length of the common suffix of aend[-len..0) and bend[-len..0) */
+size_t scan_diff_back(byte const *aend, byte const *bend, size_t len)
+{
+    size_t i = 0;
+
+    while (i + BLOCK <= len && block_equal(aend - i - BLOCK, bend - i - BLOCK))
+        i += BLOCK;
+    while (i < len && aend[-(ssize_t) i - 1] == bend[-(ssize_t) i - 1])
+        ++i;
+    return i;
+}
+
+/* length of the prefix where a[0..len) and b[0..len) differ in every byte */
+size_t scan_same(byte const *a, byte const *b, size_t len)
+{
+    size_t i = 0;
+    while (i < len && a[i] != b[i])
+        ++i;
+    return i;
+}
+
+size_t scan_same_back(byte const *aend, byte const *bend, size_t len)
+{
+    size_t i = 0;
+    while (i < len && aend[-(ssize_t) i - 1] != bend[-(ssize_t) i - 1])
+        ++i;
+    return i;
+}
+
+/* feeds ptr[0..len) into a run counter: *last is the byte of the current run
+ * and *cnt its length so far. returns the index at which the run reaches
+ * minlen bytes, or len if that doesn't happen in this chunk. */
+size_t scan_run(byte const *ptr, size_t len, byte *last, size_t *cnt, size_t minlen)
+{
+    assert(minlen);
+
+    for (size_t i = 0, k; i < len; i += k) {
+        if (ptr[i] != *last) {
+            *last = ptr[i];
+            *cnt = 0;
+        }
+        k = scan_fill(ptr + i, min(len - i, minlen - *cnt), *last);
+        if ((*cnt += k) >= minlen)
+            return i + k - 1;
+    }
+    return len;
+}
+
+/* high bit of each byte of w set where that byte is printable */
+static inline uint64_t word_printable(uint64_t w)
+{
+    uint64_t const ones = 0x0101010101010101ull, high = 0x8080808080808080ull;
+    uint64_t low = w & ~high, tab = w ^ '\t' * ones;
+
+    /* 0x20 <= low < 0x7f without carries between bytes; bytes >= 0x80 are out */
+    uint64_t print = (low + 0x60 * ones) & ~(low + ones) & ~w;
+    /* exact zero test on w ^ tabs */
+    tab = ~(((tab & ~high) + ~high) | tab);
+    return (print | tab) & high;
+}
+
+/* index of the first byte of w, in memory order, with its high bit set */
+static inline unsigned first_high(uint64_t m)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(m) / 8;
+#else
+    return __builtin_ctzll(m) / 8;
+#endif
+}
+
+/* length of the prefix of ptr[0..len) that is printable ascii (or tabs) if want, else of the rest */
+size_t scan_printable(byte const *ptr, size_t len, bool want)
+{
+    uint64_t const high = 0x8080808080808080ull;
+    uint64_t w, stop;
+    size_t i = 0;
+
+    for (; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, ptr + i, sizeof(w));
+        stop = word_printable(w) ^ (want ? high : 0);
+        if (stop)
+            return i + first_high(stop);
+    }
+    while (i < len && is_printable(ptr[i]) == want)
+        ++i;
+    return i;
+}
+
+#undef BLOCK
@@ -0,0 +1,21 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "common.h"
+
+/* word-at-a-time kernels over contiguous memory */
+
+size_t scan_fill(byte const *ptr, size_t len, byte b);
+size_t scan_fill_back(byte const *end, size_t len, byte b);
+size_t scan_diff(byte const *a, byte const *b, size_t len);
+size_t scan_diff_back(byte const *aend, byte const *bend, size_t len);
+size_t scan_same(byte const *a, byte const *b, size_t len);
+size_t scan_same_back(byte const *aend, byte const *bend, size_t len);
+size_t scan_printable(byte const *ptr, size_t len, bool want);
+size_t scan_run(byte const *ptr, size_t len, byte *last, size_t *cnt, size_t minlen);
+
+/* what strings(1) considers text */
+static inline bool is_printable(byte b)
+    { return (b >= 0x20 && b < 0x7f) || b == '\t'; }
+
+#endif
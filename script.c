@@ -0,0 +1,426 @@
+
+#include "common.h"
+#include "blob.h"
+#include "script.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+/*
+ * Non-interactive editing: every file given on the command line is
+ * patched by the same script, one process per file so that a fatal
+ * error (which calls die()) only affects that file.
+ *
+ * One command per line; '#' starts a comment. Byte strings are given
+ * as hex digits or "quoted strings"; several of them are concatenated.
+ *
+ *     goto $offset | +$n | -$n | end
+ *     write $bytes...              replace bytes at the cursor
+ *     insert $bytes...             insert bytes at the cursor
+ *     delete $n                    delete bytes at the cursor
+ *     search $bytes...             move to the next match (error if none)
+ *     replace $bytes $bytes        replace all matches after the cursor
+ *     save [$filename]
+ */
+
+enum script_op {
+    SCRIPT_GOTO,
+    SCRIPT_WRITE,
+    SCRIPT_INSERT,
+    SCRIPT_DELETE,
+    SCRIPT_SEARCH,
+    SCRIPT_REPLACE,
+    SCRIPT_SAVE,
+};
+
+struct script_cmd {
+    enum script_op op;
+    unsigned line;
+
+    enum { SCRIPT_ABS, SCRIPT_FWD, SCRIPT_BACK, SCRIPT_END } whence;
+    size_t n;
+
+    byte *data, *repl;
+    size_t len, repl_len;
+
+    char *filename;
+};
+
+struct script {
+    char const *name;
+    size_t n;
+    struct script_cmd *cmds;
+};
+
+static void script_error(struct script const *script, unsigned line, char const *msg)
+{
+    fprintf(stderr, "%s:%u: %s\n", script->name, line, msg);
+    exit(EXIT_FAILURE);
+}
+
+/* parses one hex or quoted token at *p; returns false at the end of the line */
+static bool parse_token(char **p, byte **buf, size_t *len, bool *ok)
+{
+    char *q = *p;
+    byte *tmp;
+    size_t n;
+
+    while (isspace(*q)) ++q;
+    if (!*q || *q == '#')
+        return false;
+
+    *ok = true;
+    *buf = realloc_strict(*buf, *len + strlen(q) + 1);
+
+    if (*q == '"') {
+        for (++q; *q && *q != '"'; ++q) {
+            if (*q == '\\') {
+                switch (*++q) {
+                case 'n': (*buf)[(*len)++] = '\n'; break;
+                case 't': (*buf)[(*len)++] = '\t'; break;
+                case '0': (*buf)[(*len)++] = '\0'; break;
+                case '\\': case '"': (*buf)[(*len)++] = *q; break;
+                case 'x':
+                    if (!isxdigit(q[1]) || !isxdigit(q[2]))
+                        return *ok = false;
+                    {
+                        char hex[3] = {q[1], q[2], 0};
+                        (*buf)[(*len)++] = strtoul(hex, NULL, 16);
+                    }
+                    q += 2;
+                    break;
+                default:
+                    return *ok = false;
+                }
+            }
+            else
+                (*buf)[(*len)++] = *q;
+        }
+        if (*q++ != '"')
+            return *ok = false;
+    }
+    else {
+        char *end = q, save;
+        while (*end && !isspace(*end) && *end != '#') ++end;
+        save = *end;
+        *end = 0;
+        if (!(n = unhex(&tmp, q))) {
+            *end = save;
+            return *ok = false;
+        }
+        memcpy(*buf + *len, tmp, n);
+        *len += n;
+        free(tmp);
+        *end = save;
+        q = end;
+    }
+
+    *p = q;
+    return true;
+}
+
+static size_t parse_bytes(struct script const *script, unsigned line, char **p, byte **buf, bool single)
+{
+    size_t len = 0;
+    bool ok = true;
+
+    *buf = NULL;
+    while (parse_token(p, buf, &len, &ok) && !single)
+        ;
+    if (!ok)
+        script_error(script, line, "invalid byte string");
+    if (!len)
+        script_error(script, line, "expected a byte string");
+    return len;
+}
+
+static void parse_end(struct script const *script, unsigned line, char *p)
+{
+    while (isspace(*p)) ++p;
+    if (*p && *p != '#')
+        script_error(script, line, "trailing garbage");
+}
+
+static void script_parse(struct script *script, char const *filename)
+{
+    char buf[0x1000], *p, *word, *end;
+    unsigned line = 0;
+    FILE *fp;
+
+    memset(script, 0, sizeof(*script));
+    script->name = filename;
+
+    if (!(fp = fopen(filename, "r")))
+        pdie("fopen");
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        struct script_cmd cmd;
+
+        ++line;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.line = line;
+
+        if ((p = strchr(buf, '\n')))
+            *p = 0;
+        for (p = buf; isspace(*p); ++p);
+        if (!*p || *p == '#')
+            continue;
+
+        for (word = p; *p && !isspace(*p); ++p);
+        if (*p)
+            *p++ = 0;
+
+        if (!strcmp(word, "goto")) {
+            cmd.op = SCRIPT_GOTO;
+            while (isspace(*p)) ++p;
+            if (!strncmp(p, "end", 3)) {
+                cmd.whence = SCRIPT_END;
+                p += 3;
+            }
+            else {
+                cmd.whence = *p == '+' ? SCRIPT_FWD : *p == '-' ? SCRIPT_BACK : SCRIPT_ABS;
+                p += cmd.whence != SCRIPT_ABS;
+                if (!isdigit(*p))
+                    script_error(script, line, "expected an offset");
+                cmd.n = strtoull(p, &end, 0);
+                p = end;
+            }
+            parse_end(script, line, p);
+        }
+        else if (!strcmp(word, "write") || !strcmp(word, "insert") || !strcmp(word, "search")) {
+            cmd.op = *word == 'w' ? SCRIPT_WRITE : *word == 'i' ? SCRIPT_INSERT : SCRIPT_SEARCH;
+            cmd.len = parse_bytes(script, line, &p, &cmd.data, false);
+        }
+        else if (!strcmp(word, "delete")) {
+            cmd.op = SCRIPT_DELETE;
+            while (isspace(*p)) ++p;
+            if (!isdigit(*p))
+                script_error(script, line, "expected a length");
+            cmd.n = strtoull(p, &end, 0);
+            parse_end(script, line, end);
+        }
+        else if (!strcmp(word, "replace")) {
+            cmd.op = SCRIPT_REPLACE;
+            cmd.len = parse_bytes(script, line, &p, &cmd.data, true);
+            cmd.repl_len = parse_bytes(script, line, &p, &cmd.repl, true);
+            parse_end(script, line, p);
+        }
+        else if (!strcmp(word, "save")) {
+            cmd.op = SCRIPT_SAVE;
+            while (isspace(*p)) ++p;
+            if (*p)
+                cmd.filename = strdup(p);
+        }
+        else
+            script_error(script, line, "unknown command");
+
+        script->cmds = realloc_strict(script->cmds, (script->n + 1) * sizeof(*script->cmds));
+        script->cmds[script->n++] = cmd;
+    }
+
+    if (ferror(fp))
+        pdie("fgets");
+    fclose(fp);
+}
+
+static void script_free(struct script *script)
+{
+    for (size_t i = 0; i < script->n; ++i) {
+        free(script->cmds[i].data);
+        free(script->cmds[i].repl);
+        free(script->cmds[i].filename);
+    }
+    free(script->cmds);
+}
+
+static void file_error(char const *filename, struct script_cmd const *cmd, char const *msg)
+{
+    fprintf(stderr, "%s: line %u: %s\n", filename, cmd->line, msg);
+    exit(EXIT_FAILURE);
+}
+
+/* runs the script on one file; returns the number of bytes changed */
+static size_t script_run(struct script const *script, char const *filename)
+{
+    struct blob blob;
+    struct clipboard clipboard = {0};
+    size_t cur = 0, changed = 0;
+    ssize_t pos;
+
+    blob_init(&blob);
+    blob.clipboard = &clipboard;
+    blob_load(&blob, filename);
+
+    for (size_t i = 0; i < script->n; ++i) {
+        struct script_cmd const *cmd = &script->cmds[i];
+
+        switch (cmd->op) {
+
+        case SCRIPT_GOTO:
+            switch (cmd->whence) {
+            case SCRIPT_ABS:  pos = cmd->n; break;
+            case SCRIPT_FWD:  pos = cur + cmd->n; break;
+            case SCRIPT_BACK: pos = cur - cmd->n; break;
+            case SCRIPT_END:  pos = blob_length(&blob); break;
+            default: die("bad offset");
+            }
+            if (pos < 0 || (size_t) pos > blob_length(&blob))
+                file_error(filename, cmd, "offset out of range");
+            cur = pos;
+            break;
+
+        case SCRIPT_WRITE:
+            if (cur + cmd->len > blob_length(&blob)) {
+                if (!blob_can_move(&blob))
+                    file_error(filename, cmd, "can't extend: file is memory-mapped");
+                blob_insert(&blob, blob_length(&blob), cmd->data, cur + cmd->len - blob_length(&blob), false);
+            }
+            blob_replace(&blob, cur, cmd->data, cmd->len, false);
+            cur += cmd->len;
+            changed += cmd->len;
+            break;
+
+        case SCRIPT_INSERT:
+            if (!blob_can_move(&blob))
+                file_error(filename, cmd, "can't insert: file is memory-mapped");
+            blob_insert(&blob, cur, cmd->data, cmd->len, false);
+            cur += cmd->len;
+            changed += cmd->len;
+            break;
+
+        case SCRIPT_DELETE:
+            if (!blob_can_move(&blob))
+                file_error(filename, cmd, "can't delete: file is memory-mapped");
+            if (cur + cmd->n > blob_length(&blob))
+                file_error(filename, cmd, "deleting past the end of the file");
+            if (cmd->n)
+                blob_delete(&blob, cur, cmd->n, false);
+            changed += cmd->n;
+            break;
+
+        case SCRIPT_SEARCH:
+            /* no wrapping around here */
+            if (cur >= blob_length(&blob)
+                    || 0 > (pos = blob_search(&blob, cmd->data, cmd->len, cur, +1))
+                    || (size_t) pos < cur)
+                file_error(filename, cmd, "pattern not found");
+            cur = pos;
+            break;
+
+        case SCRIPT_REPLACE:
+            if (cmd->len != cmd->repl_len && !blob_can_move(&blob))
+                file_error(filename, cmd, "can't resize: file is memory-mapped");
+            while (cur < blob_length(&blob)
+                    && 0 <= (pos = blob_search(&blob, cmd->data, cmd->len, cur, +1))
+                    && (size_t) pos >= cur) {
+                if (cmd->len == cmd->repl_len)
+                    blob_replace(&blob, pos, cmd->repl, cmd->repl_len, false);
+                else {
+                    blob_delete(&blob, pos, cmd->len, false);
+                    blob_insert(&blob, pos, cmd->repl, cmd->repl_len, false);
+                }
+                cur = pos + cmd->repl_len;
+                changed += max(cmd->len, cmd->repl_len);
+            }
+            break;
+
+        case SCRIPT_SAVE:
+            switch (blob_save(&blob, cmd->filename)) {
+            case BLOB_SAVE_OK:
+                break;
+            case BLOB_SAVE_FILENAME:
+                file_error(filename, cmd, "can't save: no filename");
+                break;
+            case BLOB_SAVE_NONEXISTENT:
+                file_error(filename, cmd, "can't save: nonexistent path");
+                break;
+            case BLOB_SAVE_PERMISSIONS:
+                file_error(filename, cmd, "can't save: insufficient permissions");
+                break;
+            case BLOB_SAVE_BUSY:
+                file_error(filename, cmd, "can't save: file is busy");
+                break;
+            case BLOB_SAVE_PROCESS:
+            case BLOB_SAVE_FAULT:
+                file_error(filename, cmd, "can't save to process memory");
+                break;
+            case BLOB_SAVE_CHANGED:
+                file_error(filename, cmd, "can't save: file was changed by someone else");
+                break;
+            case BLOB_SAVE_PENDING:
+                file_error(filename, cmd, "can't save: still saving");
+                break;
+            case BLOB_SAVE_WRITE:
+                file_error(filename, cmd, "can't save: write failed");
+                break;
+            default:
+                die("can't save: unknown error");
+            }
+            break;
+
+        default:
+            die("unknown script command");
+        }
+    }
+
+    blob_free(&blob);
+    free(clipboard.data);
+
+    return changed;
+}
+
+static void script_child(struct script const *script, char const *filename)
+{
+    uint64_t t = monotonic_microtime();
+    size_t changed = script_run(script, filename);
+    t = monotonic_microtime() - t;
+
+    printf("%s: %zu bytes changed in %llu.%06llu s\n", filename, changed,
+            (unsigned long long) t / 1000000, (unsigned long long) t % 1000000);
+    fflush(stdout);
+    exit(EXIT_SUCCESS);
+}
+
+int script_main(char const *filename, char **files, size_t nfiles, unsigned jobs)
+{
+    struct script script;
+    size_t next = 0, running = 0, failed = 0;
+    int status;
+    pid_t pid;
+
+    script_parse(&script, filename);
+
+    if (!jobs)
+        jobs = 1;
+
+    while (next < nfiles || running) {
+
+        if (next < nfiles && running < jobs) {
+            if (0 > (pid = fork()))
+                pdie("fork");
+            if (!pid)
+                script_child(&script, files[next]);
+            ++next;
+            ++running;
+            continue;
+        }
+
+        if (0 > (pid = wait(&status))) {
+            if (errno == EINTR)
+                continue;
+            pdie("wait");
+        }
+        --running;
+        failed += !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+
+    script_free(&script);
+
+    if (failed)
+        fprintf(stderr, "%zu of %zu files failed.\n", failed, nfiles);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
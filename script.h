@@ -0,0 +1,8 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "common.h"
+
+int script_main(char const *script, char **files, size_t nfiles, unsigned jobs);
+
+#endif
@@ -0,0 +1,305 @@
+
+#include "common.h"
+#include "snap.h"
+#include "blob.h"
+#include "scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* granularity of saved data: a page is copied on its first write after a mark */
+#define SNAP_PAGE 0x1000
+
+void snap_init(struct snapshots *snaps)
+{
+    memset(snaps, 0, sizeof(*snaps));
+}
+
+static void layer_free_data(struct snapshots *snaps, struct snap_layer *L)
+{
+    for (size_t i = 0; i < L->n; ++i) {
+        snaps->mem -= L->ext[i].len;
+        free(L->ext[i].data);
+    }
+    free(L->ext);
+    L->ext = NULL;
+    L->n = L->cap = 0;
+    ranges_free(&L->saved);
+}
+
+static void layer_free(struct snapshots *snaps, struct snap_layer *L)
+{
+    layer_free_data(snaps, L);
+    if (L->imaged)
+        snaps->mem -= L->image_len;
+    free(L->image);
+    free(L->name);
+}
+
+void snap_free(struct snapshots *snaps)
+{
+    for (size_t i = 0; i < snaps->n; ++i)
+        layer_free(snaps, &snaps->layers[i]);
+    free(snaps->layers);
+    snap_init(snaps);
+}
+
+static void layer_push(struct snapshots *snaps, struct snap_layer *L, size_t pos, size_t len, byte *data)
+{
+    if (L->n == L->cap)
+        L->ext = realloc_strict(L->ext, (L->cap = max(16, 2 * L->cap)) * sizeof(*L->ext));
+    L->ext[L->n].pos = pos;
+    L->ext[L->n].len = len;
+    L->ext[L->n].data = data;
+    ++L->n;
+    snaps->mem += len;
+}
+
+/* calls f for each part of [pos, pos + len) that is not in rs */
+static void each_gap(struct ranges const *rs, size_t pos, size_t len,
+        void (*f)(void *, size_t, size_t), void *arg)
+{
+    size_t end = pos + len;
+    for (size_t i = ranges_find(rs, pos); pos < end; ++i) {
+        size_t to = i < rs->n ? min(end, rs->r[i].pos) : end;
+        if (to > pos)
+            f(arg, pos, to - pos);
+        if (i >= rs->n)
+            break;
+        pos = max(pos, range_end(&rs->r[i]));
+    }
+}
+
+struct save_ctx {
+    struct blob *blob;
+    struct snap_layer *L;
+};
+
+static void save_gap(void *arg, size_t pos, size_t len)
+{
+    struct save_ctx *ctx = arg;
+    byte *data = malloc_strict(len);
+    blob_read_strict(ctx->blob, pos, data, len);
+    layer_push(&ctx->blob->snaps, ctx->L, pos, len, data);
+}
+
+/* keeps what [pos, pos + len) looks like in the latest marked state */
+void snap_before_replace(struct blob *blob, size_t pos, size_t len)
+{
+    struct snapshots *snaps = &blob->snaps;
+    struct save_ctx ctx = {blob, NULL};
+    size_t from, to;
+
+    if (!snaps->n || !len)
+        return;
+    ctx.L = &snaps->layers[snaps->n - 1];
+    if (ctx.L->imaged)
+        return;
+
+    from = pos / SNAP_PAGE * SNAP_PAGE;
+    to = min(blob_length(blob), (pos + len + SNAP_PAGE - 1) / SNAP_PAGE * SNAP_PAGE);
+    each_gap(&ctx.L->saved, from, to - from, save_gap, &ctx);
+    ranges_add(&ctx.L->saved, from, to - from);
+}
+
+static void overlay(byte *image, struct snap_layer const *L)
+{
+    for (size_t i = 0; i < L->n; ++i)
+        memcpy(image + L->ext[i].pos, L->ext[i].data, L->ext[i].len);
+}
+
+/* offsets are about to shift, so the latest marked state is kept whole */
+void snap_before_move(struct blob *blob)
+{
+    struct snapshots *snaps = &blob->snaps;
+    struct snap_layer *L;
+
+    if (!snaps->n || (L = &snaps->layers[snaps->n - 1])->imaged)
+        return;
+
+    L->image_len = blob_length(blob);
+    L->image = malloc_strict(L->image_len);
+    if (L->image_len)
+        blob_read_strict(blob, 0, L->image, L->image_len);
+    overlay(L->image, L);
+    layer_free_data(snaps, L);
+    L->imaged = true;
+    snaps->mem += L->image_len;
+}
+
+static ssize_t snap_find(struct snapshots const *snaps, char const *name)
+{
+    for (size_t i = 0; i < snaps->n; ++i)
+        if (!strcmp(snaps->layers[i].name, name))
+            return i;
+    return -1;
+}
+
+void snap_mark(struct blob *blob, char const *name)
+{
+    struct snapshots *snaps = &blob->snaps;
+    struct snap_layer *L;
+
+    snap_drop(blob, name);
+
+    if (snaps->n == snaps->cap)
+        snaps->layers = realloc_strict(snaps->layers, (snaps->cap = max(4, 2 * snaps->cap)) * sizeof(*snaps->layers));
+    L = &snaps->layers[snaps->n++];
+    memset(L, 0, sizeof(*L));
+    L->name = strdup(name);
+    ranges_init(&L->saved);
+}
+
+struct merge_ctx {
+    struct snapshots *snaps;
+    struct snap_layer *to;
+    struct snap_extent const *e;
+};
+
+static void merge_gap(void *arg, size_t pos, size_t len)
+{
+    struct merge_ctx *ctx = arg;
+    byte *data = malloc_strict(len);
+    memcpy(data, ctx->e->data + (pos - ctx->e->pos), len);
+    layer_push(ctx->snaps, ctx->to, pos, len, data);
+}
+
+/* folds the data of L into the layer before it, which may still need it */
+static void layer_merge(struct snapshots *snaps, struct snap_layer *prev, struct snap_layer *L)
+{
+    struct merge_ctx ctx = {snaps, prev, NULL};
+
+    if (L->imaged) {
+        overlay(L->image, prev);
+        layer_free_data(snaps, prev);
+        prev->imaged = true;
+        prev->image = L->image;
+        prev->image_len = L->image_len;
+        L->imaged = false;
+        L->image = NULL;
+        return;
+    }
+
+    for (size_t i = 0; i < L->n; ++i) {
+        ctx.e = &L->ext[i];
+        each_gap(&prev->saved, ctx.e->pos, ctx.e->len, merge_gap, &ctx);
+    }
+    for (size_t i = 0; i < L->saved.n; ++i)
+        ranges_add(&prev->saved, L->saved.r[i].pos, L->saved.r[i].len);
+}
+
+bool snap_drop(struct blob *blob, char const *name)
+{
+    struct snapshots *snaps = &blob->snaps;
+    ssize_t i;
+
+    if ((i = snap_find(snaps, name)) < 0)
+        return false;
+
+    if (i && !snaps->layers[i - 1].imaged)
+        layer_merge(snaps, &snaps->layers[i - 1], &snaps->layers[i]);
+    layer_free(snaps, &snaps->layers[i]);
+
+    memmove(snaps->layers + i, snaps->layers + i + 1, (snaps->n - i - 1) * sizeof(*snaps->layers));
+    --snaps->n;
+    return true;
+}
+
+size_t snap_extents(struct snapshots const *snaps)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < snaps->n; ++i)
+        n += snaps->layers[i].n + snaps->layers[i].imaged;
+    return n;
+}
+
+struct pieces {
+    size_t n, cap;
+    struct snap_extent *p; /* data is borrowed from the layers */
+    struct snap_extent const *e;
+};
+
+static void piece_gap(void *arg, size_t pos, size_t len)
+{
+    struct pieces *ps = arg;
+    if (ps->n == ps->cap)
+        ps->p = realloc_strict(ps->p, (ps->cap = max(64, 2 * ps->cap)) * sizeof(*ps->p));
+    ps->p[ps->n].pos = pos;
+    ps->p[ps->n].len = len;
+    ps->p[ps->n].data = ps->e->data + (pos - ps->e->pos);
+    ++ps->n;
+}
+
+/* replaces the parts of [pos, pos + len) that differ from data */
+static void restore_range(struct blob *blob, size_t pos, byte const *data, size_t len)
+{
+    byte const *ptr;
+    for (size_t n, off, end; len; pos += n, data += n, len -= n) {
+        ptr = blob_lookup(blob, pos, &n);
+        n = min(n, len);
+        for (off = 0; off < n; off = end) {
+            off += scan_diff(ptr + off, data + off, n - off);
+            for (end = off; end < n && ptr[end] != data[end]; )
+                end = min(n, (end + SNAP_PAGE) / SNAP_PAGE * SNAP_PAGE);
+            if (end > off)
+                blob_replace(blob, pos + off, data + off, end - off, true);
+        }
+    }
+}
+
+/* brings back the marked state as a single undo step */
+bool snap_restore(struct blob *blob, char const *name)
+{
+    struct snapshots *snaps = &blob->snaps;
+    struct snap_layer const *L, *image = NULL;
+    struct ranges done;
+    struct pieces ps = {0};
+    ssize_t k;
+
+    if ((k = snap_find(snaps, name)) < 0)
+        return false;
+
+    /* each byte comes from the oldest layer since the mark that saved it */
+    ranges_init(&done);
+    for (size_t i = k; i < snaps->n && !image; ++i) {
+        L = &snaps->layers[i];
+        if (L->imaged) {
+            image = L;
+            break;
+        }
+        for (size_t j = 0; j < L->n; ++j) {
+            ps.e = &L->ext[j];
+            each_gap(&done, ps.e->pos, ps.e->len, piece_gap, &ps);
+        }
+        for (size_t j = 0; j < L->saved.n; ++j)
+            ranges_add(&done, L->saved.r[j].pos, L->saved.r[j].len);
+    }
+    ranges_free(&done);
+
+    blob_batch_begin(blob);
+    if (image) {
+        size_t len = image->image_len, cur = blob_length(blob);
+        byte *state = malloc_strict(len);
+        memcpy(state, image->image, len);
+        for (size_t i = 0; i < ps.n; ++i)
+            memcpy(state + ps.p[i].pos, ps.p[i].data, ps.p[i].len);
+        free(ps.p);
+        ps.p = NULL;
+
+        restore_range(blob, 0, state, min(len, cur));
+        if (len > cur)
+            blob_insert(blob, cur, state + cur, len - cur, true);
+        else if (len < cur)
+            blob_delete(blob, len, cur - len, true);
+        free(state);
+    }
+    else {
+        for (size_t i = 0; i < ps.n; ++i)
+            restore_range(blob, ps.p[i].pos, ps.p[i].data, ps.p[i].len);
+    }
+    blob_batch_end(blob);
+
+    free(ps.p);
+    return true;
+}
+
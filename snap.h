@@ -0,0 +1,44 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+#include "common.h"
+#include "ranges.h"
+
+struct blob;
+
+/* bytes saved from the blob before they were first overwritten */
+struct snap_extent {
+    size_t pos, len;
+    byte *data;
+};
+
+/* everything needed to go back to one named state, on top of what the
+ * later layers saved */
+struct snap_layer {
+    char *name;
+    struct ranges saved;
+    size_t n, cap;
+    struct snap_extent *ext;
+    bool imaged; /* content moved after this state, so image holds all of it */
+    byte *image;
+    size_t image_len;
+};
+
+struct snapshots {
+    size_t n, cap;
+    struct snap_layer *layers;
+    size_t mem; /* bytes of saved data */
+};
+
+void snap_init(struct snapshots *snaps);
+void snap_free(struct snapshots *snaps);
+
+void snap_before_replace(struct blob *blob, size_t pos, size_t len);
+void snap_before_move(struct blob *blob);
+
+void snap_mark(struct blob *blob, char const *name);
+bool snap_restore(struct blob *blob, char const *name);
+bool snap_drop(struct blob *blob, char const *name);
+size_t snap_extents(struct snapshots const *snaps);
+
+#endif
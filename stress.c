@@ -0,0 +1,137 @@
+
+/*
+ * Stress test of the worker pool: hashing jobs run while the main thread
+ * keeps editing the blob they read.  A job that isn't cancelled must have
+ * hashed the blob exactly as it was when the job was submitted, since any
+ * edit after that cancels it first.  Build and run it with "make stress",
+ * which uses -fsanitize=thread to catch data races as well.
+ */
+
+#include "common.h"
+#include "blob.h"
+#include "hash.h"
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#define STRESS_ROUNDS 1000
+#define STRESS_SIZE (1 << 18)
+
+jmp_buf jmp_mainloop;
+
+void die(char const *s)
+{
+    fprintf(stderr, "%s\n", s);
+    exit(EXIT_FAILURE);
+}
+
+void pdie(char const *s)
+{
+    perror(s);
+    exit(EXIT_FAILURE);
+}
+
+struct stress_job {
+    size_t from, to;
+    byte expected[HASH_MAX_SIZE];
+    byte digest[HASH_MAX_SIZE];
+};
+
+static size_t finished, cancelled;
+
+static bool stress_run(struct job *job)
+{
+    struct stress_job *S = job->arg;
+    return hash_blob(job->blob, S->from, S->to, HASH_XXH64, S->digest, job_progress, job);
+}
+
+static void stress_finish(struct job *job)
+{
+    struct stress_job *S = job->arg;
+
+    if (!job->ok) {
+        ++cancelled;
+        return;
+    }
+    if (memcmp(S->digest, S->expected, hash_size(HASH_XXH64)))
+        die("a job saw the blob change under it");
+    ++finished;
+}
+
+static void stress_submit(struct blob *blob)
+{
+    struct stress_job *S = malloc_strict(sizeof(*S));
+    size_t len = blob_length(blob);
+
+    S->from = len ? rand() % len : 0;
+    S->to = S->from + (len - S->from ? rand() % (len - S->from) + 1 : 0);
+    hash_blob(blob, S->from, S->to, HASH_XXH64, S->expected, NULL, NULL);
+    jobs_submit(job_new("stress", blob, stress_run, stress_finish, S));
+}
+
+static void stress_edit(struct blob *blob)
+{
+    byte data[0x100];
+    size_t len = blob_length(blob), n = rand() % sizeof(data) + 1;
+    size_t pos = rand() % (len - n);
+
+    for (size_t i = 0; i < n; ++i)
+        data[i] = rand();
+
+    switch (rand() % 4) {
+    case 0:
+        blob_insert(blob, pos, data, n, rand() % 2);
+        break;
+    case 1:
+        blob_delete(blob, pos, n, rand() % 2);
+        break;
+    case 2:
+        /* nothing changes, but the jobs must still stop */
+        jobs_quiesce(blob);
+        break;
+    default:
+        blob_replace(blob, pos, data, n, rand() % 2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct blob blob;
+    struct clipboard clip = {0};
+    FILE *fp;
+    unsigned seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+
+    srand(seed);
+
+    if (!(fp = tmpfile()))
+        pdie("tmpfile");
+    for (size_t i = 0; i < STRESS_SIZE; ++i)
+        putc(rand(), fp);
+    rewind(fp);
+
+    blob_init(&blob);
+    blob.clipboard = &clip;
+    blob_load_stream(&blob, fp);
+    fclose(fp);
+
+    for (size_t i = 0; i < STRESS_ROUNDS; ++i) {
+        for (int j = rand() % 4; j >= 0; --j)
+            stress_submit(&blob);
+        /* give some of them the time to finish */
+        if (rand() % 3 == 0)
+            usleep(rand() % 2000);
+        jobs_deliver();
+        stress_edit(&blob);
+    }
+
+    stress_submit(&blob);
+    jobs_shutdown();
+    blob_free(&blob);
+    free(clip.data);
+
+    printf("%zu jobs finished, %zu cancelled (seed %u)\n", finished, cancelled, seed);
+    return EXIT_SUCCESS;
+}
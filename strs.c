@@ -0,0 +1,272 @@
+
+#include "common.h"
+#include "strs.h"
+#include "scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STRS_CHUNK (16 * (1 << 20)) /* bytes per thread between progress reports */
+
+
+bool strs_lookup_enc(char const *name, enum strs_enc *enc)
+{
+    static char const *const names[] = {"ascii", "utf16le", "utf16be"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); ++i) {
+        if (!strcmp(name, names[i])) {
+            *enc = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void strs_init(struct strs *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void strs_free(struct strs *s)
+{
+    free(s->r);
+    strs_init(s);
+}
+
+static void strs_push(struct strs *s, size_t pos, size_t len)
+{
+    if (s->n == s->cap)
+        s->r = realloc_strict(s->r, (s->cap = max(64, 2 * s->cap)) * sizeof(*s->r));
+    s->r[s->n].pos = pos;
+    s->r[s->n].len = len;
+    ++s->n;
+}
+
+static size_t unit_size(enum strs_enc enc)
+{
+    return enc == STRS_ASCII ? 1 : 2;
+}
+
+static bool unit_printable(enum strs_enc enc, byte const *p)
+{
+    switch (enc) {
+    case STRS_UTF16LE: return is_printable(p[0]) && !p[1];
+    case STRS_UTF16BE: return !p[0] && is_printable(p[1]);
+    default: return is_printable(p[0]);
+    }
+}
+
+struct strs_job {
+    struct blob const *blob;
+    enum strs_enc enc;
+    size_t minlen, from, pos, len, to;
+    struct strs found;
+    struct {
+        byte const *ptr;
+        size_t pos, end;
+    } span; /* the last span returned by blob_lookup() */
+};
+
+/* like blob_lookup(), but cheap for the many short runs of random data */
+static inline byte const *job_lookup(struct strs_job *job, size_t pos, size_t *len)
+{
+    if (pos < job->span.pos || pos >= job->span.end) {
+        job->span.ptr = blob_lookup(job->blob, pos, len);
+        job->span.pos = pos;
+        job->span.end = pos + *len;
+    }
+    *len = job->span.end - pos;
+    return job->span.ptr + (pos - job->span.pos);
+}
+
+/* whether a printable unit starts at pos; it must end before to */
+static bool printable_at(struct blob const *blob, enum strs_enc enc, size_t pos, size_t to)
+{
+    byte unit[2];
+
+    if (pos + unit_size(enc) > to)
+        return false;
+    for (size_t k = 0; k < unit_size(enc); ++k)
+        unit[k] = blob_at(blob, pos + k);
+    return unit_printable(enc, unit);
+}
+
+/* the first offset in [pos, end) at which a printable unit starts, or end */
+static size_t next_start(struct strs_job *job, size_t pos, size_t end)
+{
+    enum strs_enc enc = job->enc;
+    byte const *ptr;
+    size_t n, k;
+
+    while (pos < end) {
+        ptr = job_lookup(job, pos, &n);
+        n = min(n, end - pos);
+        if (enc == STRS_ASCII)
+            k = scan_printable(ptr, n, false);
+        else
+            for (k = 0; k + 1 < n && !unit_printable(enc, ptr + k); ++k);
+        if (k < n && (enc == STRS_ASCII || k + 1 < n || printable_at(job->blob, enc, pos + k, job->to)))
+            return pos + k;
+        pos += n;
+    }
+    return end;
+}
+
+/* the offset of the first unit from pos on, in steps of units, that isn't printable */
+static size_t run_end(struct strs_job *job, size_t pos)
+{
+    enum strs_enc enc = job->enc;
+    size_t u = unit_size(enc), to = job->to, n, k;
+    byte const *ptr;
+
+    while (pos + u <= to) {
+        ptr = job_lookup(job, pos, &n);
+        n = min(n, to - pos);
+        if (n < u) {
+            /* a unit split between spans */
+            if (!printable_at(job->blob, enc, pos, to))
+                break;
+            pos += u;
+            continue;
+        }
+        if (enc == STRS_ASCII)
+            k = scan_printable(ptr, n, true);
+        else
+            for (k = 0; k + 2 <= n && unit_printable(enc, ptr + k); k += 2);
+        pos += k;
+        if (k < n / u * u)
+            break;
+    }
+    return pos;
+}
+
+/* finds the strings starting in [pos, pos + len); they may run on up to to */
+static void *strs_thread(void *arg)
+{
+    struct strs_job *job = arg;
+    size_t u = unit_size(job->enc), i = job->pos, end = job->pos + job->len, start;
+
+    /* a string running into this chunk belongs to the one before. for utf-16,
+     * pos can be inside a unit, but not both that and inside a string at its
+     * own alignment, since a printable unit has a zero byte next to its char */
+    for (size_t back = 1; back <= u; ++back) {
+        if (i >= job->from + back && printable_at(job->blob, job->enc, i - back, job->to)) {
+            i = run_end(job, i - back) + 1;
+            break;
+        }
+    }
+
+    /* like strings(1), look for the next one right after the unit that ended a string */
+    while ((i = next_start(job, i, end)) < end) {
+        start = i;
+        i = run_end(job, i);
+        if ((i - start) / u >= job->minlen)
+            strs_push(&job->found, start, i - start);
+        ++i;
+    }
+    return NULL;
+}
+
+/* holes hold no strings, so chunks inside them are left out */
+static size_t skip_hole(struct blob const *blob, size_t pos, size_t to)
+{
+    size_t h = ranges_find(&blob->holes, pos);
+
+    if (h < blob->holes.n && blob->holes.r[h].pos <= pos)
+        return min(range_end(&blob->holes.r[h]), to);
+    return pos;
+}
+
+/* like strings(1): utf-16 strings may start at any offset */
+bool strs_find(struct strs *s, struct blob const *blob, size_t from, size_t to,
+        enum strs_enc enc, size_t minlen,
+        bool (*progress)(void *arg, size_t done, size_t total), void *arg)
+{
+    struct strs_job jobs[CONFIG_PARALLEL_MAX];
+    size_t threads = blob_concurrent(blob) ? parallel_threads(to - from) : 1, pos = from, n;
+
+    strs_free(s);
+    s->blob = blob;
+    s->enc = enc;
+
+    while ((pos = skip_hole(blob, pos, to)) < to) {
+        for (n = 0; n < threads && (pos = skip_hole(blob, pos, to)) < to; ++n, pos += jobs[n - 1].len) {
+            jobs[n].blob = blob;
+            jobs[n].enc = enc;
+            jobs[n].minlen = max(1, minlen);
+            jobs[n].from = from;
+            jobs[n].pos = pos;
+            jobs[n].len = min(STRS_CHUNK, to - pos);
+            jobs[n].to = to;
+            jobs[n].span.pos = jobs[n].span.end = 0;
+            strs_init(&jobs[n].found);
+        }
+        parallel_run(strs_thread, jobs, sizeof(*jobs), n);
+
+        /* the chunks are in order, and so are their strings */
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < jobs[i].found.n; ++j)
+                strs_push(s, jobs[i].found.r[j].pos, jobs[i].found.r[j].len);
+            strs_free(&jobs[i].found);
+        }
+
+        if (progress && !progress(arg, pos - from, to - from))
+            return false;
+    }
+    return true;
+}
+
+/* copies string i for display; bytes past the end of the blob are left out */
+size_t strs_text(struct strs const *s, size_t i, char *buf, size_t size)
+{
+    size_t u = unit_size(s->enc), pos = s->r[i].pos, len = blob_length(s->blob), n = 0;
+
+    for (size_t k = 0; k < s->r[i].len && n + 1 < size && pos + k + u <= len; k += u)
+        buf[n++] = blob_at(s->blob, pos + k + (s->enc == STRS_UTF16BE));
+    if (size)
+        buf[n] = 0;
+    return n;
+}
+
+/* whether string i contains needle, compared in place */
+bool strs_match(struct strs const *s, size_t i, char const *needle)
+{
+    size_t u = unit_size(s->enc), off = s->enc == STRS_UTF16BE;
+    size_t pos = s->r[i].pos, len = min(s->r[i].len, blob_length(s->blob) - min(pos, blob_length(s->blob)));
+    size_t m = strlen(needle), k;
+
+    for (size_t start = 0; start + m * u <= len; start += u) {
+        for (k = 0; k < m && blob_at(s->blob, pos + start + k * u + off) == (byte) needle[k]; ++k);
+        if (k == m)
+            return true;
+    }
+    return false;
+}
+
+void strs_list_init(struct strs_list *L)
+{
+    memset(L, 0, sizeof(*L));
+    strs_init(&L->found);
+}
+
+void strs_list_free(struct strs_list *L)
+{
+    strs_free(&L->found);
+    free(L->idx);
+    free(L->filter);
+    strs_list_init(L);
+}
+
+/* keeps the strings containing filter, or all of them if it is empty */
+void strs_list_filter(struct strs_list *L, char const *filter)
+{
+    free(L->filter);
+    L->filter = filter && *filter ? strdup(filter) : NULL;
+
+    L->idx = realloc_strict(L->idx, max(1, L->found.n) * sizeof(*L->idx));
+    L->n = 0;
+    for (size_t i = 0; i < L->found.n; ++i)
+        if (!L->filter || strs_match(&L->found, i, L->filter))
+            L->idx[L->n++] = i;
+    L->top = L->sel = 0;
+}
+
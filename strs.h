@@ -0,0 +1,48 @@
+#ifndef STRS_H
+#define STRS_H
+
+#include "common.h"
+#include "ranges.h"
+#include "blob.h"
+
+/* strings(1) over blob ranges */
+
+enum strs_enc {
+    STRS_ASCII,
+    STRS_UTF16LE,
+    STRS_UTF16BE,
+};
+
+struct strs {
+    struct blob const *blob; /* the blob searched */
+    enum strs_enc enc;
+    size_t n, cap;
+    struct range *r; /* offset and length in bytes of each string; no copies */
+};
+
+/* the result list as shown: the strings matching a filter and the selection */
+struct strs_list {
+    struct strs found;
+    size_t *idx, n; /* indices into found */
+    size_t top, sel; /* into idx */
+    char *filter;
+};
+
+bool strs_lookup_enc(char const *name, enum strs_enc *enc);
+
+void strs_init(struct strs *s);
+void strs_free(struct strs *s);
+
+/* progress is called between rounds; the search stops if it returns false */
+bool strs_find(struct strs *s, struct blob const *blob, size_t from, size_t to,
+        enum strs_enc enc, size_t minlen,
+        bool (*progress)(void *arg, size_t done, size_t total), void *arg);
+
+size_t strs_text(struct strs const *s, size_t i, char *buf, size_t size);
+bool strs_match(struct strs const *s, size_t i, char const *needle);
+
+void strs_list_init(struct strs_list *L);
+void strs_list_free(struct strs_list *L);
+void strs_list_filter(struct strs_list *L, char const *filter);
+
+#endif
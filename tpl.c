@@ -0,0 +1,509 @@
+
+#include "common.h"
+#include "tpl.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+ * Structure templates describe file formats for annotating the hex view.
+ * Whitespace and newlines separate tokens; '#' starts a comment.
+ *
+ *     endian little | big          default byte order of the fields below
+ *     enum $name { $NAME = $n ... }
+ *     struct $name { $field ... }
+ *     root $struct [@ $expr]       what the file is; at offset 0 by default
+ *
+ * A field is
+ *
+ *     $type $name [[$count]] [@ $offset] [: $enum]
+ *
+ * where $type is u8, u16, u32, u64, s8, ..., s64, each optionally suffixed
+ * le or be, char, or a struct. Fields follow each other unless given an
+ * absolute @ $offset. Counts and offsets are expressions over numbers,
+ * earlier fields (looked up in the enclosing structs too, a.b for fields
+ * of struct fields) and $base, the offset of the current struct, with
+ * the operators of C: | ^ & << >> + - * / % and unary - ~.
+ */
+
+struct lexer {
+    FILE *fp;
+    unsigned line;
+    char tok[0x100];
+    int c; /* next character */
+};
+
+static void lex_next(struct lexer *lx)
+{
+    size_t n = 0;
+
+    while (true) {
+        while (isspace(lx->c)) {
+            if (lx->c == '\n')
+                ++lx->line;
+            lx->c = getc(lx->fp);
+        }
+        if (lx->c != '#')
+            break;
+        while (lx->c != EOF && lx->c != '\n')
+            lx->c = getc(lx->fp);
+    }
+
+    if (lx->c == EOF) {
+        *lx->tok = 0;
+        return;
+    }
+
+    if (isalnum(lx->c) || lx->c == '_' || lx->c == '$' || lx->c == '.') {
+        while ((isalnum(lx->c) || lx->c == '_' || lx->c == '$' || lx->c == '.') && n + 1 < sizeof(lx->tok)) {
+            lx->tok[n++] = lx->c;
+            lx->c = getc(lx->fp);
+        }
+    }
+    else {
+        lx->tok[n++] = lx->c;
+        lx->c = getc(lx->fp);
+        if ((*lx->tok == '<' || *lx->tok == '>') && lx->c == *lx->tok) {
+            lx->tok[n++] = lx->c;
+            lx->c = getc(lx->fp);
+        }
+    }
+    lx->tok[n] = 0;
+}
+
+static bool lex_is(struct lexer const *lx, char const *s)
+{
+    return !strcmp(lx->tok, s);
+}
+
+static bool lex_accept(struct lexer *lx, char const *s)
+{
+    if (!lex_is(lx, s))
+        return false;
+    lex_next(lx);
+    return true;
+}
+
+static bool lex_ident(struct lexer const *lx)
+{
+    return isalpha(*lx->tok) || *lx->tok == '_';
+}
+
+static bool lex_number(struct lexer const *lx, uint64_t *n)
+{
+    char *end;
+
+    if (!isdigit(*lx->tok))
+        return false;
+    *n = strtoull(lx->tok, &end, 0);
+    return !*end;
+}
+
+static void expr_free(struct tpl_expr *e)
+{
+    if (!e)
+        return;
+    expr_free(e->a);
+    expr_free(e->b);
+    free(e->name);
+    free(e);
+}
+
+static struct tpl_expr *expr_new(int op)
+{
+    struct tpl_expr *e = malloc_strict(sizeof(*e));
+    memset(e, 0, sizeof(*e));
+    e->op = op;
+    return e;
+}
+
+/* operators by precedence, loosest first; shifts are spelled "<" and ">" in the tree */
+static char const *const levels[][3] = {
+    {"|"}, {"^"}, {"&"}, {"<<", ">>"}, {"+", "-"}, {"*", "/", "%"},
+};
+
+static struct tpl_expr *parse_expr(struct lexer *lx, unsigned level);
+
+static struct tpl_expr *parse_unary(struct lexer *lx)
+{
+    struct tpl_expr *e;
+    uint64_t n;
+
+    if (lex_accept(lx, "(")) {
+        if (!(e = parse_expr(lx, 0)) || !lex_accept(lx, ")")) {
+            expr_free(e);
+            return NULL;
+        }
+        return e;
+    }
+    if (lex_is(lx, "-") || lex_is(lx, "~")) {
+        e = expr_new(lex_is(lx, "-") ? TPL_NEG : TPL_NOT);
+        lex_next(lx);
+        if (!(e->a = parse_unary(lx))) {
+            expr_free(e);
+            return NULL;
+        }
+        return e;
+    }
+    if (lex_number(lx, &n)) {
+        e = expr_new(TPL_NUM);
+        e->num = n;
+    }
+    else if (lex_is(lx, "$base"))
+        e = expr_new(TPL_BASE);
+    else if (lex_ident(lx)) {
+        e = expr_new(TPL_NAME);
+        e->name = strdup(lx->tok);
+    }
+    else
+        return NULL;
+    lex_next(lx);
+    return e;
+}
+
+static struct tpl_expr *parse_expr(struct lexer *lx, unsigned level)
+{
+    struct tpl_expr *e, *b;
+    size_t k;
+
+    if (level == sizeof(levels) / sizeof(*levels))
+        return parse_unary(lx);
+    if (!(e = parse_expr(lx, level + 1)))
+        return NULL;
+
+    while (true) {
+        for (k = 0; k < 3 && levels[level][k] && !lex_is(lx, levels[level][k]); ++k);
+        if (k == 3 || !levels[level][k])
+            return e;
+        lex_next(lx);
+        if (!(b = parse_expr(lx, level + 1))) {
+            expr_free(e);
+            return NULL;
+        }
+        struct tpl_expr *op = expr_new(TPL_BINARY);
+        op->binop = *levels[level][k];
+        op->a = e;
+        op->b = b;
+        e = op;
+    }
+}
+
+/* names of types are resolved once the whole file is read */
+struct pending {
+    size_t n, cap;
+    struct {
+        size_t st, field;
+        char *type, *enm;
+    } *p;
+};
+
+/* st is SIZE_MAX for the root */
+static void pend_push(struct pending *pend, size_t st, size_t field, char const *type, char const *enm)
+{
+    if (pend->n == pend->cap)
+        pend->p = realloc_strict(pend->p, (pend->cap = max(16, 2 * pend->cap)) * sizeof(*pend->p));
+    pend->p[pend->n].st = st;
+    pend->p[pend->n].field = field;
+    pend->p[pend->n].type = type ? strdup(type) : NULL;
+    pend->p[pend->n++].enm = enm ? strdup(enm) : NULL;
+}
+
+static bool parse_int_type(char const *s, struct tpl_field *f, bool big_endian)
+{
+    char *end;
+    unsigned long bits;
+
+    if (*s != 'u' && *s != 's')
+        return false;
+    bits = strtoul(s + 1, &end, 10);
+    if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+        return false;
+    if (*end && strcmp(end, "le") && strcmp(end, "be"))
+        return false;
+
+    f->kind = TPL_INT;
+    f->width = bits / 8;
+    f->is_signed = *s == 's';
+    f->big_endian = *end ? !strcmp(end, "be") : big_endian;
+    return true;
+}
+
+static enum tpl_error parse_struct(struct lexer *lx, struct template *t, struct pending *pend, bool big_endian)
+{
+    struct tpl_struct *st;
+    struct tpl_field *f;
+
+    if (!lex_ident(lx))
+        return TPL_SYNTAX;
+    for (size_t i = 0; i < t->nstructs; ++i)
+        if (!strcmp(t->structs[i].name, lx->tok))
+            return TPL_DUPLICATE;
+
+    t->structs = realloc_strict(t->structs, (t->nstructs + 1) * sizeof(*t->structs));
+    st = &t->structs[t->nstructs++];
+    memset(st, 0, sizeof(*st));
+    st->name = strdup(lx->tok);
+    lex_next(lx);
+    if (!lex_accept(lx, "{"))
+        return TPL_SYNTAX;
+
+    while (!lex_accept(lx, "}")) {
+        if (!lex_ident(lx))
+            return TPL_SYNTAX;
+        st->fields = realloc_strict(st->fields, (st->n + 1) * sizeof(*st->fields));
+        f = &st->fields[st->n++];
+        memset(f, 0, sizeof(*f));
+        f->enm = -1;
+        f->line = lx->line;
+
+        if (lex_is(lx, "char")) {
+            f->kind = TPL_CHAR;
+            f->width = 1;
+        }
+        else if (!parse_int_type(lx->tok, f, big_endian)) {
+            /* a struct, to be looked up later */
+            pend_push(pend, st - t->structs, st->n - 1, lx->tok, NULL);
+            f->kind = TPL_STRUCT;
+        }
+        lex_next(lx);
+
+        if (!lex_ident(lx))
+            return TPL_SYNTAX;
+        f->name = strdup(lx->tok);
+        lex_next(lx);
+
+        if (lex_accept(lx, "[") && (!(f->count = parse_expr(lx, 0)) || !lex_accept(lx, "]")))
+            return TPL_SYNTAX;
+        if (lex_accept(lx, "@") && !(f->at = parse_expr(lx, 0)))
+            return TPL_SYNTAX;
+        if (lex_accept(lx, ":")) {
+            if (!lex_ident(lx) || f->kind != TPL_INT)
+                return TPL_SYNTAX;
+            pend_push(pend, st - t->structs, st->n - 1, NULL, lx->tok);
+            lex_next(lx);
+        }
+    }
+    return TPL_OK;
+}
+
+static enum tpl_error parse_enum(struct lexer *lx, struct template *t)
+{
+    struct tpl_enum *e;
+    uint64_t n;
+
+    if (!lex_ident(lx))
+        return TPL_SYNTAX;
+    for (size_t i = 0; i < t->nenums; ++i)
+        if (!strcmp(t->enums[i].name, lx->tok))
+            return TPL_DUPLICATE;
+
+    t->enums = realloc_strict(t->enums, (t->nenums + 1) * sizeof(*t->enums));
+    e = &t->enums[t->nenums++];
+    memset(e, 0, sizeof(*e));
+    e->name = strdup(lx->tok);
+    lex_next(lx);
+    if (!lex_accept(lx, "{"))
+        return TPL_SYNTAX;
+
+    while (!lex_accept(lx, "}")) {
+        if (!lex_ident(lx))
+            return TPL_SYNTAX;
+        e->v = realloc_strict(e->v, (e->n + 1) * sizeof(*e->v));
+        e->v[e->n].name = strdup(lx->tok);
+        ++e->n;
+        lex_next(lx);
+        if (!lex_accept(lx, "=") || !lex_number(lx, &n))
+            return TPL_SYNTAX;
+        e->v[e->n - 1].value = n;
+        lex_next(lx);
+        lex_accept(lx, ",");
+    }
+    return TPL_OK;
+}
+
+static ssize_t find_struct(struct template const *t, char const *name)
+{
+    for (size_t i = 0; i < t->nstructs; ++i)
+        if (!strcmp(t->structs[i].name, name))
+            return i;
+    return -1;
+}
+
+/* sizes that don't depend on the data, and which structs can reach out of line */
+static void tpl_measure(struct template *t, size_t i, unsigned char *state)
+{
+    struct tpl_struct *st = &t->structs[i];
+    struct tpl_field const *f;
+    size_t size = 0, w;
+
+    if (state[i])
+        return;
+    state[i] = 1; /* in progress: recursive structs aren't fixed */
+    st->fixed = SIZE_MAX;
+
+    for (size_t j = 0; j < st->n; ++j) {
+        f = &st->fields[j];
+        if (f->kind == TPL_STRUCT) {
+            tpl_measure(t, f->type, state);
+            st->has_at |= t->structs[f->type].has_at || state[f->type] == 1;
+        }
+        if (f->at) {
+            st->has_at = true;
+            continue;
+        }
+        w = tpl_field_width(t, f);
+        if (size == SIZE_MAX || w == SIZE_MAX || (f->count && f->count->op != TPL_NUM))
+            size = SIZE_MAX;
+        else
+            size += w * (f->count ? f->count->num : 1);
+    }
+    st->fixed = size;
+    state[i] = 2;
+}
+
+enum tpl_error tpl_load(struct template *t, char const *path, unsigned *line)
+{
+    struct lexer lx = {0};
+    struct pending pend = {0};
+    enum tpl_error err = TPL_OK;
+    bool big_endian = false, have_root = false;
+    unsigned char *state;
+    ssize_t k;
+
+    memset(t, 0, sizeof(*t));
+    *line = 0;
+    if (!(lx.fp = fopen(path, "r")))
+        return TPL_OPEN;
+    lx.line = 1;
+    lx.c = getc(lx.fp);
+    lex_next(&lx);
+
+    while (!err && *lx.tok) {
+        *line = lx.line;
+        if (lex_accept(&lx, "endian")) {
+            if (!lex_is(&lx, "big") && !lex_is(&lx, "little"))
+                err = TPL_SYNTAX;
+            big_endian = lex_is(&lx, "big");
+            lex_next(&lx);
+        }
+        else if (lex_accept(&lx, "struct"))
+            err = parse_struct(&lx, t, &pend, big_endian);
+        else if (lex_accept(&lx, "enum"))
+            err = parse_enum(&lx, t);
+        else if (lex_accept(&lx, "root")) {
+            if (!lex_ident(&lx) || have_root) {
+                err = TPL_SYNTAX;
+                break;
+            }
+            pend_push(&pend, SIZE_MAX, 0, lx.tok, NULL);
+            have_root = true;
+            lex_next(&lx);
+            if (lex_accept(&lx, "@") && !(t->root_at = parse_expr(&lx, 0)))
+                err = TPL_SYNTAX;
+        }
+        else
+            err = TPL_SYNTAX;
+    }
+    if (!err && !have_root)
+        err = TPL_NO_ROOT;
+    fclose(lx.fp);
+
+    for (size_t i = 0; i < pend.n; ++i) {
+        struct tpl_field *f = pend.p[i].st == SIZE_MAX ? NULL : &t->structs[pend.p[i].st].fields[pend.p[i].field];
+        if (!err && pend.p[i].type) {
+            if ((k = find_struct(t, pend.p[i].type)) < 0) {
+                err = TPL_UNKNOWN_TYPE;
+                *line = f ? f->line : *line;
+            }
+            else if (f)
+                f->type = k;
+            else
+                t->root = k;
+        }
+        if (!err && pend.p[i].enm) {
+            for (k = 0; (size_t) k < t->nenums && strcmp(t->enums[k].name, pend.p[i].enm); ++k);
+            if ((size_t) k == t->nenums) {
+                err = TPL_UNKNOWN_ENUM;
+                *line = f->line;
+            }
+            f->enm = k;
+        }
+        free(pend.p[i].type);
+        free(pend.p[i].enm);
+    }
+    free(pend.p);
+
+    if (err) {
+        tpl_free(t);
+        return err;
+    }
+
+    state = malloc_strict(max(1, t->nstructs));
+    memset(state, 0, t->nstructs);
+    for (size_t i = 0; i < t->nstructs; ++i)
+        tpl_measure(t, i, state);
+    free(state);
+    return TPL_OK;
+}
+
+void tpl_free(struct template *t)
+{
+    for (size_t i = 0; i < t->nstructs; ++i) {
+        for (size_t j = 0; j < t->structs[i].n; ++j) {
+            free(t->structs[i].fields[j].name);
+            expr_free(t->structs[i].fields[j].count);
+            expr_free(t->structs[i].fields[j].at);
+        }
+        free(t->structs[i].fields);
+        free(t->structs[i].name);
+    }
+    for (size_t i = 0; i < t->nenums; ++i) {
+        for (size_t j = 0; j < t->enums[i].n; ++j)
+            free(t->enums[i].v[j].name);
+        free(t->enums[i].v);
+        free(t->enums[i].name);
+    }
+    free(t->structs);
+    free(t->enums);
+    expr_free(t->root_at);
+    memset(t, 0, sizeof(*t));
+}
+
+char const *tpl_strerror(enum tpl_error err)
+{
+    switch (err) {
+    case TPL_OK:
+        return "success";
+    case TPL_OPEN:
+        return "can't open template";
+    case TPL_SYNTAX:
+        return "syntax error";
+    case TPL_UNKNOWN_TYPE:
+        return "unknown type";
+    case TPL_UNKNOWN_ENUM:
+        return "unknown enum";
+    case TPL_DUPLICATE:
+        return "duplicate name";
+    case TPL_NO_ROOT:
+        return "no root struct";
+    default:
+        return "unknown error";
+    }
+}
+
+/* bytes per element of the field, or SIZE_MAX if that depends on the data */
+size_t tpl_field_width(struct template const *t, struct tpl_field const *f)
+{
+    return f->kind == TPL_STRUCT ? t->structs[f->type].fixed : f->width;
+}
+
+char const *tpl_enum_name(struct tpl_enum const *e, uint64_t value)
+{
+    for (size_t i = 0; i < e->n; ++i)
+        if (e->v[i].value == value)
+            return e->v[i].name;
+    return NULL;
+}
+
@@ -0,0 +1,76 @@
+#ifndef TPL_H
+#define TPL_H
+
+#include "common.h"
+
+/* structure templates: the language; see tpl.c */
+
+enum tpl_error {
+    TPL_OK = 0,
+    TPL_OPEN,
+    TPL_SYNTAX,
+    TPL_UNKNOWN_TYPE,
+    TPL_UNKNOWN_ENUM,
+    TPL_DUPLICATE,
+    TPL_NO_ROOT,
+};
+
+struct tpl_expr {
+    enum { TPL_NUM, TPL_NAME, TPL_BASE, TPL_NEG, TPL_NOT, TPL_BINARY } op;
+    uint64_t num;
+    char *name; /* dotted path of a field */
+    char binop; /* one of + - * / % & | ^ < (shift left) > (shift right) */
+    struct tpl_expr *a, *b;
+};
+
+enum tpl_kind {
+    TPL_INT,
+    TPL_CHAR,
+    TPL_STRUCT,
+};
+
+struct tpl_field {
+    char *name;
+    enum tpl_kind kind;
+    unsigned width; /* bytes of an integer */
+    bool is_signed, big_endian;
+    size_t type; /* index of the struct for TPL_STRUCT */
+    ssize_t enm; /* index of the enum naming the values, or -1 */
+    struct tpl_expr *count; /* array length, NULL for single values */
+    struct tpl_expr *at; /* absolute offset, NULL if right after the previous field */
+    unsigned line;
+};
+
+struct tpl_struct {
+    char *name;
+    size_t n;
+    struct tpl_field *fields;
+    size_t fixed; /* size if it does not depend on the data, else SIZE_MAX */
+    bool has_at; /* whether instances may have fields elsewhere in the file */
+};
+
+struct tpl_enum {
+    char *name;
+    size_t n;
+    struct tpl_value {
+        uint64_t value;
+        char *name;
+    } *v;
+};
+
+struct template {
+    size_t nstructs, nenums;
+    struct tpl_struct *structs;
+    struct tpl_enum *enums;
+    size_t root;
+    struct tpl_expr *root_at;
+};
+
+enum tpl_error tpl_load(struct template *t, char const *path, unsigned *line);
+void tpl_free(struct template *t);
+char const *tpl_strerror(enum tpl_error err);
+
+size_t tpl_field_width(struct template const *t, struct tpl_field const *f);
+char const *tpl_enum_name(struct tpl_enum const *e, uint64_t value);
+
+#endif
@@ -3,6 +3,8 @@
 #include "blob.h"
 #include "view.h"
 #include "input.h"
+#include "inspect.h"
+#include "strs.h"
 #include "ansi.h"
 
 #include <stdlib.h>
@@ -18,10 +20,18 @@ static size_t view_end(struct view const *view)
     return view->start + view->rows * view->cols;
 }
 
+/* end of the compared blob, in offsets of the primary blob */
+static size_t view_cmp_last(struct view const *view)
+{
+    ssize_t len = blob_length(view->cmp);
+    return len > view->cmp_delta ? len - view->cmp_delta : 0;
+}
+
 void view_init(struct view *view, struct blob *blob, struct input *input)
 {
     memset(view, 0, sizeof(*view));
     view->blob = blob;
+    view->cmp = NULL;
     view->input = input;
     view->pos_digits = 4; /* rather arbitrary */
     view->color = true;
@@ -34,6 +44,10 @@ void view_text(struct view *view, bool leave_alternate)
 {
     if (!view->initialized) return;
 
+    if (view->overview)
+        print(mouse_off);
+    if (view->panel)
+        print(reset_scroll_region);
     if (leave_alternate)
         print(leave_alternate_screen);
     cursor_column(0);
@@ -59,6 +73,11 @@ void view_visual(struct view *view)
 
     print(enter_alternate_screen);
     print(hide_cursor);
+    if (view->overview)
+        print(mouse_on);
+    if (view->panel)
+        scroll_region(view->rows);
+    view->panel_pos = SIZE_MAX;
     fflush(stdout);
 }
 
@@ -87,11 +106,31 @@ void view_set_cols(struct view *view, bool relative, int cols)
     }
 }
 
+/* hex digits needed for offsets into len bytes */
+unsigned view_pos_digits(size_t len)
+{
+    return (bit_length(max(2, len) - 1) + 3) / 4;
+}
+
+/* number of bytes per line that fit into a terminal of the given width */
+unsigned view_fit_cols(unsigned width, unsigned pos_digits, bool cmp)
+{
+    unsigned used = pos_digits + strlen(": ") + strlen("||"), cols;
+
+    if (cmp)
+        used += strlen("  ") + strlen("||");
+    cols = width > used ? (width - used) / ((1 + cmp) * strlen("xx c")) : 0;
+
+    if (cols > CONFIG_ROUND_COLS)
+        cols -= cols % CONFIG_ROUND_COLS;
+    return cols;
+}
+
 void view_recompute(struct view *view, bool winch)
 {
     struct winsize winsz;
     unsigned old_rows = view->rows, old_cols = view->cols;
-    unsigned digs = (bit_length(max(2, blob_length(view->blob)) - 1) + 3) / 4;
+    unsigned digs = view_pos_digits(blob_length(view->blob));
 
     if (digs > view->pos_digits) {
         view->pos_digits = digs;
@@ -103,13 +142,14 @@ void view_recompute(struct view *view, bool winch)
     if (-1 == ioctl(fileno(stdout), TIOCGWINSZ, &winsz))
         pdie("ioctl");
 
-    view->rows = winsz.ws_row;
-    if (!view->cols_fixed) {
-        view->cols = (winsz.ws_col - (view->pos_digits + strlen(": ") + strlen("||"))) / strlen("xx c");
-
-        if (view->cols > CONFIG_ROUND_COLS)
-            view->cols -= view->cols % CONFIG_ROUND_COLS;
-    }
+    /* the inspector and the field at the cursor go below the hex rows, if there is room */
+    view->panel = (view->inspect ? INSPECT_ROWS : 0) + !!view->blob->layout;
+    if (winsz.ws_row <= view->panel)
+        view->panel = 0;
+    view->rows = winsz.ws_row - view->panel;
+    view->width = winsz.ws_col;
+    if (!view->cols_fixed)
+        view->cols = view_fit_cols(winsz.ws_col - 2 * view->overview, view->pos_digits, view->cmp);
 
     if (!view->rows || !view->cols)
         die("window too small.");
@@ -124,9 +164,32 @@ void view_recompute(struct view *view, bool winch)
 
     view_adjust(view);
 
+    /* keep scrolling away from the panel */
+    if (view->panel)
+        scroll_region(view->rows);
+    else
+        print(reset_scroll_region);
+    view->panel_pos = SIZE_MAX;
     print(clear_screen);
 }
 
+/* the overview column is clickable, so mouse reporting is on while it is shown */
+void view_set_overview(struct view *view, bool on)
+{
+    view->overview = on;
+    print(on ? mouse_on : mouse_off);
+    view_recompute(view, true);
+    view_dirty_from(view, 0);
+    view->panel_pos = SIZE_MAX;
+    print(clear_screen);
+}
+
+void view_set_inspect(struct view *view, bool on)
+{
+    view->inspect = on;
+    view_recompute(view, true);
+}
+
 void view_free(struct view *view)
 {
     free(view->dirty);
@@ -148,8 +211,35 @@ void view_error(struct view *view, char const *msg)
     view_message(view, msg, color_red);
 }
 
+/* whether the byte shown at pos differs between the compared blobs */
+static bool view_differs(struct view const *view, size_t pos)
+{
+    struct blob const *A = view->blob, *B = view->cmp;
+    ssize_t q = pos + view->cmp_delta;
+    bool in_a = pos < blob_length(A), in_b = q >= 0 && (size_t) q < blob_length(B);
+
+    if (in_a != in_b)
+        return true;
+    return in_a && blob_at(A, pos) != blob_at(B, q);
+}
+
+/* renders the hex and ascii columns of one line of blob, where the line shows
+ * the bytes at off + delta. the second pane of compare mode is !primary. */
 /* FIXME hex and ascii mode look very similar */
-static void render_line(struct view *view, size_t off, size_t last)
+/* whether a template field starts at pos; neighbouring bytes are mostly in the same field */
+static bool view_field_start(struct view *view, size_t pos)
+{
+    struct layout_hit hit;
+
+    if (pos < view->field.pos || pos >= range_end(&view->field)) {
+        view->field_found = layout_find(view->blob->layout, pos, &hit);
+        view->field.pos = view->field_found ? hit.pos : pos;
+        view->field.len = view->field_found ? hit.len : 1;
+    }
+    return view->field_found && pos == view->field.pos;
+}
+
+static void render_pane(struct view *view, struct blob const *blob, ssize_t delta, size_t off, size_t last, bool primary)
 {
     byte b;
     char digits[0x10], *asciiptr;
@@ -158,44 +248,47 @@ static void render_line(struct view *view, size_t off, size_t last)
     struct input *I = view->input;
 
     size_t sel_start = min(I->cur, I->sel), sel_end = max(I->cur, I->sel);
+    bool select = primary && I->mode == SELECT;
     char const *last_color = NULL, *next_color;
 
     if (!(asciifp = open_memstream(&asciiptr, &asciilen)))
         pdie("open_memstream");
 #define BOTH(EX) for (FILE *fp; ; ) { fp = stdout; EX; fp = asciifp; EX; break; }
 
-    if (off <= I->cur && I->cur < off + view->cols) {
-        /* cursor in current line */
-        if (view->color) print(color_yellow);
-        printf("%0*zx%c ", view->pos_digits, I->cur, I->input_mode.insert ? '+' : '>');
-        if (view->color) print(color_normal);
-    }
-    else {
-        printf("%0*zx: ", view->pos_digits, off);
-    }
-
-    if (I->mode == SELECT && off > sel_start && off <= sel_end)
+    if (select && off > sel_start && off <= sel_end)
         print(underline_on);
 
-    for (size_t j = 0, len = blob_length(view->blob); j < view->cols; ++j) {
+    for (size_t j = 0, len = blob_length(blob); j < view->cols; ++j) {
+
+        ssize_t pos = off + j + delta;
+        bool diff = view->cmp && view_differs(view, off + j);
 
-        if (off + j < len) {
-            sprintf(digits, "%02hhx", b = blob_at(view->blob, off + j));
+        if (pos >= 0 && (size_t) pos < len && blob_unmapped(blob, pos)) {
+            b = ' ';
+            strcpy(digits, "  ");
+        }
+        else if (pos >= 0 && (size_t) pos < len) {
+            sprintf(digits, "%02hhx", b = blob_at(blob, pos));
         }
         else {
             b = 0;
             strcpy(digits, "  ");
         }
 
-        if (I->mode == SELECT && off + j == sel_start)
+        if (select && off + j == sel_start)
             print(underline_on);
 
         if (off + j >= last) {
-            for (size_t p = j; p < view->cols; ++p)
+            for (size_t p = j; p < view->cols; ++p) {
                 printf("   ");
+                if (view->cmp) fputc(' ', asciifp);
+            }
             break;
         }
 
+        if (diff)
+            BOTH(fprint(fp, bold_on));
+
         if (off + j == I->cur) {
             next_color = I->cur >= blob_length(view->blob) ? color_red : color_yellow;
             BOTH(
@@ -203,20 +296,20 @@ static void render_line(struct view *view, size_t off, size_t last)
                 fprint(fp, inverse_video_on);
             );
 
-            if (!I->input_mode.ascii) {
+            if (primary && !I->input_mode.ascii) {
                 print(bold_on);
                 if (I->mode == INPUT && !I->low_nibble) print(underline_on);
                 putchar(digits[0]);
                 if (I->mode == INPUT) print(I->low_nibble ? underline_on : underline_off);
                 putchar(digits[1]);
                 if (I->mode == INPUT && I->low_nibble) print(underline_off);
-                print(bold_off);
+                if (!diff) print(bold_off);
             }
             else
                 printf("%s", digits);
 
-            if (I->mode == INPUT && I->input_mode.ascii)
-                fprintf(asciifp, "%s%s%c%s%s", bold_on, underline_on, isprint(b) ? b : '.', underline_off, bold_off);
+            if (primary && I->mode == INPUT && I->input_mode.ascii)
+                fprintf(asciifp, "%s%s%c%s%s", bold_on, underline_on, isprint(b) ? b : '.', underline_off, diff ? "" : bold_off);
             else
                 fputc(isprint(b) ? b : '.', asciifp);
 
@@ -225,7 +318,8 @@ static void render_line(struct view *view, size_t off, size_t last)
             );
         }
         else {
-            next_color = isalnum(b) ? color_cyan
+            next_color = diff ? color_purple
+                       : isalnum(b) ? color_cyan
                        : isprint(b) ? color_blue
                        : !b ? color_red
                        : color_normal;
@@ -238,10 +332,19 @@ static void render_line(struct view *view, size_t off, size_t last)
         }
         last_color = next_color;
 
-        if (I->mode == SELECT && (off + j == sel_end || j == view->cols - 1))
+        if (diff)
+            BOTH(fprint(fp, bold_off));
+
+        if (select && (off + j == sel_end || j == view->cols - 1))
             print(underline_off);
 
-        putchar(' ');
+        if (primary && view->blob->layout && j + 1 < view->cols && view_field_start(view, off + j + 1)) {
+            if (view->color) print(color_green);
+            putchar('|');
+            last_color = view->color ? color_green : NULL;
+        }
+        else
+            putchar(' ');
     }
     if (view->color) print(color_normal);
 
@@ -255,10 +358,159 @@ static void render_line(struct view *view, size_t off, size_t last)
     putchar('|');
 }
 
+static void render_line(struct view *view, size_t off, size_t last)
+{
+    struct input *I = view->input;
+
+    if (off <= I->cur && I->cur < off + view->cols) {
+        /* cursor in current line */
+        if (view->color) print(color_yellow);
+        printf("%0*zx%c ", view->pos_digits, I->cur, I->input_mode.insert ? '+' : '>');
+        if (view->color) print(color_normal);
+    }
+    else {
+        printf("%0*zx: ", view->pos_digits, off);
+    }
+
+    render_pane(view, view->blob, 0, off, last, true);
+
+    if (view->cmp) {
+        printf("  ");
+        render_pane(view, view->cmp, view->cmp_delta, off, view_cmp_last(view), false);
+    }
+}
+
+/* characters taken by a line of render_line() */
+static unsigned view_line_width(struct view const *view)
+{
+    unsigned pane = view->cols * strlen("xx c") + strlen("||");
+    return view->pos_digits + strlen(": ") + pane + (view->cmp ? strlen("  ") + pane : 0);
+}
+
+/* the blocks summarized in the given row of the overview column */
+static bool overview_segment(struct view const *view, unsigned row, size_t *from, size_t *to)
+{
+    size_t n = view->blob->overview ? view->blob->overview->n : 0;
+
+    if (!n || row >= view->rows)
+        return false;
+    *from = row * n / view->rows;
+    *to = max(*from + 1, (row + 1) * n / view->rows);
+    return true;
+}
+
+/* the glyph is the entropy in bits per byte; zeros, text and near-random data are colored */
+static void render_overview(struct view *view, unsigned row)
+{
+    struct overview_block sum;
+    size_t from, to, first = view->start / OVERVIEW_BLOCK, last = (view_end(view) - 1) / OVERVIEW_BLOCK;
+    char const *color;
+    bool stale, here;
+
+    cursor_column(view_line_width(view) + 1);
+    if (!overview_segment(view, row, &from, &to))
+        return;
+
+    overview_summary(view->blob->overview, from, to, &sum, &stale);
+    here = from <= last && first < to;
+    color = stale ? color_normal
+          : sum.zero >= 230 ? color_red
+          : sum.text >= 192 ? color_cyan
+          : sum.entropy >= 240 ? color_purple
+          : color_normal;
+
+    if (view->color) print(color);
+    if (here) print(inverse_video_on);
+    putchar(stale ? '?' : '0' + (sum.entropy + 16) / 32);
+    if (here) print(inverse_video_off);
+    if (view->color) print(color_normal);
+}
+
+/* the offset a click at the given screen position jumps to */
+bool view_overview_pos(struct view const *view, unsigned row, unsigned col, size_t *pos)
+{
+    size_t from, to;
+
+    if (!view->overview || col != view_line_width(view) + 1 || !overview_segment(view, row, &from, &to))
+        return false;
+    *pos = from * OVERVIEW_BLOCK;
+    return true;
+}
+
+/* computes some of the overview while waiting for input; returns false when there is nothing left */
+bool view_idle(struct view *view)
+{
+    size_t from, to, f, t;
+
+    if (!view->overview || !overview_step(view->blob->overview, view->blob, &from, &to))
+        return false;
+
+    for (unsigned l = 0; l < view->rows; ++l) {
+        if (overview_segment(view, l, &f, &t) && f < to && from < t) {
+            cursor_line(l);
+            render_overview(view, l);
+        }
+    }
+    fflush(stdout);
+    return true;
+}
+
+/* only reads the few bytes under the cursor, so it is cheap to redraw on every move */
+static void render_inspector(struct view *view)
+{
+    char lines[INSPECT_ROWS][INSPECT_WIDTH];
+    byte data[INSPECT_BYTES];
+    size_t cur = view->input->cur, n = min(sizeof(data), blob_length(view->blob) - cur);
+    int width = view->width > view->pos_digits + 2 ? view->width - view->pos_digits - 2 : 0;
+
+    if (n)
+        blob_read_strict(view->blob, cur, data, n);
+    inspect_format(data, n, lines);
+
+    for (unsigned l = 0; l < INSPECT_ROWS; ++l) {
+        cursor_line(view->rows + l);
+        print(clear_line);
+        printf("%*c  %.*s", view->pos_digits, ' ', width, lines[l]);
+    }
+}
+
+/* the template field at the cursor, on the last row of the panel */
+static void render_field(struct view *view)
+{
+    struct layout_hit hit;
+    char text[0x200];
+    int width = view->width > view->pos_digits + 2 ? view->width - view->pos_digits - 2 : 0;
+
+    if (layout_find(view->blob->layout, view->input->cur, &hit))
+        layout_describe(view->blob->layout, &hit, text, sizeof(text));
+    else
+        strcpy(text, "(no field)");
+
+    cursor_line(view->rows + view->panel - 1);
+    print(clear_line);
+    printf("%*c  ", view->pos_digits, ' ');
+    if (view->color) print(color_green);
+    printf("%.*s", width, text);
+    if (view->color) print(color_normal);
+}
+
 void view_update(struct view *view)
 {
     size_t last = max(blob_length(view->blob), view->input->cur + 1);
 
+    if (view->cmp)
+        last = max(last, view_cmp_last(view));
+
+    if (view->overview && !view->blob->overview)
+        view->blob->overview = overview_new(view->blob);
+
+    /* edits dropped parsed fields; their boundaries may have moved anywhere */
+    if (view->blob->layout && view->blob->layout->changed) {
+        view->blob->layout->changed = false;
+        view_dirty_from(view, 0);
+    }
+    view->field.len = 0;
+
     if (view->scroll) {
         printf("\x1b[%ld%c", labs(view->scroll), view->scroll > 0 ? 'S' : 'T');
         view->scroll = 0;
@@ -271,12 +523,56 @@ void view_update(struct view *view)
         cursor_line(l);
         print(clear_line);
         if (i < last)
-            render_line(view, i, last);
+            render_line(view, i, max(blob_length(view->blob), view->input->cur + 1));
+        if (view->overview)
+            render_overview(view, l);
+    }
+
+    if (view->panel && view->panel_pos != view->input->cur) {
+        if (view->inspect)
+            render_inspector(view);
+        if (view->blob->layout)
+            render_field(view);
+        view->panel_pos = view->input->cur;
     }
 
     fflush(stdout);
 }
 
+/* the :strings results, over the whole screen */
+void view_strings(struct view *view, struct strs_list const *L)
+{
+    unsigned rows = view->rows + view->panel - 1;
+    int width = view->width > view->pos_digits + 2 ? view->width - view->pos_digits - 2 : 0;
+    struct range const *r;
+    char text[0x200];
+
+    for (unsigned l = 0; l < rows; ++l) {
+        cursor_line(l);
+        print(clear_line);
+        if (L->top + l >= L->n)
+            continue;
+        r = &L->found.r[L->idx[L->top + l]];
+        strs_text(&L->found, L->idx[L->top + l], text, sizeof(text));
+        for (char *p = text; *p; ++p)
+            *p = *p == '\t' ? ' ' : *p;
+
+        if (L->top + l == L->sel) print(inverse_video_on);
+        printf("%0*zx  %.*s", view->pos_digits, r->pos, width, text);
+        if (L->top + l == L->sel) print(inverse_video_off);
+    }
+
+    cursor_line(rows);
+    print(clear_line);
+    if (view->color) print(color_yellow);
+    printf("%zu of %zu strings", L->n ? L->sel + 1 : 0, L->n);
+    if (L->filter)
+        printf(" containing \"%s\"", L->filter);
+    if (view->color) print(color_normal);
+    printf("  (enter: jump, /: filter, q: close)");
+    fflush(stdout);
+}
+
 void view_dirty_at(struct view *view, size_t pos)
 {
     view_dirty_fromto(view, pos, pos + 1);
@@ -289,7 +585,12 @@ void view_dirty_from(struct view *view, size_t from)
 
 void view_dirty_fromto(struct view *view, size_t from, size_t to)
 {
-    size_t lfrom, lto;
+    size_t lfrom, lto, cur = view->input->cur;
+
+    /* with a template, the field at the cursor may depend on any byte */
+    if (view->blob->layout || (from < cur + INSPECT_BYTES && cur < to))
+        view->panel_pos = SIZE_MAX;
+
     from = max(view->start, from);
     to = min(view_end(view), to);
     if (from < to) {
@@ -324,6 +625,12 @@ void view_adjust(struct view *view)
     assert(view->input->cur >= view->start);
     assert(view->input->cur < view_end(view));
 
+    /* scrolling would move the overview column along */
+    if (view->start != old_start && view->overview) {
+        view_dirty_from(view, 0);
+        return;
+    }
+
     /* scrolling */
     if (view->start != old_start) {
         if (!(((ssize_t) view->start - (ssize_t) old_start) % (ssize_t) view->cols)) {
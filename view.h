@@ -7,12 +7,25 @@
 #include <sys/ioctl.h>
 
 struct input;
+struct strs_list;
 struct view {
     bool initialized;
 
     struct blob *blob;
     struct input *input; /* FIXME hack */
 
+    struct blob *cmp; /* compare mode: shown next to blob */
+    ssize_t cmp_delta; /* blob[i] is aligned with cmp[i + cmp_delta] */
+    bool cmp_resync; /* re-align automatically when jumping to differences */
+
+    bool overview; /* show a column of block statistics on the right */
+
+    bool inspect; /* decode the bytes at the cursor below the hex view */
+    unsigned panel; /* screen rows taken by the inspector and the template field */
+    size_t panel_pos; /* cursor position the panel was drawn for; SIZE_MAX if stale */
+    struct range field; /* last template field looked up while drawing */
+    bool field_found;
+
     size_t start;
 
     uint8_t *dirty;
@@ -20,6 +33,7 @@ struct view {
 
     bool cols_fixed;
     unsigned rows, cols;
+    unsigned width; /* of the terminal */
     unsigned pos_digits;
     bool color;
     bool winch;
@@ -31,14 +45,21 @@ struct view {
 void view_init(struct view *view, struct blob *blob, struct input *input);
 void view_text(struct view *view, bool leave_alternate);
 void view_visual(struct view *view);
+unsigned view_pos_digits(size_t len);
+unsigned view_fit_cols(unsigned width, unsigned pos_digits, bool cmp);
 void view_recompute(struct view *view, bool winch);
 void view_set_cols(struct view *view, bool relative, int cols);
+void view_set_overview(struct view *view, bool on);
+void view_set_inspect(struct view *view, bool on);
+bool view_overview_pos(struct view const *view, unsigned row, unsigned col, size_t *pos);
 void view_free(struct view *view);
 
 void view_message(struct view *view, char const *msg, char const *color);
 void view_error(struct view *view, char const *msg);
 
 void view_update(struct view *view);
+void view_strings(struct view *view, struct strs_list const *L);
+bool view_idle(struct view *view);
 
 void view_dirty_at(struct view *view, size_t pos);
 void view_dirty_from(struct view *view, size_t from);
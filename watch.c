@@ -0,0 +1,130 @@
+
+#include "common.h"
+#include "watch.h"
+#include "blob.h"
+#include "hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+/*
+ * A change by someone else is noticed through inotify where available, and
+ * confirmed by comparing the file's identity with the one recorded when the
+ * blob was last in sync with it.  Blocks keep the blob's own bytes until
+ * they are first modified, so only those need a checksum of what the file
+ * held: it tells a reload whether the file changed under local edits.
+ */
+
+static void watch_add(struct watch *w, char const *filename)
+{
+    if (w->fd >= 0 && 0 > inotify_add_watch(w->fd, filename,
+                IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)) {
+        close(w->fd);
+        w->fd = -1;
+    }
+}
+
+struct watch *watch_new(char const *filename)
+{
+    struct watch *w = malloc_strict(sizeof(*w));
+
+    memset(w, 0, sizeof(*w));
+    ranges_init(&w->modified);
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watch_add(w, filename);
+    file_id_get(filename, &w->id);
+    return w;
+}
+
+void watch_free(struct watch *w)
+{
+    if (!w)
+        return;
+    if (w->fd >= 0)
+        close(w->fd);
+    ranges_free(&w->modified);
+    free(w->sums);
+    free(w);
+}
+
+uint64_t watch_sum(byte const *data, size_t len)
+{
+    struct hash h;
+    byte digest[HASH_MAX_SIZE];
+    uint64_t sum = 0;
+
+    hash_init(&h, HASH_XXH64);
+    hash_update(&h, data, len);
+    hash_final(&h, digest);
+    for (size_t i = 0; i < hash_size(HASH_XXH64); ++i)
+        sum = sum << 8 | digest[i];
+    return sum;
+}
+
+bool watch_block_modified(struct watch const *w, size_t idx)
+{
+    return ranges_intersects(&w->modified, idx * WATCH_BLOCK, WATCH_BLOCK);
+}
+
+/* bytes [pos, pos + len) are about to be overwritten in place */
+void watch_touch(struct watch *w, struct blob const *blob, size_t pos, size_t len)
+{
+    size_t from;
+
+    if (!w || !len)
+        return;
+
+    for (size_t i = pos / WATCH_BLOCK; !w->moved && i <= (pos + len - 1) / WATCH_BLOCK; ++i) {
+        if (watch_block_modified(w, i))
+            continue;
+        if (i >= w->n)
+            w->sums = realloc_strict(w->sums, (w->n = max(i + 1, 2 * w->n)) * sizeof(*w->sums));
+        from = i * WATCH_BLOCK;
+        w->sums[i] = watch_sum(blob->data + from, min(WATCH_BLOCK, blob_length(blob) - from));
+    }
+    ranges_add(&w->modified, pos, len);
+}
+
+/* offsets no longer match the file's */
+void watch_moved(struct watch *w)
+{
+    if (w)
+        w->moved = true;
+}
+
+/* whether the file was just found to differ from when the blob was last in sync with it */
+bool watch_poll(struct watch *w, char const *filename)
+{
+    char buf[0x1000];
+    struct file_id id;
+    bool events = w->fd < 0;
+
+    while (w->fd >= 0 && 0 < read(w->fd, buf, sizeof(buf)))
+        events = true;
+    if (w->changed || !events)
+        return false;
+
+    file_id_get(filename, &id);
+    return w->changed = !!memcmp(&id, &w->id, sizeof(id));
+}
+
+/* the file as it is now counts as the base of the blob's own modifications */
+void watch_resync(struct watch *w, char const *filename)
+{
+    char buf[0x1000];
+
+    while (w->fd >= 0 && 0 < read(w->fd, buf, sizeof(buf)));
+    /* the file may be a new one by now, e.g. after a rename over it */
+    watch_add(w, filename);
+    file_id_get(filename, &w->id);
+    w->changed = false;
+}
+
+/* the blob was written to the file, so nothing is modified any more */
+void watch_saved(struct watch *w, char const *filename)
+{
+    watch_resync(w, filename);
+    ranges_clear(&w->modified);
+    w->moved = false;
+}
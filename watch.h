@@ -0,0 +1,36 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "common.h"
+#include "ranges.h"
+
+struct blob;
+
+/* notices when the file behind a blob is changed by someone else */
+
+#define WATCH_BLOCK 0x10000
+
+struct watch {
+    struct file_id id; /* the file when the blob was last in sync with it */
+    int fd; /* inotify instance, or -1 where that is unavailable */
+    bool changed; /* the file no longer matches id */
+    bool moved; /* bytes were inserted or deleted since */
+    struct ranges modified; /* bytes changed here since */
+    size_t n;
+    uint64_t *sums; /* checksums of the file's blocks, taken before their first modification */
+};
+
+struct watch *watch_new(char const *filename);
+void watch_free(struct watch *w);
+
+void watch_touch(struct watch *w, struct blob const *blob, size_t pos, size_t len);
+void watch_moved(struct watch *w);
+
+bool watch_poll(struct watch *w, char const *filename);
+void watch_resync(struct watch *w, char const *filename);
+void watch_saved(struct watch *w, char const *filename);
+
+uint64_t watch_sum(byte const *data, size_t len);
+bool watch_block_modified(struct watch const *w, size_t idx);
+
+#endif
@@ -0,0 +1,247 @@
+
+#include "common.h"
+#include "xform.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* bytes per pass of the pattern kernels; long enough for the compiler to vectorize */
+#define XFORM_BLOCK 0x1000
+
+
+void xform_init(struct xform *x)
+{
+    memset(x, 0, sizeof(*x));
+    x->width = 1;
+}
+
+void xform_free(struct xform *x)
+{
+    free(x->pat);
+    free(x->blk);
+    xform_init(x);
+}
+
+static uint64_t load(byte const *p, unsigned width, bool big_endian)
+{
+    uint64_t v = 0;
+    for (unsigned k = 0; k < width; ++k)
+        v |= (uint64_t) p[big_endian ? width - 1 - k : k] << 8 * k;
+    return v;
+}
+
+static void store(byte *p, uint64_t v, unsigned width, bool big_endian)
+{
+    for (unsigned k = 0; k < width; ++k)
+        p[big_endian ? width - 1 - k : k] = v >> 8 * k;
+}
+
+/* applies x to data[from, to) of a range of len bytes. from and to are
+ * multiples of xform_grain(); for XFORM_REVERSE they index the first half. */
+static void xform_kernel(struct xform const *x, byte *restrict data, size_t len, size_t from, size_t to)
+{
+    byte const *restrict blk = x->blk;
+    size_t i, j, n;
+
+    switch (x->op) {
+    case XFORM_FILL:
+        for (i = from; i < to; i += n)
+            memcpy(data + i, blk, n = min(x->blklen, to - i));
+        break;
+    case XFORM_XOR:
+        for (i = from; i < to; i += n)
+            for (j = 0, n = min(x->blklen, to - i); j < n; ++j)
+                data[i + j] ^= blk[j];
+        break;
+    case XFORM_AND:
+        for (i = from; i < to; i += n)
+            for (j = 0, n = min(x->blklen, to - i); j < n; ++j)
+                data[i + j] &= blk[j];
+        break;
+    case XFORM_OR:
+        for (i = from; i < to; i += n)
+            for (j = 0, n = min(x->blklen, to - i); j < n; ++j)
+                data[i + j] |= blk[j];
+        break;
+    case XFORM_NOT:
+        for (i = from; i < to; ++i)
+            data[i] = ~data[i];
+        break;
+    case XFORM_ADD:
+        if (x->width == 1) {
+            for (i = from; i < to; ++i)
+                data[i] += x->n;
+            break;
+        }
+        /* a trailing partial element is left alone */
+        for (i = from; i + x->width <= to; i += x->width)
+            store(data + i, load(data + i, x->width, x->big_endian) + x->n, x->width, x->big_endian);
+        break;
+    case XFORM_REVERSE:
+        for (i = from; i < to; ++i) {
+            byte b = data[i];
+            data[i] = data[len - 1 - i];
+            data[len - 1 - i] = b;
+        }
+        break;
+    case XFORM_SWAP:
+        for (i = from; i + x->width <= to; i += x->width)
+            store(data + i, load(data + i, x->width, false), x->width, true);
+        break;
+    default:
+        die("unknown transformation");
+    }
+}
+
+/* chunks handed to threads must start at a multiple of this */
+static size_t xform_grain(struct xform const *x)
+{
+    switch (x->op) {
+    case XFORM_FILL: case XFORM_XOR: case XFORM_AND: case XFORM_OR:
+        return x->blklen;
+    case XFORM_ADD: case XFORM_SWAP:
+        return x->width;
+    default:
+        return 1;
+    }
+}
+
+struct xform_job {
+    struct xform const *x;
+    byte *data;
+    size_t len, from, to;
+};
+
+static void *xform_thread(void *arg)
+{
+    struct xform_job *job = arg;
+    xform_kernel(job->x, job->data, job->len, job->from, job->to);
+    return NULL;
+}
+
+/* splits large ranges across one thread per processor */
+static void xform_run(struct xform const *x, byte *data, size_t len)
+{
+    struct xform_job jobs[CONFIG_PARALLEL_MAX];
+    size_t end = x->op == XFORM_REVERSE ? len / 2 : len;
+    size_t grain = xform_grain(x), n = parallel_threads(end);
+    size_t chunk = (end / n + grain - 1) / grain * grain;
+
+    for (size_t i = 0; i < n; ++i) {
+        jobs[i].x = x;
+        jobs[i].data = data;
+        jobs[i].len = len;
+        jobs[i].from = min(end, i * chunk);
+        jobs[i].to = i + 1 < n ? min(end, (i + 1) * chunk) : end;
+    }
+    parallel_run(xform_thread, jobs, sizeof(*jobs), n);
+}
+
+/* applies x to [pos, pos + len) of the blob as a single undo step */
+void xform_apply(struct xform const *x, struct blob *blob, size_t pos, size_t len)
+{
+    byte *data;
+
+    if (!len)
+        return;
+    data = blob_begin_write(blob, pos, len, true);
+    xform_run(x, data, len);
+    blob_end_write(blob, pos, len);
+}
+
+static enum xform_error parse_pattern(struct xform *x, char const *arg)
+{
+    if (!arg || !(x->patlen = unhex(&x->pat, arg)))
+        return XFORM_PATTERN;
+
+    x->blklen = (XFORM_BLOCK + x->patlen - 1) / x->patlen * x->patlen;
+    x->blk = malloc_strict(x->blklen);
+    for (size_t i = 0; i < x->blklen; i += x->patlen)
+        memcpy(x->blk + i, x->pat, x->patlen);
+    return XFORM_OK;
+}
+
+static bool parse_width(struct xform *x, char const *arg)
+{
+    char *end;
+    unsigned long w = strtoul(arg, &end, 10);
+
+    if (*end || (w != 1 && w != 2 && w != 4 && w != 8))
+        return false;
+    x->width = w;
+    return true;
+}
+
+/* args are the rest of the command line, split on spaces */
+enum xform_error xform_parse(struct xform *x, char const *name, char *args)
+{
+    static struct {
+        char const *name;
+        enum xform_op op;
+    } const ops[] = {
+        {"fill", XFORM_FILL},
+        {"xor", XFORM_XOR},
+        {"and", XFORM_AND},
+        {"or", XFORM_OR},
+        {"not", XFORM_NOT},
+        {"add", XFORM_ADD},
+        {"reverse", XFORM_REVERSE},
+        {"swap-endian", XFORM_SWAP},
+    };
+    char *arg, *end;
+    size_t i;
+
+    for (i = 0; i < sizeof(ops) / sizeof(*ops) && strcmp(ops[i].name, name); ++i);
+    if (i == sizeof(ops) / sizeof(*ops))
+        return XFORM_UNKNOWN;
+    x->op = ops[i].op;
+    arg = args ? strtok(args, " ") : NULL;
+
+    switch (x->op) {
+    case XFORM_FILL: case XFORM_XOR: case XFORM_AND: case XFORM_OR:
+        return parse_pattern(x, arg);
+
+    case XFORM_ADD:
+        if (!arg)
+            return XFORM_NUMBER;
+        x->n = strtoull(arg, &end, 0); /* negative numbers wrap around */
+        if (*end)
+            return XFORM_NUMBER;
+        if ((arg = strtok(NULL, " ")) && !parse_width(x, arg))
+            return XFORM_WIDTH;
+        if (arg && (arg = strtok(NULL, " "))) {
+            if (strcmp(arg, "le") && strcmp(arg, "be"))
+                return XFORM_WIDTH;
+            x->big_endian = !strcmp(arg, "be");
+        }
+        return XFORM_OK;
+
+    case XFORM_SWAP:
+        if (!arg || !parse_width(x, arg) || x->width == 1)
+            return XFORM_WIDTH;
+        return XFORM_OK;
+
+    default:
+        return XFORM_OK;
+    }
+}
+
+char const *xform_strerror(enum xform_error err)
+{
+    switch (err) {
+    case XFORM_OK:
+        return "success";
+    case XFORM_UNKNOWN:
+        return "unknown transformation";
+    case XFORM_PATTERN:
+        return "expected hex bytes";
+    case XFORM_NUMBER:
+        return "expected a number";
+    case XFORM_WIDTH:
+        return "bad element width or byte order";
+    default:
+        return "unknown error";
+    }
+}
+
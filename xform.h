@@ -0,0 +1,48 @@
+#ifndef XFORM_H
+#define XFORM_H
+
+#include "common.h"
+#include "blob.h"
+
+/* in-place transformations of a range of bytes */
+
+enum xform_op {
+    XFORM_FILL,
+    XFORM_XOR,
+    XFORM_AND,
+    XFORM_OR,
+    XFORM_NOT,
+    XFORM_ADD,
+    XFORM_REVERSE,
+    XFORM_SWAP,
+};
+
+struct xform {
+    enum xform_op op;
+
+    byte *pat; /* repeated from the start of the range */
+    size_t patlen;
+    byte *blk; /* pat repeated to a whole number of copies of at least XFORM_BLOCK bytes */
+    size_t blklen;
+
+    uint64_t n; /* added to every element */
+    unsigned width; /* bytes per element */
+    bool big_endian;
+};
+
+enum xform_error {
+    XFORM_OK = 0,
+    XFORM_UNKNOWN,
+    XFORM_PATTERN,
+    XFORM_NUMBER,
+    XFORM_WIDTH,
+};
+
+void xform_init(struct xform *x);
+void xform_free(struct xform *x);
+
+enum xform_error xform_parse(struct xform *x, char const *name, char *args);
+void xform_apply(struct xform const *x, struct blob *blob, size_t pos, size_t len);
+char const *xform_strerror(enum xform_error err);
+
+#endif